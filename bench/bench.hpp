@@ -0,0 +1,168 @@
+#pragma once
+
+#ifndef XCLIPP_BENCH_BENCH_HPP
+#define XCLIPP_BENCH_BENCH_HPP
+
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace xcpp::bench
+{
+
+// prevents compiler from optimizing away computation of `value`
+template <class T>
+inline void DoNotOptimize(const T& value) noexcept
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// `size` bytes built of randomly chosen `pieces`
+inline std::string MakeCorpus(std::size_t size, std::initializer_list<std::string_view> pieces)
+{
+    std::mt19937 gen{42};
+    std::uniform_int_distribution<std::size_t> dist{0, pieces.size() - 1};
+    std::string corpus;
+    corpus.reserve(size + 16);
+    while (corpus.size() < size)
+    {
+        corpus += pieces.begin()[dist(gen)];
+    }
+    return corpus;
+}
+
+// counts CPU cycles of the calling thread in user space, unavailable if perf events are not permitted
+class CycleCounter
+{
+public:
+    CycleCounter() noexcept
+    {
+        perf_event_attr attr = {};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    CycleCounter(const CycleCounter&) = delete;
+
+    CycleCounter& operator=(const CycleCounter&) = delete;
+
+    ~CycleCounter()
+    {
+        if (fd_ != -1)
+        {
+            close(fd_);
+        }
+    }
+
+    // cycles counted since creation
+    std::optional<std::uint64_t> Read() const noexcept
+    {
+        std::uint64_t cycles = 0;
+        if (fd_ == -1 || read(fd_, &cycles, sizeof(cycles)) != sizeof(cycles))
+        {
+            return {};
+        }
+        return cycles;
+    }
+
+private:
+    int fd_;
+};
+
+struct Runs
+{
+    std::size_t count = 0;
+    double seconds = 0;
+    // CPU cycles of all runs, if they can be counted
+    std::optional<std::uint64_t> cycles;
+};
+
+// runs `fn` repeatedly for at least `min_time`
+template <std::invocable F>
+Runs Repeat(F&& fn, std::chrono::nanoseconds min_time)
+{
+    using clock = std::chrono::steady_clock;
+
+    fn(); // warm up caches and page in buffers
+    CycleCounter cycle_counter;
+    auto start_cycles = cycle_counter.Read();
+    Runs runs;
+    auto start = clock::now();
+    auto elapsed = clock::duration::zero();
+    do
+    {
+        fn();
+        ++runs.count;
+        elapsed = clock::now() - start;
+    } while (elapsed < min_time);
+    auto end_cycles = cycle_counter.Read();
+
+    runs.seconds = std::chrono::duration<double>(elapsed).count();
+    if (start_cycles && end_cycles && *end_cycles != *start_cycles)
+    {
+        runs.cycles = *end_cycles - *start_cycles;
+    }
+    return runs;
+}
+
+// runs `fn` repeatedly for at least `min_time` and reports throughput for `bytes` processed per run,
+// also in bytes per CPU cycle if cycles can be counted
+template <std::invocable F>
+void Measure(
+    std::string_view name,
+    std::size_t bytes,
+    F&& fn,
+    std::chrono::nanoseconds min_time = std::chrono::milliseconds{500})
+{
+    auto runs = Repeat(fn, min_time);
+    double mb_per_s = static_cast<double>(bytes) * runs.count / runs.seconds / 1e6;
+    std::printf("%-48.*s %12zu B %10.1f MB/s", static_cast<int>(name.size()), name.data(), bytes, mb_per_s);
+    if (runs.cycles)
+    {
+        std::printf(" %8.3f B/cycle\n", static_cast<double>(bytes) * runs.count / *runs.cycles);
+    }
+    else
+    {
+        std::printf("\n");
+    }
+}
+
+// as above, but reports time per run, for work not proportional to input size, e.g. early rejection
+template <std::invocable F>
+void MeasureCalls(
+    std::string_view name,
+    std::size_t bytes,
+    F&& fn,
+    std::chrono::nanoseconds min_time = std::chrono::milliseconds{500})
+{
+    auto runs = Repeat(fn, min_time);
+    double ns_per_call = runs.seconds / runs.count * 1e9;
+    std::printf("%-48.*s %12zu B %10.1f ns/call", static_cast<int>(name.size()), name.data(), bytes, ns_per_call);
+    if (runs.cycles)
+    {
+        std::printf(" %8.1f cycles/call\n", static_cast<double>(*runs.cycles) / runs.count);
+    }
+    else
+    {
+        std::printf("\n");
+    }
+}
+
+} // namespace xcpp::bench
+
+#endif // XCLIPP_BENCH_BENCH_HPP
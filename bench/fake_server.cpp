@@ -0,0 +1,854 @@
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+#include "fake_server.hpp"
+#include "transport.hpp"
+#include "utils.hpp"
+
+namespace xcpp::bench
+{
+
+// byte order of the host is used, as clients are in the same process
+
+static std::uint16_t get16(const char* p) noexcept
+{
+    std::uint16_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static std::uint32_t get32(const char* p) noexcept
+{
+    std::uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void put8(std::string& s, std::uint8_t v)
+{
+    s.push_back(static_cast<char>(v));
+}
+
+static void put16(std::string& s, std::uint16_t v)
+{
+    s.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+static void put32(std::string& s, std::uint32_t v)
+{
+    s.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+static std::size_t pad4(std::size_t n) noexcept
+{
+    return (n + 3) & ~std::size_t{3};
+}
+
+// value of `bit` attribute in the list of values present in `mask`, which follows the mask in requests
+static std::optional<std::uint32_t> attribute(
+    std::uint32_t mask, std::uint32_t bit, const char* values, std::size_t size) noexcept
+{
+    if ((mask & bit) == 0)
+    {
+        return {};
+    }
+    std::size_t index = std::popcount(mask & (bit - 1));
+    if (4 * (index + 1) > size)
+    {
+        return {};
+    }
+    return get32(values + 4 * index);
+}
+
+// predefined atoms of the core protocol, atom `a` is at index `a - 1`
+static constexpr std::string_view predefined_atoms[] =
+{
+    "PRIMARY", "SECONDARY", "ARC", "ATOM", "BITMAP", "CARDINAL", "COLORMAP", "CURSOR",
+    "CUT_BUFFER0", "CUT_BUFFER1", "CUT_BUFFER2", "CUT_BUFFER3",
+    "CUT_BUFFER4", "CUT_BUFFER5", "CUT_BUFFER6", "CUT_BUFFER7",
+    "DRAWABLE", "FONT", "INTEGER", "PIXMAP", "POINT", "RECTANGLE", "RESOURCE_MANAGER",
+    "RGB_COLOR_MAP", "RGB_BEST_MAP", "RGB_BLUE_MAP", "RGB_DEFAULT_MAP", "RGB_GRAY_MAP", "RGB_GREEN_MAP",
+    "RGB_RED_MAP", "STRING", "VISUALID", "WINDOW", "WM_COMMAND", "WM_HINTS", "WM_CLIENT_MACHINE",
+    "WM_ICON_NAME", "WM_ICON_SIZE", "WM_NAME", "WM_NORMAL_HINTS", "WM_SIZE_HINTS", "WM_ZOOM_HINTS",
+    "MIN_SPACE", "NORM_SPACE", "MAX_SPACE", "END_SPACE", "SUPERSCRIPT_X", "SUPERSCRIPT_Y",
+    "SUBSCRIPT_X", "SUBSCRIPT_Y", "UNDERLINE_POSITION", "UNDERLINE_THICKNESS", "STRIKEOUT_ASCENT",
+    "STRIKEOUT_DESCENT", "ITALIC_ANGLE", "X_HEIGHT", "QUAD_WIDTH", "WEIGHT", "POINT_SIZE", "RESOLUTION",
+    "COPYRIGHT", "NOTICE", "FONT_NAME", "FAMILY_NAME", "FULL_NAME", "CAP_HEIGHT", "WM_CLASS",
+    "WM_TRANSIENT_FOR"
+};
+
+FakeServer::FakeServer(const FakeServerOptions& options) : options_{options}
+{
+    int wake[2];
+    if (pipe2(wake, O_CLOEXEC) == -1)
+    {
+        throw std::runtime_error("Failed to create pipe");
+    }
+    wake_read_ = FileDescriptor{wake[0]};
+    wake_write_ = FileDescriptor{wake[1]};
+
+    for (auto name : predefined_atoms)
+    {
+        atom_names_.emplace_back(name);
+        atoms_[atom_names_.back()] = atom_names_.size();
+    }
+    windows_[root_window] = {no_client, {}, {}};
+    thread_ = std::thread{&FakeServer::Serve, this};
+}
+
+FakeServer::~FakeServer()
+{
+    wake_write_.Reset(); // serving thread stops on EOF
+    thread_.join();
+}
+
+std::pair<Connection, int> FakeServer::Connect() const
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1)
+    {
+        throw std::runtime_error("Failed to create socket pair");
+    }
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    {
+        std::lock_guard lock{pending_mutex_};
+        pending_.emplace_back(fds[1]);
+    }
+    char c = 0;
+    write(wake_write_.Get(), &c, 1);
+
+    // takes ownership of the fd, blocks until setup is handled by serving thread
+    Connection connection{xcb_connect_to_fd(fds[0], nullptr), xcb_disconnect};
+    if (int err = xcb_connection_has_error(connection.get()))
+    {
+        throw std::runtime_error("Failed to connect to fake X server, XCB_CONN_* error code " + std::to_string(err));
+    }
+    return {std::move(connection), 0};
+}
+
+void FakeServer::Serve()
+{
+    std::vector<pollfd> fds;
+    std::vector<std::size_t> ids;
+    while (true)
+    {
+        fds.assign(1, {wake_read_.Get(), POLLIN, 0});
+        ids.assign(1, no_client);
+        for (auto& [id, client] : clients_)
+        {
+            short events = client.out.size() == client.out_offset ? POLLIN : POLLIN | POLLOUT;
+            fds.push_back({client.fd.Get(), events, 0});
+            ids.push_back(id);
+        }
+        if (poll(fds.data(), fds.size(), -1) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+
+        if (fds[0].revents != 0)
+        {
+            char buf[64];
+            if (read(wake_read_.Get(), buf, sizeof(buf)) <= 0)
+            {
+                return;
+            }
+            AcceptPending();
+        }
+        for (std::size_t i = 1; i < fds.size(); ++i)
+        {
+            std::size_t id = ids[i];
+            if (!clients_.contains(id))
+            {
+                continue; // disconnected while handling another client
+            }
+            if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0)
+            {
+                if (!ReadInput(id))
+                {
+                    Disconnect(id);
+                    continue;
+                }
+                HandleInput(id);
+            }
+        }
+        // replies and events are written as soon as possible, including ones to clients which haven't asked
+        for (auto it = clients_.begin(); it != clients_.end();)
+        {
+            auto& client = it->second;
+            bool is_broken = false;
+            while (client.out_offset != client.out.size())
+            {
+                ssize_t n = write(
+                    client.fd.Get(), client.out.data() + client.out_offset, client.out.size() - client.out_offset);
+                if (n == -1)
+                {
+                    is_broken = errno != EAGAIN && errno != EINTR;
+                    break;
+                }
+                client.out_offset += n;
+            }
+            if (client.out_offset == client.out.size())
+            {
+                client.out.clear();
+                client.out_offset = 0;
+            }
+            auto id = it++->first;
+            if (is_broken)
+            {
+                Disconnect(id);
+            }
+        }
+    }
+}
+
+void FakeServer::AcceptPending()
+{
+    std::lock_guard lock{pending_mutex_};
+    for (auto& fd : pending_)
+    {
+        clients_[next_client_++].fd = std::move(fd);
+    }
+    pending_.clear();
+}
+
+bool FakeServer::ReadInput(std::size_t client)
+{
+    auto& state = clients_[client];
+    // drop handled input before appending more
+    if (state.in_offset != 0)
+    {
+        state.in.erase(0, state.in_offset);
+        state.in_offset = 0;
+    }
+    while (true)
+    {
+        ssize_t n = read(state.fd.Get(), read_buffer_.data(), read_buffer_.size());
+        if (n > 0)
+        {
+            state.in.append(read_buffer_.data(), n);
+        }
+        if (n == 0)
+        {
+            return false;
+        }
+        if (n == -1)
+        {
+            return errno == EAGAIN || errno == EINTR;
+        }
+    }
+}
+
+void FakeServer::HandleInput(std::size_t client)
+{
+    auto& state = clients_[client];
+    if (!state.is_set_up)
+    {
+        SetUp(client);
+        if (!state.is_set_up)
+        {
+            return;
+        }
+    }
+    while (clients_.contains(client))
+    {
+        const char* p = state.in.data() + state.in_offset;
+        std::size_t left = state.in.size() - state.in_offset;
+        if (left < 4)
+        {
+            return;
+        }
+        std::size_t header_size = 4;
+        std::size_t length = get16(p + 2);
+        if (length == 0 && state.big_requests)
+        {
+            if (left < 8)
+            {
+                return;
+            }
+            header_size = 8;
+            length = get32(p + 4);
+        }
+        std::size_t limit = state.big_requests ? options_.big_request_length : options_.max_request_length;
+        if (4 * length < header_size || length > limit)
+        {
+            // the rest of the stream can't be parsed, as real server does, drop the client
+            ++state.sequence;
+            SendError(client, XCB_LENGTH, 0, {static_cast<std::uint8_t>(p[0]), 0, nullptr, 0});
+            Disconnect(client);
+            return;
+        }
+        if (left < 4 * length)
+        {
+            return;
+        }
+        state.in_offset += 4 * length;
+        ++state.sequence;
+        ++time_;
+        Request req{
+            static_cast<std::uint8_t>(p[0]), static_cast<std::uint8_t>(p[1]),
+            p + header_size, 4 * length - header_size};
+        HandleRequest(client, req);
+    }
+}
+
+void FakeServer::SetUp(std::size_t client)
+{
+    auto& state = clients_[client];
+    if (state.in.size() < 12)
+    {
+        return;
+    }
+    std::size_t size = 12 + pad4(get16(state.in.data() + 6)) + pad4(get16(state.in.data() + 8));
+    if (state.in.size() < size)
+    {
+        return;
+    }
+    state.in_offset = size;
+    state.is_set_up = true;
+
+    constexpr std::string_view vendor = "fake";
+    std::string data;
+    put32(data, 0); // release
+    put32(data, (client + 1) << 21); // resource id base
+    put32(data, (1 << 21) - 1); // resource id mask
+    put32(data, 0); // motion buffer size
+    put16(data, vendor.size());
+    put16(data, options_.max_request_length);
+    put8(data, 1); // screens
+    put8(data, 0); // pixmap formats
+    put8(data, 0); // image byte order
+    put8(data, 0); // bitmap bit order
+    put8(data, 32); // scanline unit
+    put8(data, 32); // scanline pad
+    put8(data, 8); // min keycode
+    put8(data, 255); // max keycode
+    put32(data, 0);
+    data += vendor;
+    data.resize(pad4(data.size()));
+    // screen without depths, only its root window is used
+    put32(data, root_window);
+    put32(data, 0); // colormap
+    put32(data, 0xFFFFFF); // white pixel
+    put32(data, 0); // black pixel
+    put32(data, 0); // input masks
+    put16(data, 64); // width and height in pixels and millimeters
+    put16(data, 64);
+    put16(data, 17);
+    put16(data, 17);
+    put16(data, 1); // installed maps
+    put16(data, 1);
+    put32(data, 0); // root visual
+    put8(data, 0); // backing stores
+    put8(data, 0); // save unders
+    put8(data, 24); // root depth
+    put8(data, 0); // depths
+
+    std::string reply;
+    put8(reply, 1); // success
+    put8(reply, 0);
+    put16(reply, 11);
+    put16(reply, 0);
+    put16(reply, data.size() / 4);
+    clients_[client].out += reply + data;
+}
+
+void FakeServer::HandleRequest(std::size_t client, const Request& req)
+{
+    const char* b = req.body;
+    auto has = [&req](std::size_t size) { return req.size >= size; };
+    auto error = [this, client, &req](std::uint8_t code, std::uint32_t value = 0)
+    {
+        SendError(client, code, value, req);
+    };
+
+    switch (req.opcode)
+    {
+        case XCB_CREATE_WINDOW:
+        {
+            if (!has(28))
+            {
+                return error(XCB_LENGTH);
+            }
+            xcb_window_t window = get32(b);
+            xcb_window_t parent = get32(b + 4);
+            if (windows_.contains(window))
+            {
+                return error(XCB_ID_CHOICE, window);
+            }
+            if (!windows_.contains(parent))
+            {
+                return error(XCB_WINDOW, parent);
+            }
+            auto& w = windows_[window];
+            w.creator = client;
+            if (auto mask = attribute(get32(b + 24), XCB_CW_EVENT_MASK, b + 28, req.size - 28))
+            {
+                w.event_masks[client] = *mask;
+            }
+            return;
+        }
+        case XCB_CHANGE_WINDOW_ATTRIBUTES:
+        {
+            if (!has(8))
+            {
+                return error(XCB_LENGTH);
+            }
+            auto w = windows_.find(get32(b));
+            if (w == windows_.end())
+            {
+                return error(XCB_WINDOW, get32(b));
+            }
+            if (auto mask = attribute(get32(b + 4), XCB_CW_EVENT_MASK, b + 8, req.size - 8))
+            {
+                w->second.event_masks[client] = *mask;
+            }
+            return;
+        }
+        case XCB_DESTROY_WINDOW:
+        {
+            if (!has(4))
+            {
+                return error(XCB_LENGTH);
+            }
+            if (!windows_.contains(get32(b)))
+            {
+                return error(XCB_WINDOW, get32(b));
+            }
+            return DestroyWindow(get32(b));
+        }
+        case XCB_INTERN_ATOM:
+        {
+            if (!has(4) || !has(4 + get16(b)))
+            {
+                return error(XCB_LENGTH);
+            }
+            std::string name{b + 4, get16(b)};
+            xcb_atom_t atom = XCB_ATOM_NONE;
+            if (auto it = atoms_.find(name); it != atoms_.end())
+            {
+                atom = it->second;
+            }
+            else if (req.data == 0) // not only_if_exists
+            {
+                atom_names_.push_back(name);
+                atom = atom_names_.size();
+                atoms_[std::move(name)] = atom;
+            }
+            std::string fields;
+            put32(fields, atom);
+            return SendReply(client, 0, fields);
+        }
+        case XCB_GET_ATOM_NAME:
+        {
+            if (!has(4))
+            {
+                return error(XCB_LENGTH);
+            }
+            xcb_atom_t atom = get32(b);
+            if (!IsAtom(atom))
+            {
+                return error(XCB_ATOM, atom);
+            }
+            auto& name = atom_names_[atom - 1];
+            std::string fields;
+            put16(fields, name.size());
+            return SendReply(client, 0, fields, name);
+        }
+        case XCB_CHANGE_PROPERTY:
+        {
+            if (!has(20))
+            {
+                return error(XCB_LENGTH);
+            }
+            xcb_window_t window = get32(b);
+            xcb_atom_t property = get32(b + 4);
+            xcb_atom_t type = get32(b + 8);
+            std::uint8_t format = static_cast<std::uint8_t>(b[12]);
+            std::size_t size = static_cast<std::size_t>(get32(b + 16)) * format / 8;
+            auto w = windows_.find(window);
+            if (w == windows_.end())
+            {
+                return error(XCB_WINDOW, window);
+            }
+            if (!IsAtom(property) || !IsAtom(type))
+            {
+                return error(XCB_ATOM, IsAtom(property) ? type : property);
+            }
+            if ((format != 8 && format != 16 && format != 32) || req.data > XCB_PROP_MODE_APPEND)
+            {
+                return error(XCB_VALUE, format);
+            }
+            if (!has(20 + size))
+            {
+                return error(XCB_LENGTH);
+            }
+            std::string_view data{b + 20, size};
+            auto prop = w->second.properties.find(property);
+            if (req.data == XCB_PROP_MODE_REPLACE || prop == w->second.properties.end())
+            {
+                w->second.properties[property] = {type, format, std::string{data}};
+            }
+            else if (prop->second.type != type || prop->second.format != format)
+            {
+                return error(XCB_MATCH);
+            }
+            else if (req.data == XCB_PROP_MODE_APPEND)
+            {
+                prop->second.data += data;
+            }
+            else
+            {
+                prop->second.data.insert(0, data);
+            }
+            return NotifyProperty(window, property, XCB_PROPERTY_NEW_VALUE);
+        }
+        case XCB_DELETE_PROPERTY:
+        {
+            if (!has(8))
+            {
+                return error(XCB_LENGTH);
+            }
+            auto w = windows_.find(get32(b));
+            if (w == windows_.end())
+            {
+                return error(XCB_WINDOW, get32(b));
+            }
+            if (w->second.properties.erase(get32(b + 4)) != 0)
+            {
+                NotifyProperty(get32(b), get32(b + 4), XCB_PROPERTY_DELETE);
+            }
+            return;
+        }
+        case XCB_GET_PROPERTY:
+        {
+            if (!has(20))
+            {
+                return error(XCB_LENGTH);
+            }
+            xcb_window_t window = get32(b);
+            xcb_atom_t property = get32(b + 4);
+            xcb_atom_t type = get32(b + 8);
+            std::size_t offset = 4 * static_cast<std::size_t>(get32(b + 12));
+            std::size_t length = 4 * static_cast<std::size_t>(get32(b + 16));
+            auto w = windows_.find(window);
+            if (w == windows_.end())
+            {
+                return error(XCB_WINDOW, window);
+            }
+            std::string fields;
+            auto prop = w->second.properties.find(property);
+            if (prop == w->second.properties.end())
+            {
+                put32(fields, XCB_ATOM_NONE);
+                put32(fields, 0);
+                put32(fields, 0);
+                return SendReply(client, 0, fields);
+            }
+            auto& [prop_type, format, data] = prop->second;
+            if (type != XCB_GET_PROPERTY_TYPE_ANY && type != prop_type)
+            {
+                put32(fields, prop_type);
+                put32(fields, data.size());
+                put32(fields, 0);
+                return SendReply(client, format, fields);
+            }
+            if (offset > data.size())
+            {
+                return error(XCB_VALUE, get32(b + 12));
+            }
+            std::size_t size = std::min(data.size() - offset, length);
+            std::size_t bytes_after = data.size() - offset - size;
+            put32(fields, prop_type);
+            put32(fields, bytes_after);
+            put32(fields, size / (format / 8));
+            SendReply(client, format, fields, {data.data() + offset, size});
+            if (req.data != 0 && bytes_after == 0) // delete
+            {
+                w->second.properties.erase(prop);
+                NotifyProperty(window, property, XCB_PROPERTY_DELETE);
+            }
+            return;
+        }
+        case XCB_SET_SELECTION_OWNER:
+        {
+            if (!has(12))
+            {
+                return error(XCB_LENGTH);
+            }
+            xcb_window_t owner = get32(b);
+            xcb_atom_t selection = get32(b + 4);
+            xcb_timestamp_t time = get32(b + 8) == XCB_CURRENT_TIME ? time_ : get32(b + 8);
+            if (owner != XCB_NONE && !windows_.contains(owner))
+            {
+                return error(XCB_WINDOW, owner);
+            }
+            if (!IsAtom(selection))
+            {
+                return error(XCB_ATOM, selection);
+            }
+            auto& sel = selections_[selection];
+            if (time < sel.time || time > time_)
+            {
+                return;
+            }
+            // previous owner is told it has lost the selection unless it's the same client
+            if (sel.owner != XCB_NONE && (owner == XCB_NONE || windows_[owner].creator != windows_[sel.owner].creator))
+            {
+                std::string event;
+                put8(event, XCB_SELECTION_CLEAR);
+                put8(event, 0);
+                put16(event, 0);
+                put32(event, time);
+                put32(event, sel.owner);
+                put32(event, selection);
+                SendEvent(windows_[sel.owner].creator, std::move(event));
+            }
+            sel = {owner, time};
+            return;
+        }
+        case XCB_GET_SELECTION_OWNER:
+        {
+            if (!has(4))
+            {
+                return error(XCB_LENGTH);
+            }
+            if (!IsAtom(get32(b)))
+            {
+                return error(XCB_ATOM, get32(b));
+            }
+            auto sel = selections_.find(get32(b));
+            std::string fields;
+            put32(fields, sel == selections_.end() ? XCB_NONE : sel->second.owner);
+            return SendReply(client, 0, fields);
+        }
+        case XCB_CONVERT_SELECTION:
+        {
+            if (!has(20))
+            {
+                return error(XCB_LENGTH);
+            }
+            xcb_window_t requestor = get32(b);
+            xcb_atom_t selection = get32(b + 4);
+            if (!windows_.contains(requestor))
+            {
+                return error(XCB_WINDOW, requestor);
+            }
+            if (!IsAtom(selection) || !IsAtom(get32(b + 8)))
+            {
+                return error(XCB_ATOM, IsAtom(selection) ? get32(b + 8) : selection);
+            }
+            auto sel = selections_.find(selection);
+            std::string event;
+            if (sel != selections_.end() && sel->second.owner != XCB_NONE)
+            {
+                put8(event, XCB_SELECTION_REQUEST);
+                put8(event, 0);
+                put16(event, 0);
+                put32(event, get32(b + 16)); // time
+                put32(event, sel->second.owner);
+                put32(event, requestor);
+                event.append(b + 4, 12); // selection, target, property
+                return SendEvent(windows_[sel->second.owner].creator, std::move(event));
+            }
+            put8(event, XCB_SELECTION_NOTIFY);
+            put8(event, 0);
+            put16(event, 0);
+            put32(event, get32(b + 16)); // time
+            put32(event, requestor);
+            event.append(b + 4, 8); // selection, target
+            put32(event, XCB_ATOM_NONE);
+            return SendEvent(windows_[requestor].creator, std::move(event));
+        }
+        case XCB_SEND_EVENT:
+        {
+            if (!has(40))
+            {
+                return error(XCB_LENGTH);
+            }
+            xcb_window_t destination = get32(b);
+            if (!windows_.contains(destination))
+            {
+                return error(XCB_WINDOW, destination);
+            }
+            std::string event{b + 8, 32};
+            event[0] = static_cast<char>(event[0] | 0x80);
+            return DeliverEvent(destination, get32(b + 4), event);
+        }
+        case XCB_GET_INPUT_FOCUS:
+        {
+            std::string fields;
+            put32(fields, root_window);
+            return SendReply(client, XCB_INPUT_FOCUS_POINTER_ROOT, fields);
+        }
+        case XCB_QUERY_EXTENSION:
+        {
+            if (!has(4) || !has(4 + get16(b)))
+            {
+                return error(XCB_LENGTH);
+            }
+            bool is_present = std::string_view{b + 4, get16(b)} == "BIG-REQUESTS" && options_.big_request_length != 0;
+            std::string fields;
+            put8(fields, is_present);
+            put8(fields, is_present ? big_requests_opcode : 0);
+            put8(fields, 0); // first event
+            put8(fields, 0); // first error
+            return SendReply(client, 0, fields);
+        }
+        case XCB_NO_OPERATION:
+        {
+            return;
+        }
+        case big_requests_opcode:
+        {
+            if (options_.big_request_length == 0 || req.data != 0)
+            {
+                return error(XCB_REQUEST);
+            }
+            clients_[client].big_requests = true;
+            std::string fields;
+            put32(fields, options_.big_request_length);
+            return SendReply(client, 0, fields);
+        }
+        default:
+        {
+            return error(XCB_REQUEST);
+        }
+    }
+}
+
+void FakeServer::Disconnect(std::size_t client)
+{
+    std::vector<xcb_window_t> created;
+    for (auto& [id, window] : windows_)
+    {
+        window.event_masks.erase(client);
+        if (window.creator == client)
+        {
+            created.push_back(id);
+        }
+    }
+    for (auto window : created)
+    {
+        DestroyWindow(window);
+    }
+    clients_.erase(client);
+}
+
+void FakeServer::DestroyWindow(xcb_window_t window)
+{
+    // selections are lost silently, only XFixes would report it
+    for (auto& [atom, selection] : selections_)
+    {
+        if (selection.owner == window)
+        {
+            selection.owner = XCB_NONE;
+        }
+    }
+    std::string event;
+    put8(event, XCB_DESTROY_NOTIFY);
+    put8(event, 0);
+    put16(event, 0);
+    put32(event, window); // event window
+    put32(event, window);
+    DeliverEvent(window, XCB_EVENT_MASK_STRUCTURE_NOTIFY, event);
+    windows_.erase(window);
+}
+
+void FakeServer::SendReply(std::size_t client, std::uint8_t data, std::string_view fields, std::string_view tail)
+{
+    auto& state = clients_[client];
+    std::string& out = state.out;
+    put8(out, 1);
+    put8(out, data);
+    put16(out, state.sequence);
+    put32(out, pad4(tail.size()) / 4);
+    out += fields;
+    out.append(24 - fields.size(), '\0');
+    out += tail;
+    out.append(pad4(tail.size()) - tail.size(), '\0');
+}
+
+void FakeServer::SendError(std::size_t client, std::uint8_t code, std::uint32_t value, const Request& req)
+{
+    auto& state = clients_[client];
+    std::string& out = state.out;
+    put8(out, 0);
+    put8(out, code);
+    put16(out, state.sequence);
+    put32(out, value);
+    put16(out, 0); // minor opcode
+    put8(out, req.opcode);
+    out.append(21, '\0');
+}
+
+void FakeServer::SendEvent(std::size_t client, std::string event)
+{
+    auto state = clients_.find(client);
+    if (state == clients_.end())
+    {
+        return;
+    }
+    event.resize(32);
+    std::memcpy(event.data() + 2, &state->second.sequence, sizeof(state->second.sequence));
+    state->second.out += event;
+}
+
+void FakeServer::DeliverEvent(xcb_window_t window, std::uint32_t mask, const std::string& event)
+{
+    auto& w = windows_[window];
+    if (mask == 0)
+    {
+        SendEvent(w.creator, event);
+        return;
+    }
+    for (auto [client, selected] : w.event_masks)
+    {
+        if ((selected & mask) != 0)
+        {
+            SendEvent(client, event);
+        }
+    }
+}
+
+void FakeServer::NotifyProperty(xcb_window_t window, xcb_atom_t property, std::uint8_t state)
+{
+    std::string event;
+    put8(event, XCB_PROPERTY_NOTIFY);
+    put8(event, 0);
+    put16(event, 0);
+    put32(event, window);
+    put32(event, property);
+    put32(event, time_);
+    put8(event, state);
+    DeliverEvent(window, XCB_EVENT_MASK_PROPERTY_CHANGE, event);
+}
+
+bool FakeServer::IsAtom(xcb_atom_t atom) const noexcept
+{
+    return atom != XCB_ATOM_NONE && atom <= atom_names_.size();
+}
+
+} // namespace xcpp::bench
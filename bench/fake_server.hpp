@@ -0,0 +1,153 @@
+#pragma once
+
+#ifndef XCLIPP_BENCH_FAKE_SERVER_HPP
+#define XCLIPP_BENCH_FAKE_SERVER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+#include "transport.hpp"
+#include "utils.hpp"
+
+namespace xcpp::bench
+{
+
+struct FakeServerOptions
+{
+    // in 4-byte units, as announced in connection setup
+    std::uint16_t max_request_length = 65535;
+    // in 4-byte units, BIG-REQUESTS is not offered if 0
+    std::uint32_t big_request_length = 4194303;
+};
+
+// in-process X server speaking X11 protocol over socket pairs, so clients run unchanged on top of it;
+// only what selection transfers need is modeled: windows, atoms, properties, selections,
+// PropertyNotify/DestroyNotify/SelectionClear/SelectionRequest/SelectionNotify events and request length limits;
+// time is a counter of handled requests, so runs are deterministic
+class FakeServer : public Transport
+{
+public:
+    explicit FakeServer(const FakeServerOptions& options = {});
+
+    FakeServer(const FakeServer&) = delete;
+
+    FakeServer& operator=(const FakeServer&) = delete;
+
+    // stops serving, connections left open get I/O errors
+    ~FakeServer() override;
+
+    std::pair<Connection, int> Connect() const override;
+
+private:
+    struct Property
+    {
+        xcb_atom_t type;
+        std::uint8_t format;
+        std::string data;
+    };
+
+    struct Window
+    {
+        std::size_t creator;
+        // of each client interested in the window
+        std::unordered_map<std::size_t, std::uint32_t> event_masks;
+        std::unordered_map<xcb_atom_t, Property> properties;
+    };
+
+    struct Selection
+    {
+        xcb_window_t owner;
+        xcb_timestamp_t time;
+    };
+
+    struct ClientState
+    {
+        FileDescriptor fd;
+        // received bytes starting from `in_offset` are not handled yet
+        std::string in;
+        std::size_t in_offset = 0;
+        // bytes starting from `out_offset` are not sent yet
+        std::string out;
+        std::size_t out_offset = 0;
+        std::uint16_t sequence = 0;
+        bool is_set_up = false;
+        bool big_requests = false;
+    };
+
+    // request without its header
+    struct Request
+    {
+        std::uint8_t opcode;
+        std::uint8_t data;
+        const char* body;
+        std::size_t size;
+    };
+
+    void Serve();
+
+    void AcceptPending();
+
+    // returns false if connection is broken
+    bool ReadInput(std::size_t client);
+
+    void HandleInput(std::size_t client);
+
+    void SetUp(std::size_t client);
+
+    void HandleRequest(std::size_t client, const Request& req);
+
+    void Disconnect(std::size_t client);
+
+    void DestroyWindow(xcb_window_t window);
+
+    void SendReply(std::size_t client, std::uint8_t data, std::string_view fields, std::string_view tail = {});
+
+    void SendError(std::size_t client, std::uint8_t code, std::uint32_t value, const Request& req);
+
+    // sends `event` to `client` with its current sequence number
+    void SendEvent(std::size_t client, std::string event);
+
+    // sends `event` to clients selected any of `mask` events on `window`, or to its creator if `mask` is 0
+    void DeliverEvent(xcb_window_t window, std::uint32_t mask, const std::string& event);
+
+    void NotifyProperty(xcb_window_t window, xcb_atom_t property, std::uint8_t state);
+
+    bool IsAtom(xcb_atom_t atom) const noexcept;
+
+    inline static constexpr xcb_window_t root_window = 0x100;
+    inline static constexpr std::uint8_t big_requests_opcode = 133;
+    inline static constexpr std::size_t no_client = static_cast<std::size_t>(-1);
+
+    FakeServerOptions options_;
+    // read by serving thread when woken up
+    mutable std::mutex pending_mutex_;
+    mutable std::vector<FileDescriptor> pending_;
+    FileDescriptor wake_read_;
+    FileDescriptor wake_write_;
+
+    std::unordered_map<std::size_t, ClientState> clients_;
+    std::size_t next_client_ = 0;
+    std::unordered_map<xcb_window_t, Window> windows_;
+    // name of atom `a` is at index `a - 1`
+    std::vector<std::string> atom_names_;
+    std::unordered_map<std::string, xcb_atom_t> atoms_;
+    std::unordered_map<xcb_atom_t, Selection> selections_;
+    xcb_timestamp_t time_ = 1;
+    std::vector<char> read_buffer_ = std::vector<char>(1 << 18);
+
+    std::thread thread_;
+};
+
+} // namespace xcpp::bench
+
+#endif // XCLIPP_BENCH_FAKE_SERVER_HPP
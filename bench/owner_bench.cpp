@@ -0,0 +1,124 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+#include "clipper.hpp"
+#include "fake_server.hpp"
+#include "reader.hpp"
+
+using namespace xcpp;
+
+// makes another client own CLIPBOARD, so the owner's Run() returns
+static void take_clipboard(const bench::FakeServer& server)
+{
+    auto [connection, screen_id] = server.Connect();
+    xcb_connection_t* c = connection.get();
+    xcb_window_t window = xcb_generate_id(c);
+    xcb_create_window(
+        c, 0, window, xcb_setup_roots_iterator(xcb_get_setup(c)).data->root, 0, 0, 1, 1, 0,
+        XCB_WINDOW_CLASS_INPUT_ONLY, XCB_COPY_FROM_PARENT, 0, nullptr);
+    auto reply = xcb_intern_atom_reply(c, xcb_intern_atom(c, 0, 9, "CLIPBOARD"), nullptr);
+    xcb_set_selection_owner(c, window, reply->atom, XCB_CURRENT_TIME);
+    std::free(reply);
+    std::free(xcb_get_input_focus_reply(c, xcb_get_input_focus(c), nullptr)); // wait until it's handled
+}
+
+// runs `paste` for at least `min_time` and reports its latency and throughput for `bytes` pasted each time
+static void measure(std::string_view name, std::size_t bytes, const std::function<bool()>& paste)
+{
+    using clock = std::chrono::steady_clock;
+    constexpr auto min_time = std::chrono::milliseconds{500};
+
+    if (!paste())
+    {
+        std::fprintf(stderr, "%.*s: paste failed\n", static_cast<int>(name.size()), name.data());
+        return;
+    }
+    std::size_t runs = 0;
+    auto start = clock::now();
+    auto elapsed = clock::duration::zero();
+    do
+    {
+        if (!paste())
+        {
+            std::fprintf(stderr, "%.*s: paste failed\n", static_cast<int>(name.size()), name.data());
+            return;
+        }
+        ++runs;
+        elapsed = clock::now() - start;
+    } while (elapsed < min_time);
+
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    std::printf(
+        "%-40.*s %12zu B %10.1f us %10.1f MB/s\n", static_cast<int>(name.size()), name.data(), bytes,
+        seconds / runs * 1e6, static_cast<double>(bytes) * runs / seconds / 1e6);
+}
+
+static void bench_owner(std::string_view server_name, const bench::FakeServerOptions& server_options, std::size_t size)
+{
+    bench::FakeServer server{server_options};
+    std::string data(size, 'x');
+    ClipperOptions clipper_options;
+    clipper_options.transport = &server;
+    Clipper clipper{data, clipper_options};
+    std::thread owner{[&clipper]
+    {
+        try
+        {
+            clipper.Run();
+        }
+        catch (std::exception& e)
+        {
+            std::fprintf(stderr, "%s\n", e.what());
+        }
+    }};
+
+    {
+        ReaderOptions reader_options;
+        reader_options.transport = &server;
+        Reader reader{reader_options};
+        int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        std::string prefix = std::string{server_name} + " ";
+        measure(prefix + "TARGETS", 0, [&reader] { return reader.ListTargets().has_value(); });
+        measure(prefix + "UTF8_STRING", size, [&] { return reader.Read(null_fd); });
+
+        constexpr std::string_view targets[] = {"UTF8_STRING", "STRING", "TEXT"};
+        int fds[] = {null_fd, null_fd, null_fd};
+        measure(prefix + "MULTIPLE x3", 3 * size, [&]
+        {
+            auto converted = reader.ReadMultiple(targets, fds);
+            return converted && (*converted)[0] && (*converted)[1] && (*converted)[2];
+        });
+        close(null_fd);
+    }
+
+    take_clipboard(server);
+    owner.join();
+}
+
+int main(int argc, char* argv[])
+{
+    std::size_t max_size = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 64 << 20;
+
+    bench::FakeServerOptions no_big_requests;
+    no_big_requests.big_request_length = 0;
+
+    // per-request cost of the owner without X server, sizes cross the one-shot transfer limits
+    for (std::size_t size = 16; size <= max_size; size *= 16)
+    {
+        bench_owner("bigreq", {}, size);
+        bench_owner("no-bigreq", no_big_requests, size);
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include <csignal>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "clipper.hpp"
+#include "reader.hpp"
+
+using namespace xcpp;
+
+// runs selection owner of `data` in a child process, returns its pid once ownership is taken or -1
+static pid_t start_owner(std::string_view data, const ClipperOptions& options)
+{
+    int ready[2];
+    if (pipe(ready) == -1)
+    {
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(ready[0]);
+        try
+        {
+            Clipper clipper(data, options);
+            write(ready[1], "", 1);
+            close(ready[1]);
+            clipper.Run();
+        }
+        catch (std::exception& e)
+        {
+            std::fprintf(stderr, "%s\n", e.what());
+            std::_Exit(1);
+        }
+        std::_Exit(0);
+    }
+    close(ready[1]);
+    char c = 0;
+    bool is_ready = pid != -1 && read(ready[0], &c, 1) == 1;
+    close(ready[0]);
+    return is_ready ? pid : -1;
+}
+
+static void stop_owner(pid_t pid)
+{
+    kill(pid, SIGTERM);
+    waitpid(pid, nullptr, 0);
+}
+
+// pastes `data` from owner to reader, output is discarded to measure transfer only
+static void bench_paste(std::string_view name, std::string_view data, const ClipperOptions& options)
+{
+    pid_t owner = start_owner(data, options);
+    if (owner == -1)
+    {
+        std::fprintf(stderr, "%.*s: failed to start owner\n", static_cast<int>(name.size()), name.data());
+        return;
+    }
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    Reader reader;
+    bench::Measure(name, data.size(), [&]
+    {
+        if (!reader.Read(null_fd))
+        {
+            std::fputs("Paste failed\n", stderr);
+            std::exit(1);
+        }
+    });
+    close(null_fd);
+    stop_owner(owner);
+}
+
+int main(int argc, char* argv[])
+{
+    if (std::getenv("DISPLAY") == nullptr)
+    {
+        std::fputs("DISPLAY is not set, X server is required\n", stderr);
+        return 1;
+    }
+    std::size_t max_size = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 256 << 20;
+    ClipperOptions memfd_options;
+    memfd_options.memfd_channel = true;
+
+    for (std::size_t size = 4 << 10; size <= max_size; size *= 16)
+    {
+        std::string data(size, 'x');
+        bench_paste("paste x11 UTF8_STRING", data, {});
+        bench_paste("paste memfd UTF8_STRING", data, memfd_options);
+    }
+}
@@ -0,0 +1,473 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <getopt.h>
+#include <poll.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+#include "clipper.hpp"
+#include "fake_server.hpp"
+#include "recorder.hpp"
+#include "transport.hpp"
+#include "xvfb.hpp"
+
+using namespace xcpp;
+
+using clock_type = std::chrono::steady_clock;
+
+static const char* usage =
+    "Usage: replay_bench [-f] [-x SPEED] LOG\n"
+    "\t-f  use in-process fake X server instead of Xvfb or DISPLAY\n"
+    "\t-x  replay SPEED times faster than recorded, 0 means as fast as the owner goes, 1 by default\n"
+    "LOG is written by xclipp --record\n";
+
+// how long to wait for the owner once all events are replayed
+static constexpr auto drain_timeout = std::chrono::seconds{10};
+
+struct Counters
+{
+    std::size_t requests = 0;
+    std::size_t refused = 0;
+    std::size_t deletes = 0;
+    std::vector<std::uint64_t> latencies_us;
+};
+
+// stands for a recorded requestor window, replays its requests and property deletions on its own connection
+class Requestor
+{
+public:
+    Requestor(const Transport& transport, const std::unordered_map<std::string, xcb_atom_t>& atoms) :
+        connection_{transport.Connect().first},
+        atoms_{atoms}
+    {
+        window_ = xcb_generate_id(connection_.get());
+        std::uint32_t event_mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+        xcb_create_window(
+            connection_.get(), 0, window_, xcb_setup_roots_iterator(xcb_get_setup(connection_.get())).data->root,
+            0, 0, 1, 1, 0, XCB_WINDOW_CLASS_INPUT_ONLY, XCB_COPY_FROM_PARENT, XCB_CW_EVENT_MASK, &event_mask);
+    }
+
+    int Fd() const noexcept
+    {
+        return xcb_get_file_descriptor(connection_.get());
+    }
+
+    bool IsDestroyed() const noexcept
+    {
+        return is_destroyed_;
+    }
+
+    // whether it waits for the owner
+    bool IsBusy() const noexcept
+    {
+        return !is_destroyed_ && (!queued_.empty() || !in_flight_.empty() || !pending_deletes_.empty());
+    }
+
+    std::size_t PendingDeletes() const noexcept
+    {
+        return is_destroyed_ ? 0 : pending_deletes_.size();
+    }
+
+    // the recorded requestor reacted to the owner, so its next event waits for the previous one to complete
+    void Replay(const RecordedEvent& event, Counters& counters)
+    {
+        queued_.push_back(&event);
+        Advance(counters);
+    }
+
+    void HandleEvents(Counters& counters)
+    {
+        if (xcb_generic_event_t* event = xcb_poll_for_event(connection_.get()))
+        {
+            HandleEvent(event, counters);
+        }
+        Advance(counters);
+    }
+
+private:
+    void HandleEvent(xcb_generic_event_t* event, Counters& counters)
+    {
+        switch (event->response_type & ~0x80)
+        {
+            case XCB_SELECTION_NOTIFY:
+            {
+                auto notify = reinterpret_cast<xcb_selection_notify_event_t*>(event);
+                if (notify->requestor == window_ && !in_flight_.empty())
+                {
+                    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                        clock_type::now() - in_flight_.front());
+                    counters.latencies_us.push_back(us.count());
+                    counters.refused += notify->property == XCB_ATOM_NONE;
+                    in_flight_.pop_front();
+                }
+                break;
+            }
+            case XCB_PROPERTY_NOTIFY:
+            {
+                auto notify = reinterpret_cast<xcb_property_notify_event_t*>(event);
+                if (notify->window == window_ && notify->state == XCB_PROPERTY_NEW_VALUE)
+                {
+                    if (incremental_.contains(notify->atom) && IsEmpty(notify->atom))
+                    {
+                        incremental_.erase(notify->atom); // final chunk, the owner doesn't track its deletion
+                    }
+                    present_.insert(notify->atom);
+                    DeletePresent(counters);
+                }
+                break;
+            }
+        }
+        std::free(event);
+    }
+
+    // replays queued events as far as the owner allows, replies awaited meanwhile may bring events along,
+    // which are queued by xcb without waking poll(), so they are handled here as well
+    void Advance(Counters& counters)
+    {
+        while (true)
+        {
+            while (xcb_generic_event_t* event = xcb_poll_for_queued_event(connection_.get()))
+            {
+                HandleEvent(event, counters);
+            }
+            // the recorded requestor didn't request anything else before its INCR transfers had finished
+            if (is_destroyed_ ||
+                queued_.empty() ||
+                !in_flight_.empty() ||
+                !pending_deletes_.empty() ||
+                (queued_.front()->type == RecordedEvent::Type::REQUEST && !incremental_.empty()))
+            {
+                break;
+            }
+            Execute(*queued_.front(), counters);
+            queued_.pop_front();
+        }
+        xcb_flush(connection_.get());
+    }
+
+    void Execute(const RecordedEvent& event, Counters& counters)
+    {
+        xcb_connection_t* c = connection_.get();
+        switch (event.type)
+        {
+            case RecordedEvent::Type::REQUEST:
+            {
+                if (!event.subrequests.empty())
+                {
+                    std::vector<xcb_atom_t> pairs;
+                    for (auto& [target, property] : event.subrequests)
+                    {
+                        pairs.push_back(Atom(target));
+                        pairs.push_back(Atom(property));
+                    }
+                    xcb_change_property(
+                        c, XCB_PROP_MODE_REPLACE, window_, Atom(event.property), Atom("ATOM_PAIR"), 32, pairs.size(),
+                        pairs.data());
+                }
+                xcb_convert_selection(
+                    c, window_, Atom(event.selection), Atom(event.target), Atom(event.property), XCB_CURRENT_TIME);
+                in_flight_.push_back(clock_type::now());
+                ++counters.requests;
+                break;
+            }
+            // the recorded requestor deleted it once the owner had put the next chunk, so it's done the same way
+            case RecordedEvent::Type::PROPERTY_DELETE:
+            {
+                pending_deletes_.push_back(Atom(event.property));
+                DeletePresent(counters);
+                break;
+            }
+            case RecordedEvent::Type::DESTROY:
+            {
+                xcb_destroy_window(c, window_);
+                is_destroyed_ = true;
+                break;
+            }
+        }
+    }
+
+    xcb_atom_t Atom(const std::string& name) const
+    {
+        auto it = atoms_.find(name);
+        return it == atoms_.end() ? xcb_atom_t{XCB_ATOM_NONE} : it->second;
+    }
+
+    bool IsEmpty(xcb_atom_t property)
+    {
+        auto cookie = xcb_get_property(connection_.get(), 0, window_, property, XCB_ATOM_ANY, 0, 0);
+        auto reply = xcb_get_property_reply(connection_.get(), cookie, nullptr);
+        bool is_empty = reply != nullptr && reply->bytes_after == 0;
+        std::free(reply);
+        return is_empty;
+    }
+
+    // deletes properties in recorded order, each one only once the owner has put a new value
+    void DeletePresent(Counters& counters)
+    {
+        while (!pending_deletes_.empty() && present_.erase(pending_deletes_.front()) != 0)
+        {
+            // reads it like a real requestor, so the server does the same work
+            auto cookie = xcb_get_property(
+                connection_.get(), 1, window_, pending_deletes_.front(), XCB_ATOM_ANY, 0,
+                std::numeric_limits<std::uint32_t>::max() / 4);
+            auto reply = xcb_get_property_reply(connection_.get(), cookie, nullptr);
+            if (reply != nullptr && reply->type == Atom("INCR"))
+            {
+                incremental_.insert(pending_deletes_.front());
+            }
+            std::free(reply);
+            pending_deletes_.pop_front();
+            ++counters.deletes;
+        }
+    }
+
+    Connection connection_;
+    const std::unordered_map<std::string, xcb_atom_t>& atoms_;
+    xcb_window_t window_;
+    bool is_destroyed_ = false;
+    // due events not replayed yet
+    std::deque<const RecordedEvent*> queued_;
+    // start times of requests waiting for SelectionNotify, the owner handles requests of a requestor in order
+    std::deque<clock_type::time_point> in_flight_;
+    std::deque<xcb_atom_t> pending_deletes_;
+    std::unordered_set<xcb_atom_t> present_;
+    // properties receiving INCR transfers
+    std::unordered_set<xcb_atom_t> incremental_;
+};
+
+static double percentile(const std::vector<std::uint64_t>& sorted, double p)
+{
+    std::size_t i = std::min(sorted.size() - 1, static_cast<std::size_t>(p * sorted.size()));
+    return sorted.empty() ? 0.0 : sorted[i] / 1e3;
+}
+
+int main(int argc, char* argv[])
+{
+    bool use_fake = false;
+    double speed = 1;
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "fx:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'f':
+            {
+                use_fake = true;
+                break;
+            }
+            case 'x':
+            {
+                speed = std::strtod(optarg, nullptr);
+                break;
+            }
+            default:
+            {
+                std::fputs(usage, stderr);
+                return 1;
+            }
+        }
+    }
+    if (optind + 1 != argc)
+    {
+        std::fputs(usage, stderr);
+        return 1;
+    }
+    auto recording = read_recording(argv[optind]);
+    if (!recording)
+    {
+        std::fprintf(stderr, "%s is not a complete recording\n", argv[optind]);
+        return 1;
+    }
+
+    std::optional<bench::Xvfb> xvfb;
+    std::optional<bench::FakeServer> fake_server;
+    std::optional<DisplayTransport> display;
+    const Transport* transport = nullptr;
+    if (!use_fake && xvfb.emplace().IsRunning())
+    {
+        transport = &display.emplace();
+    }
+    else if (!use_fake && std::getenv("DISPLAY") != nullptr)
+    {
+        std::fprintf(stderr, "Xvfb can't be started, using DISPLAY=%s\n", std::getenv("DISPLAY"));
+        transport = &display.emplace();
+    }
+    else
+    {
+        transport = &fake_server.emplace();
+    }
+
+    try
+    {
+        // content isn't recorded, only its size
+        std::string data(recording->data_size, 'x');
+        ClipperOptions clipper_options;
+        clipper_options.transport = transport;
+        Clipper clipper{data, clipper_options};
+        std::thread owner{[&clipper]
+        {
+            try
+            {
+                clipper.Run();
+            }
+            catch (std::exception& e)
+            {
+                std::fprintf(stderr, "Owner failed: %s\n", e.what());
+            }
+        }};
+
+        // atoms of all recorded names are interned at once, so they don't disturb the timing
+        auto [control, screen_id] = transport->Connect();
+        std::unordered_map<std::string, xcb_atom_t> atoms{
+            {"CLIPBOARD", XCB_ATOM_NONE},
+            {"ATOM_PAIR", XCB_ATOM_NONE},
+            {"INCR", XCB_ATOM_NONE}
+        };
+        for (auto& e : recording->events)
+        {
+            for (auto* name : {&e.selection, &e.target, &e.property})
+            {
+                atoms.emplace(*name, XCB_ATOM_NONE);
+            }
+            for (auto& [target, property] : e.subrequests)
+            {
+                atoms.emplace(target, XCB_ATOM_NONE);
+                atoms.emplace(property, XCB_ATOM_NONE);
+            }
+        }
+        atoms.erase("");
+        std::vector<std::pair<xcb_atom_t*, xcb_intern_atom_cookie_t>> cookies;
+        for (auto& [name, atom] : atoms)
+        {
+            cookies.emplace_back(&atom, xcb_intern_atom(control.get(), 0, name.size(), name.data()));
+        }
+        for (auto [atom, cookie] : cookies)
+        {
+            if (auto reply = xcb_intern_atom_reply(control.get(), cookie, nullptr))
+            {
+                *atom = reply->atom;
+                std::free(reply);
+            }
+        }
+
+        std::unordered_map<std::uint32_t, std::unique_ptr<Requestor>> requestors;
+        Counters counters;
+        std::vector<Requestor*> polled;
+        std::vector<pollfd> fds;
+        auto& events = recording->events;
+        std::size_t next = 0;
+        auto start = clock_type::now();
+        auto due = [&](const RecordedEvent& e)
+        {
+            std::chrono::duration<double, std::micro> offset{speed <= 0 ? 0.0 : e.time_us / speed};
+            return start + std::chrono::duration_cast<clock_type::duration>(offset);
+        };
+        auto is_busy = [&requestors]
+        {
+            return std::ranges::any_of(requestors, [](auto& r) { return r.second->IsBusy(); });
+        };
+        std::optional<clock_type::time_point> drain_deadline;
+        while (next < events.size() || (is_busy() && clock_type::now() < *drain_deadline))
+        {
+            auto now = clock_type::now();
+            for (; next < events.size() && due(events[next]) <= now; ++next)
+            {
+                auto& requestor = requestors[events[next].requestor];
+                if (requestor == nullptr)
+                {
+                    requestor = std::make_unique<Requestor>(*transport, atoms);
+                }
+                requestor->Replay(events[next], counters);
+            }
+            if (next == events.size() && !drain_deadline)
+            {
+                drain_deadline = clock_type::now() + drain_timeout;
+            }
+
+            polled.clear();
+            fds.clear();
+            for (auto& [i, r] : requestors)
+            {
+                if (!r->IsDestroyed())
+                {
+                    polled.push_back(r.get());
+                    fds.push_back({r->Fd(), POLLIN, 0});
+                }
+            }
+            auto timeout = std::chrono::milliseconds{100};
+            if (next < events.size())
+            {
+                auto until_due = std::chrono::ceil<std::chrono::milliseconds>(due(events[next]) - clock_type::now());
+                timeout = std::clamp(until_due, std::chrono::milliseconds{0}, timeout);
+            }
+            poll(fds.data(), fds.size(), timeout.count());
+            for (std::size_t i = 0; i < polled.size(); ++i)
+            {
+                if (fds[i].revents != 0)
+                {
+                    polled[i]->HandleEvents(counters);
+                }
+            }
+        }
+        auto elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+
+        std::size_t unmatched_deletes = 0;
+        for (auto& [i, r] : requestors)
+        {
+            unmatched_deletes += r->PendingDeletes();
+        }
+        std::ranges::sort(counters.latencies_us);
+        auto& latencies = counters.latencies_us;
+        double recorded = events.empty() ? 0.0 : events.back().time_us / 1e6;
+        std::printf(
+            "events %zu, requestors %zu, data %zu B\n"
+            "recorded %.3f s, replayed %.3f s\n"
+            "requests %zu, refused %zu, %.1f requests/s\n"
+            "SelectionNotify latency p50 %.3f ms, p99 %.3f ms, max %.3f ms\n"
+            "property deletes %zu, not matched by the owner %zu\n",
+            events.size(), requestors.size(), recording->data_size, recorded, elapsed,
+            counters.requests, counters.refused, counters.requests / elapsed,
+            percentile(latencies, 0.5), percentile(latencies, 0.99), percentile(latencies, 1.0),
+            counters.deletes, unmatched_deletes);
+
+        requestors.clear();
+        auto quiesce_deadline = clock_type::now() + std::chrono::seconds{5};
+        while (clipper.Stats().transfers != 0 && clock_type::now() < quiesce_deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        }
+        auto stats = clipper.Stats();
+        std::printf("owner left with %zu queued requests, %zu transfers\n", stats.queued_requests, stats.transfers);
+
+        // owner stops once another client takes CLIPBOARD
+        xcb_connection_t* c = control.get();
+        xcb_window_t window = xcb_generate_id(c);
+        xcb_create_window(
+            c, 0, window, xcb_setup_roots_iterator(xcb_get_setup(c)).data->root, 0, 0, 1, 1, 0,
+            XCB_WINDOW_CLASS_INPUT_ONLY, XCB_COPY_FROM_PARENT, 0, nullptr);
+        xcb_set_selection_owner(c, window, atoms["CLIPBOARD"], XCB_CURRENT_TIME);
+        xcb_flush(c);
+        owner.join();
+    }
+    catch (std::exception& e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,553 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <getopt.h>
+#include <poll.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+#include "clipper.hpp"
+#include "fake_server.hpp"
+#include "transport.hpp"
+#include "xvfb.hpp"
+
+using namespace xcpp;
+
+using clock_type = std::chrono::steady_clock;
+
+static const char* usage =
+    "Usage: stress_bench [-f] [-c CLIENTS] [-d SECONDS] [-i SECONDS] [-s SIZE] [-r LOG]\n"
+    "\t-f  use in-process fake X server instead of Xvfb or DISPLAY\n"
+    "\t-c  number of requestor connections, 1000 by default\n"
+    "\t-d  duration of the run, 60 s by default\n"
+    "\t-i  reporting interval, 10 s by default\n"
+    "\t-s  size of the served data, 16 MiB by default, so UTF8_STRING is sent with INCR\n"
+    "\t-r  record the owner's incoming traffic to LOG for replay_bench\n";
+
+// how long a well-behaved requestor waits for each step before giving up on the request
+static constexpr auto step_timeout = std::chrono::seconds{10};
+
+enum class Kind
+{
+    TARGETS,
+    TIMESTAMP,
+    TEXT,
+    MULTIPLE
+};
+
+enum class Behavior
+{
+    // deletes properties and waits for all data
+    NORMAL,
+    // never deletes INCR property, then goes away after a while like a hung application being killed
+    STALLING,
+    // destroys its window after the first INCR chunk
+    VANISHING
+};
+
+struct Atoms
+{
+    xcb_atom_t clipboard;
+    xcb_atom_t targets;
+    xcb_atom_t timestamp;
+    xcb_atom_t utf8_string;
+    xcb_atom_t multiple;
+    xcb_atom_t atom_pair;
+    xcb_atom_t incr;
+    // property of the request, and of each MULTIPLE subrequest
+    xcb_atom_t property;
+    xcb_atom_t multiple_properties[3];
+};
+
+struct Counters
+{
+    std::size_t succeeded = 0;
+    std::size_t refused = 0;
+    std::size_t timed_out = 0;
+    std::size_t stalled = 0;
+    std::size_t vanished = 0;
+    std::vector<std::uint64_t> latencies_us;
+};
+
+static xcb_atom_t intern(xcb_connection_t* c, std::string_view name)
+{
+    auto reply = xcb_intern_atom_reply(c, xcb_intern_atom(c, 0, name.size(), name.data()), nullptr);
+    xcb_atom_t atom = reply == nullptr ? xcb_atom_t{XCB_ATOM_NONE} : reply->atom;
+    std::free(reply);
+    return atom;
+}
+
+// requestor driven by events of its own connection, has at most one request in flight
+class Requestor
+{
+public:
+    Requestor(const Transport& transport, const Atoms& atoms) :
+        connection_{transport.Connect().first},
+        atoms_{atoms}
+    {
+        CreateWindow();
+    }
+
+    int Fd() const noexcept
+    {
+        return xcb_get_file_descriptor(connection_.get());
+    }
+
+    bool IsBroken() const noexcept
+    {
+        return xcb_connection_has_error(connection_.get()) != 0;
+    }
+
+    void Start(std::mt19937& gen, Counters& counters)
+    {
+        if (is_busy_)
+        {
+            return;
+        }
+        std::uniform_int_distribution<int> percent{0, 99};
+        int kind = percent(gen);
+        kind_ = kind < 20 ? Kind::TARGETS : kind < 30 ? Kind::TIMESTAMP : kind < 70 ? Kind::TEXT : Kind::MULTIPLE;
+        int behavior = percent(gen);
+        behavior_ = behavior < 2 ? Behavior::STALLING : behavior < 4 ? Behavior::VANISHING : Behavior::NORMAL;
+        stall_time_ = std::chrono::milliseconds{std::uniform_int_distribution<int>{1000, 5000}(gen)};
+        incremental_.clear();
+        is_busy_ = true;
+        start_ = clock_type::now();
+        deadline_ = start_ + step_timeout;
+        counters_ = &counters;
+
+        xcb_atom_t target = atoms_.targets;
+        if (kind_ == Kind::TIMESTAMP)
+        {
+            target = atoms_.timestamp;
+        }
+        else if (kind_ == Kind::TEXT)
+        {
+            target = atoms_.utf8_string;
+        }
+        else if (kind_ == Kind::MULTIPLE)
+        {
+            target = atoms_.multiple;
+            xcb_atom_t pairs[] =
+            {
+                atoms_.utf8_string, atoms_.multiple_properties[0],
+                atoms_.targets, atoms_.multiple_properties[1],
+                atoms_.timestamp, atoms_.multiple_properties[2]
+            };
+            xcb_change_property(
+                connection_.get(), XCB_PROP_MODE_REPLACE, window_, atoms_.property, atoms_.atom_pair, 32,
+                std::size(pairs), pairs);
+        }
+        xcb_convert_selection(
+            connection_.get(), window_, atoms_.clipboard, target, atoms_.property, XCB_CURRENT_TIME);
+        xcb_flush(connection_.get());
+    }
+
+    void HandleEvents()
+    {
+        while (xcb_generic_event_t* event = xcb_poll_for_event(connection_.get()))
+        {
+            HandleEvent(event);
+            std::free(event);
+        }
+        xcb_flush(connection_.get());
+    }
+
+    // gives up on requests without progress, stalling requestors go away once they have stalled long enough
+    void CheckTime(clock_type::time_point now)
+    {
+        if (!is_busy_)
+        {
+            return;
+        }
+        if (is_stalled_ && now - start_ > stall_time_)
+        {
+            ++counters_->stalled;
+            Reset();
+        }
+        else if (!is_stalled_ && now > deadline_)
+        {
+            ++counters_->timed_out;
+            Reset();
+        }
+    }
+
+private:
+    void CreateWindow()
+    {
+        window_ = xcb_generate_id(connection_.get());
+        std::uint32_t event_mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+        xcb_create_window(
+            connection_.get(), 0, window_, xcb_setup_roots_iterator(xcb_get_setup(connection_.get())).data->root,
+            0, 0, 1, 1, 0, XCB_WINDOW_CLASS_INPUT_ONLY, XCB_COPY_FROM_PARENT, XCB_CW_EVENT_MASK, &event_mask);
+    }
+
+    // drops the request in whatever state it is by replacing the window
+    void Reset()
+    {
+        xcb_destroy_window(connection_.get(), window_);
+        CreateWindow();
+        xcb_flush(connection_.get());
+        is_busy_ = false;
+        is_stalled_ = false;
+    }
+
+    void Finish()
+    {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - start_).count();
+        counters_->latencies_us.push_back(us);
+        ++counters_->succeeded;
+        is_busy_ = false;
+    }
+
+    // reads and deletes the whole property, returns its type and size
+    std::pair<xcb_atom_t, std::size_t> ReadProperty(xcb_atom_t property, bool is_deleted = true)
+    {
+        auto cookie = xcb_get_property(
+            connection_.get(), is_deleted, window_, property, XCB_ATOM_ANY, 0,
+            std::numeric_limits<std::uint32_t>::max() / 4);
+        auto reply = xcb_get_property_reply(connection_.get(), cookie, nullptr);
+        if (reply == nullptr)
+        {
+            return {XCB_ATOM_NONE, 0};
+        }
+        std::pair res{reply->type, static_cast<std::size_t>(xcb_get_property_value_length(reply))};
+        if (property == atoms_.property && kind_ == Kind::MULTIPLE && reply->type == atoms_.atom_pair)
+        {
+            auto pairs = static_cast<const xcb_atom_t*>(xcb_get_property_value(reply));
+            for (std::size_t i = 1; i < res.second / sizeof(xcb_atom_t); i += 2)
+            {
+                if (pairs[i] != XCB_ATOM_NONE)
+                {
+                    multiple_results_.push_back(pairs[i]);
+                }
+            }
+        }
+        std::free(reply);
+        return res;
+    }
+
+    // starts receiving the property, which may be INCR
+    void Receive(xcb_atom_t property)
+    {
+        auto [type, size] = ReadProperty(property, behavior_ != Behavior::STALLING);
+        if (type != atoms_.incr)
+        {
+            return;
+        }
+        if (behavior_ == Behavior::STALLING)
+        {
+            is_stalled_ = true;
+            return;
+        }
+        incremental_.push_back(property);
+    }
+
+    void HandleEvent(xcb_generic_event_t* event)
+    {
+        switch (event->response_type & ~0x80)
+        {
+            case XCB_SELECTION_NOTIFY:
+            {
+                auto notify = reinterpret_cast<xcb_selection_notify_event_t*>(event);
+                if (!is_busy_ || notify->requestor != window_)
+                {
+                    return;
+                }
+                deadline_ = clock_type::now() + step_timeout;
+                if (notify->property == XCB_ATOM_NONE)
+                {
+                    ++counters_->refused;
+                    is_busy_ = false;
+                    return;
+                }
+                multiple_results_.clear();
+                Receive(atoms_.property);
+                for (auto property : multiple_results_)
+                {
+                    Receive(property);
+                }
+                if (incremental_.empty() && !is_stalled_)
+                {
+                    Finish();
+                }
+                return;
+            }
+            case XCB_PROPERTY_NOTIFY:
+            {
+                auto notify = reinterpret_cast<xcb_property_notify_event_t*>(event);
+                auto property = std::ranges::find(incremental_, notify->atom);
+                if (!is_busy_ ||
+                    notify->window != window_ ||
+                    notify->state != XCB_PROPERTY_NEW_VALUE ||
+                    property == incremental_.end())
+                {
+                    return;
+                }
+                deadline_ = clock_type::now() + step_timeout;
+                if (behavior_ == Behavior::VANISHING)
+                {
+                    ++counters_->vanished;
+                    Reset();
+                    return;
+                }
+                auto [type, size] = ReadProperty(notify->atom);
+                if (size == 0)
+                {
+                    incremental_.erase(property);
+                    if (incremental_.empty())
+                    {
+                        Finish();
+                    }
+                }
+                return;
+            }
+            default:
+            {
+                return;
+            }
+        }
+    }
+
+    Connection connection_;
+    const Atoms& atoms_;
+    xcb_window_t window_;
+    Kind kind_ = Kind::TARGETS;
+    Behavior behavior_ = Behavior::NORMAL;
+    bool is_busy_ = false;
+    bool is_stalled_ = false;
+    clock_type::time_point start_;
+    clock_type::time_point deadline_;
+    std::chrono::milliseconds stall_time_;
+    std::vector<xcb_atom_t> incremental_;
+    std::vector<xcb_atom_t> multiple_results_;
+    Counters* counters_ = nullptr;
+};
+
+// resident set size of the whole process in KiB, owner and fake server included
+static long rss_kb()
+{
+    std::ifstream status{"/proc/self/status"};
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.starts_with("VmRSS:"))
+        {
+            return std::strtol(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+static void report(double elapsed, Counters& counters, const ClipperStats& stats)
+{
+    auto& latencies = counters.latencies_us;
+    std::ranges::sort(latencies);
+    auto percentile = [&latencies](double p)
+    {
+        std::size_t i = std::min(latencies.size() - 1, static_cast<std::size_t>(p * latencies.size()));
+        return latencies.empty() ? 0.0 : latencies[i] / 1e3;
+    };
+    std::printf(
+        "%8.0f %9zu %8zu %8zu %8zu %8zu %9.2f %9.2f %9.2f %9.1f %7zu %9zu\n",
+        elapsed, counters.succeeded, counters.refused, counters.timed_out, counters.stalled, counters.vanished,
+        percentile(0.5), percentile(0.99), percentile(1.0), rss_kb() / 1024.0,
+        stats.queued_requests, stats.transfers);
+    std::fflush(stdout);
+    counters = {};
+}
+
+int main(int argc, char* argv[])
+{
+    bool use_fake = false;
+    std::size_t client_count = 1000;
+    double duration = 60;
+    double interval = 10;
+    std::size_t size = 16 << 20;
+    std::string record_path;
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "fc:d:i:s:r:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'f':
+            {
+                use_fake = true;
+                break;
+            }
+            case 'c':
+            {
+                client_count = std::strtoull(optarg, nullptr, 10);
+                break;
+            }
+            case 'd':
+            {
+                duration = std::strtod(optarg, nullptr);
+                break;
+            }
+            case 'i':
+            {
+                interval = std::strtod(optarg, nullptr);
+                break;
+            }
+            case 's':
+            {
+                size = std::strtoull(optarg, nullptr, 10);
+                break;
+            }
+            case 'r':
+            {
+                record_path = optarg;
+                break;
+            }
+            default:
+            {
+                std::fputs(usage, stderr);
+                return 1;
+            }
+        }
+    }
+
+    std::optional<bench::Xvfb> xvfb;
+    std::optional<bench::FakeServer> fake_server;
+    std::optional<DisplayTransport> display;
+    const Transport* transport = nullptr;
+    if (!use_fake && xvfb.emplace().IsRunning())
+    {
+        transport = &display.emplace();
+    }
+    else if (!use_fake && std::getenv("DISPLAY") != nullptr)
+    {
+        std::fprintf(stderr, "Xvfb can't be started, using DISPLAY=%s\n", std::getenv("DISPLAY"));
+        transport = &display.emplace();
+    }
+    else
+    {
+        transport = &fake_server.emplace();
+    }
+
+    try
+    {
+        std::string data(size, 'x');
+        ClipperOptions clipper_options;
+        clipper_options.transport = transport;
+        clipper_options.record_path = record_path;
+        Clipper clipper{data, clipper_options};
+        std::thread owner{[&clipper]
+        {
+            try
+            {
+                clipper.Run();
+            }
+            catch (std::exception& e)
+            {
+                std::fprintf(stderr, "Owner failed: %s\n", e.what());
+            }
+        }};
+
+        auto [control, screen_id] = transport->Connect();
+        Atoms atoms = {};
+        atoms.clipboard = intern(control.get(), "CLIPBOARD");
+        atoms.targets = intern(control.get(), "TARGETS");
+        atoms.timestamp = intern(control.get(), "TIMESTAMP");
+        atoms.utf8_string = intern(control.get(), "UTF8_STRING");
+        atoms.multiple = intern(control.get(), "MULTIPLE");
+        atoms.atom_pair = intern(control.get(), "ATOM_PAIR");
+        atoms.incr = intern(control.get(), "INCR");
+        atoms.property = intern(control.get(), "XCLIPP_STRESS");
+        for (std::size_t i = 0; i < std::size(atoms.multiple_properties); ++i)
+        {
+            atoms.multiple_properties[i] = intern(control.get(), "XCLIPP_STRESS_" + std::to_string(i));
+        }
+
+        std::vector<std::unique_ptr<Requestor>> requestors;
+        for (std::size_t i = 0; i < client_count; ++i)
+        {
+            requestors.push_back(std::make_unique<Requestor>(*transport, atoms));
+        }
+
+        std::printf(
+            "%8s %9s %8s %8s %8s %8s %9s %9s %9s %9s %7s %9s\n",
+            "time s", "pastes", "refused", "timeout", "stalled", "vanished", "p50 ms", "p99 ms", "max ms",
+            "RSS MB", "queued", "transfers");
+        std::mt19937 gen{42};
+        Counters counters;
+        std::vector<pollfd> fds;
+        auto start = clock_type::now();
+        auto next_report = start + std::chrono::duration<double>{interval};
+        auto end = start + std::chrono::duration<double>{duration};
+        while (clock_type::now() < end)
+        {
+            fds.clear();
+            for (auto& r : requestors)
+            {
+                r->Start(gen, counters);
+                fds.push_back({r->Fd(), POLLIN, 0});
+            }
+            poll(fds.data(), fds.size(), 100);
+            auto now = clock_type::now();
+            for (std::size_t i = 0; i < requestors.size(); ++i)
+            {
+                if (fds[i].revents != 0)
+                {
+                    requestors[i]->HandleEvents();
+                }
+                requestors[i]->CheckTime(now);
+            }
+            if (std::ranges::any_of(requestors, [](auto& r) { return r->IsBroken(); }))
+            {
+                std::fputs("Requestor connection is broken\n", stderr);
+                break;
+            }
+            if (now >= next_report)
+            {
+                report(std::chrono::duration<double>(now - start).count(), counters, clipper.Stats());
+                next_report += std::chrono::duration<double>{interval};
+            }
+        }
+
+        report(std::chrono::duration<double>(clock_type::now() - start).count(), counters, clipper.Stats());
+
+        // whatever the owner still tracks once all requestors are gone is leaked
+        requestors.clear();
+        auto quiesce_deadline = clock_type::now() + std::chrono::seconds{5};
+        while (clipper.Stats().transfers != 0 && clock_type::now() < quiesce_deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        }
+        auto stats = clipper.Stats();
+        std::printf("leaked: %zu queued requests, %zu transfers\n", stats.queued_requests, stats.transfers);
+
+        // owner stops once another client takes CLIPBOARD
+        xcb_connection_t* c = control.get();
+        xcb_window_t window = xcb_generate_id(c);
+        xcb_create_window(
+            c, 0, window, xcb_setup_roots_iterator(xcb_get_setup(c)).data->root, 0, 0, 1, 1, 0,
+            XCB_WINDOW_CLASS_INPUT_ONLY, XCB_COPY_FROM_PARENT, 0, nullptr);
+        xcb_set_selection_owner(c, window, atoms.clipboard, XCB_CURRENT_TIME);
+        xcb_flush(c);
+        owner.join();
+        return stats.queued_requests == 0 && stats.transfers == 0 ? 0 : 2;
+    }
+    catch (std::exception& e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
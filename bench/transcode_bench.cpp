@@ -0,0 +1,58 @@
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "bench.hpp"
+#include "transcode.hpp"
+
+using namespace xcpp;
+
+// converts the whole `src` chunk by chunk into a buffer of `chunk_size` bytes, like INCR transfer does
+static void bench_transcoder(std::string_view name, std::string_view src, Transcoder t, std::size_t chunk_size)
+{
+    auto buf = std::make_unique<char[]>(chunk_size);
+    std::string full_name = std::string{name} + " / " + std::to_string(chunk_size >> 10) + "K chunks";
+    bench::Measure(full_name, src.size(), [&]
+    {
+        std::string_view rest = src;
+        while (!rest.empty())
+        {
+            auto [consumed, written] = t.transcode(rest, buf.get(), chunk_size);
+            bench::DoNotOptimize(buf[written / 2]);
+            rest.remove_prefix(consumed);
+        }
+    });
+}
+
+int main(int argc, char* argv[])
+{
+    std::size_t size = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 64 << 20;
+
+    std::string ascii = bench::MakeCorpus(size, {"lorem ", "ipsum ", "dolor ", "sit ", "amet,\n", "2024-01-01 INFO "});
+    std::string latin1 = bench::MakeCorpus(size, {"caf\xE9 ", "na\xEFve ", "gar\xE7on ", "text ", "\xFC" "ber "});
+    std::string cyrillic = bench::MakeCorpus(size, {"\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82 ", "mir "});
+    std::string cjk = bench::MakeCorpus(size, {"\xE4\xBD\xA0\xE5\xA5\xBD", "\xE4\xB8\x96\xE7\x95\x8C", "\xE3\x80\x82"});
+    std::string emoji = bench::MakeCorpus(size, {"\xF0\x9F\x98\x80", "\xF0\x9F\x91\x8D ", "ok "});
+
+    // typical max_transfer_size_ with and without BIG-REQUESTS
+    for (std::size_t chunk_size : {std::size_t{1} << 17, std::size_t{8} << 20})
+    {
+        bench_transcoder("utf8->utf16le ascii", ascii, utf8_to_utf16le_transcoder, chunk_size);
+        bench_transcoder("utf8->utf16le cyrillic", cyrillic, utf8_to_utf16le_transcoder, chunk_size);
+        bench_transcoder("utf8->utf16le cjk", cjk, utf8_to_utf16le_transcoder, chunk_size);
+        bench_transcoder("utf8->utf16le emoji", emoji, utf8_to_utf16le_transcoder, chunk_size);
+        bench_transcoder("utf8->utf16be cjk", cjk, utf8_to_utf16be_transcoder, chunk_size);
+        bench_transcoder("latin1->utf16le", latin1, latin1_to_utf16le_transcoder, chunk_size);
+        bench_transcoder("latin1->utf8", latin1, latin1_to_utf8_transcoder, chunk_size);
+        bench_transcoder("utf8->latin1 cyrillic", cyrillic, utf8_to_latin1_transcoder, chunk_size);
+        bench_transcoder("sanitize utf8 cjk", cjk, sanitize_utf8_transcoder, chunk_size);
+    }
+
+    bench::Measure("utf8->utf16 size cjk", cjk.size(), [&] { bench::DoNotOptimize(utf8_to_utf16_size(cjk)); });
+    bench::Measure("latin1->utf8 size", latin1.size(), [&] { bench::DoNotOptimize(latin1_to_utf8_size(latin1)); });
+
+    return 0;
+}
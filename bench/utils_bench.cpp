@@ -0,0 +1,102 @@
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+
+#include "bench.hpp"
+#include "converter.hpp"
+#include "digest.hpp"
+#include "transcode.hpp"
+#include "utils.hpp"
+
+using namespace xcpp;
+
+// uniformly random bytes
+static std::string make_binary(std::size_t size)
+{
+    std::mt19937 gen{42};
+    std::uniform_int_distribution<int> dist{0, 255};
+    std::string data(size, '\0');
+    for (auto& c : data)
+    {
+        c = static_cast<char>(dist(gen));
+    }
+    return data;
+}
+
+// valid input is scanned to the end, so throughput is reported, invalid one is rejected at its first bad bytes,
+// so time per call is reported instead
+template <class Validator>
+static void bench_validator(std::string_view name, std::string_view data, Validator validate)
+{
+    if (validate(data))
+    {
+        bench::Measure(name, data.size(), [&] { bench::DoNotOptimize(validate(data)); });
+    }
+    else
+    {
+        bench::MeasureCalls(name, data.size(), [&] { bench::DoNotOptimize(validate(data)); });
+    }
+}
+
+// produces the whole file manager clipboard format chunk by chunk, like transfer of x-special/gnome-copied-files
+static void bench_file_list(std::string_view name, std::string_view path, std::size_t chunk_size)
+{
+    auto buf = std::make_unique<char[]>(chunk_size);
+    std::size_t size = uri_path_size(path);
+    bench::Measure(name, path.size(), [&]
+    {
+        TranscodingConverter converter{uri_path_transcoder, path, size, "copy\nfile://"};
+        while (std::size_t written = converter.Convert(buf.get(), chunk_size))
+        {
+            bench::DoNotOptimize(buf[written / 2]);
+        }
+    });
+}
+
+int main(int argc, char* argv[])
+{
+    std::size_t size = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 64 << 20;
+
+    std::string logs = bench::MakeCorpus(
+        size, {"2024-01-01T00:00:00Z ", "INFO ", "WARN ", "request id=42 ", "took 15ms", "\n", "\t"});
+    std::string latin1 = bench::MakeCorpus(size, {"caf\xE9 ", "na\xEFve ", "gar\xE7on ", "text ", "\xFC" "ber "});
+    std::string cjk = bench::MakeCorpus(size, {"\xE4\xBD\xA0\xE5\xA5\xBD", "\xE4\xB8\x96\xE7\x95\x8C", "\xE3\x80\x82"});
+    std::string binary = make_binary(size);
+
+    // binary input shows how early it's rejected
+    bench_validator("is_ascii ascii logs", logs, is_ascii);
+    bench_validator("is_icccm_string ascii logs", logs, is_icccm_string);
+    bench_validator("is_icccm_string latin1", latin1, is_icccm_string);
+    bench_validator("is_icccm_string binary", binary, is_icccm_string);
+    bench_validator("is_icccm_utf8_string ascii logs", logs, is_icccm_utf8_string);
+    bench_validator("is_icccm_utf8_string cjk", cjk, is_icccm_utf8_string);
+    bench_validator("is_icccm_utf8_string binary", binary, is_icccm_utf8_string);
+    // digest of any data takes the whole of it
+    bench::Measure("content_digest ascii logs", logs.size(), [&] { bench::DoNotOptimize(content_digest(logs)); });
+    bench::Measure("content_digest binary", binary.size(), [&] { bench::DoNotOptimize(content_digest(binary)); });
+
+    // paths are short in practice, long ones show per-byte cost of percent-encoding
+    std::string plain_path = "/" + bench::MakeCorpus(4 << 10, {"home/", "user/", "projects/", "src/", "main.cpp"});
+    std::string escaped_path = "/" + bench::MakeCorpus(
+        4 << 10, {"My Documents/", "100% done/", "#1 [draft]/", "\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82/"});
+    std::string long_path = "/" + bench::MakeCorpus(size, {"a b/", "c%d/", "\xE4\xBD\xA0\xE5\xA5\xBD/", "plain/"});
+
+    bench::Measure("uri_path_size plain", plain_path.size(), [&] { bench::DoNotOptimize(uri_path_size(plain_path)); });
+    bench::Measure(
+        "uri_path_size escaped", escaped_path.size(), [&] { bench::DoNotOptimize(uri_path_size(escaped_path)); });
+    bench::Measure("uri_path_size long", long_path.size(), [&] { bench::DoNotOptimize(uri_path_size(long_path)); });
+
+    // typical max_transfer_size_ with and without BIG-REQUESTS
+    for (std::size_t chunk_size : {std::size_t{1} << 17, std::size_t{8} << 20})
+    {
+        std::string suffix = " / " + std::to_string(chunk_size >> 10) + "K chunks";
+        bench_file_list("gnome-copied-files plain" + suffix, plain_path, chunk_size);
+        bench_file_list("gnome-copied-files escaped" + suffix, escaped_path, chunk_size);
+        bench_file_list("gnome-copied-files long" + suffix, long_path, chunk_size);
+    }
+
+    return 0;
+}
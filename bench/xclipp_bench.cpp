@@ -0,0 +1,360 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <xcb/xcb.h>
+
+#include "reader.hpp"
+#include "xvfb.hpp"
+
+using namespace xcpp;
+
+using clock_type = std::chrono::steady_clock;
+
+struct Owner
+{
+    const char* name;
+    // argv of the owner process, FILE is substituted for nullptr, stdin is redirected from FILE
+    std::vector<const char*> argv;
+};
+
+enum class Paste
+{
+    TEXT,
+    MULTIPLE
+};
+
+// targets requested at once with MULTIPLE, all of them are offered for ASCII data by every owner
+static constexpr std::string_view multiple_targets[] = {"UTF8_STRING", "STRING", "TEXT"};
+
+// whether anyone owns CLIPBOARD and answers TARGETS
+static bool is_owned()
+{
+    try
+    {
+        return Reader{}.ListTargets().has_value();
+    }
+    catch (std::exception&)
+    {
+        return false;
+    }
+}
+
+// runs `owner` serving content of `file`, returns its pid once it owns CLIPBOARD or -1
+static pid_t start_owner(const Owner& owner, const char* file)
+{
+    std::vector<const char*> argv;
+    for (auto arg : owner.argv)
+    {
+        argv.push_back(arg == nullptr ? file : arg);
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int fd = open(file, O_RDONLY);
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        execvp(argv[0], const_cast<char* const*>(argv.data()));
+        std::_Exit(127);
+    }
+    if (pid == -1)
+    {
+        return -1;
+    }
+
+    auto deadline = clock_type::now() + std::chrono::seconds{10};
+    while (!is_owned())
+    {
+        if (waitpid(pid, nullptr, WNOHANG) == pid)
+        {
+            return -1;
+        }
+        if (clock_type::now() > deadline)
+        {
+            kill(pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+            return -1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    return pid;
+}
+
+// stops owner and waits until CLIPBOARD has no owner, returns owner's peak RSS in KB
+static long stop_owner(pid_t pid)
+{
+    kill(pid, SIGTERM);
+    int status = 0;
+    rusage usage = {};
+    wait4(pid, &status, 0, &usage);
+    auto deadline = clock_type::now() + std::chrono::seconds{5};
+    while (is_owned() && clock_type::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    return usage.ru_maxrss;
+}
+
+static bool paste(Reader& reader, Paste mode, int fd)
+{
+    if (mode == Paste::TEXT)
+    {
+        return reader.Read(fd);
+    }
+    int fds[std::size(multiple_targets)];
+    std::fill(std::begin(fds), std::end(fds), fd);
+    auto converted = reader.ReadMultiple(multiple_targets, fds);
+    return converted && std::ranges::all_of(*converted, [](bool c) { return c; });
+}
+
+// each requestor is a separate process with its own connection, pastes `runs` times in a row,
+// returns latencies of all pastes in ns and wall time of the whole run, nullopt if any paste failed
+static std::optional<std::pair<std::vector<std::uint64_t>, double>> run_requestors(
+    Paste mode, std::size_t concurrency, std::size_t runs)
+{
+    int ready[2];
+    int go[2];
+    if (pipe(ready) == -1 || pipe(go) == -1)
+    {
+        return {};
+    }
+    std::vector<pid_t> pids;
+    std::vector<int> result_fds;
+    for (std::size_t i = 0; i < concurrency; ++i)
+    {
+        int results[2];
+        if (pipe(results) == -1)
+        {
+            break;
+        }
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(results[0]);
+            close(go[1]);
+            int null_fd = open("/dev/null", O_WRONLY);
+            try
+            {
+                // connection setup is not measured, all requestors start at once
+                Reader reader;
+                char c = 0;
+                bool is_ready = write(ready[1], "", 1) == 1;
+                close(ready[1]); // parent stops waiting if some requestor has died before getting ready
+                if (!is_ready || read(go[0], &c, 1) != 0)
+                {
+                    std::_Exit(1);
+                }
+                for (std::size_t r = 0; r < runs; ++r)
+                {
+                    auto start = clock_type::now();
+                    if (!paste(reader, mode, null_fd))
+                    {
+                        std::_Exit(1);
+                    }
+                    std::uint64_t ns = std::chrono::nanoseconds{clock_type::now() - start}.count();
+                    if (write(results[1], &ns, sizeof(ns)) != sizeof(ns))
+                    {
+                        std::_Exit(1);
+                    }
+                }
+            }
+            catch (std::exception& e)
+            {
+                std::fprintf(stderr, "%s\n", e.what());
+                std::_Exit(1);
+            }
+            std::_Exit(0);
+        }
+        close(results[1]);
+        if (pid == -1)
+        {
+            close(results[0]);
+            break;
+        }
+        pids.push_back(pid);
+        result_fds.push_back(results[0]);
+    }
+    close(ready[1]);
+    close(go[0]);
+
+    char c = 0;
+    std::size_t ready_count = 0;
+    while (ready_count < pids.size() && read(ready[0], &c, 1) == 1)
+    {
+        ++ready_count;
+    }
+    close(ready[0]);
+    auto start = clock_type::now();
+    close(go[1]);
+
+    std::vector<std::uint64_t> latencies;
+    for (int fd : result_fds)
+    {
+        std::uint64_t ns = 0;
+        while (read(fd, &ns, sizeof(ns)) == sizeof(ns))
+        {
+            latencies.push_back(ns);
+        }
+        close(fd);
+    }
+    double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+
+    bool ok = pids.size() == concurrency;
+    for (pid_t pid : pids)
+    {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    if (!ok)
+    {
+        return {};
+    }
+    return std::pair{std::move(latencies), seconds};
+}
+
+static double percentile_ms(const std::vector<std::uint64_t>& sorted, double p)
+{
+    std::size_t i = std::min(sorted.size() - 1, static_cast<std::size_t>(p * sorted.size()));
+    return sorted[i] / 1e6;
+}
+
+// writes payload of `size` ASCII bytes into a temporary file, which is read by owners
+static std::optional<std::string> make_payload(std::size_t size)
+{
+    std::string path = "/tmp/xclipp_bench_XXXXXX";
+    int fd = mkstemp(path.data());
+    if (fd == -1)
+    {
+        return {};
+    }
+    std::string block(std::min<std::size_t>(size, 1 << 20), 'x');
+    for (std::size_t left = size; left != 0;)
+    {
+        ssize_t n = write(fd, block.data(), std::min(left, block.size()));
+        if (n <= 0)
+        {
+            close(fd);
+            unlink(path.c_str());
+            return {};
+        }
+        left -= n;
+    }
+    close(fd);
+    return path;
+}
+
+// whether `program` can be found in PATH
+static bool is_installed(const char* program)
+{
+    std::string command = std::string{"command -v "} + program + " >/dev/null 2>&1";
+    return std::system(command.c_str()) == 0;
+}
+
+int main(int argc, char* argv[])
+{
+    std::size_t max_size = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 256 << 20;
+    std::size_t max_concurrency = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 16;
+
+    bench::Xvfb xvfb;
+    if (!xvfb.IsRunning() && std::getenv("DISPLAY") == nullptr)
+    {
+        std::fputs("Xvfb can't be started and DISPLAY is not set\n", stderr);
+        return 1;
+    }
+    if (!xvfb.IsRunning())
+    {
+        std::fprintf(stderr, "Xvfb can't be started, using DISPLAY=%s\n", std::getenv("DISPLAY"));
+    }
+
+    // data of this size and less is sent in one shot, larger one with INCR
+    xcb_connection_t* c = xcb_connect(nullptr, nullptr);
+    if (xcb_connection_has_error(c))
+    {
+        std::fputs("Failed to connect to X server\n", stderr);
+        return 1;
+    }
+    std::size_t max_request_size = 4 * static_cast<std::size_t>(xcb_get_maximum_request_length(c)) - 24;
+    xcb_disconnect(c);
+
+    std::vector<Owner> owners =
+    {
+        {"xclipp", {XCLIPP_PATH, "-c", nullptr}},
+        {"xclipp-m", {XCLIPP_PATH, "-m", "-c", nullptr}}
+    };
+    if (is_installed("xclip"))
+    {
+        owners.push_back({"xclip", {"xclip", "-selection", "clipboard", "-quiet", "-i", nullptr}});
+    }
+    if (is_installed("xsel"))
+    {
+        owners.push_back({"xsel", {"xsel", "--clipboard", "--nodetach", "--input"}});
+    }
+
+    std::printf(
+        "%-9s %-8s %12s %4s %10s %10s %10s %9s\n",
+        "owner", "target", "size", "conc", "MB/s", "p50 ms", "p99 ms", "RSS MB");
+    for (std::size_t size = 16; size <= max_size; size *= 16)
+    {
+        auto payload = make_payload(size);
+        if (!payload)
+        {
+            std::fputs("Failed to write payload\n", stderr);
+            break;
+        }
+        for (auto& owner : owners)
+        {
+            for (auto mode : {Paste::TEXT, Paste::MULTIPLE})
+            {
+                const char* target =
+                    mode == Paste::MULTIPLE ? "MULTIPLE" : size <= max_request_size ? "single" : "INCR";
+                std::size_t bytes = mode == Paste::MULTIPLE ? size * std::size(multiple_targets) : size;
+                for (std::size_t concurrency = 1; concurrency <= max_concurrency; concurrency *= 4)
+                {
+                    // about 1 GB per case, but enough pastes for percentiles
+                    std::size_t runs = std::clamp<std::size_t>((1 << 30) / (bytes * concurrency), 5, 200);
+                    pid_t pid = start_owner(owner, payload->c_str());
+                    if (pid == -1)
+                    {
+                        std::fprintf(stderr, "%s: failed to take ownership\n", owner.name);
+                        break;
+                    }
+                    auto res = run_requestors(mode, concurrency, runs);
+                    long rss_kb = stop_owner(pid);
+                    if (!res)
+                    {
+                        std::printf("%-9s %-8s %12zu %4zu %10s\n", owner.name, target, size, concurrency, "failed");
+                        continue;
+                    }
+                    auto& [latencies, seconds] = *res;
+                    std::ranges::sort(latencies);
+                    std::printf(
+                        "%-9s %-8s %12zu %4zu %10.1f %10.3f %10.3f %9.1f\n",
+                        owner.name, target, size, concurrency,
+                        static_cast<double>(bytes) * latencies.size() / seconds / 1e6,
+                        percentile_ms(latencies, 0.5), percentile_ms(latencies, 0.99), rss_kb / 1024.0);
+                    std::fflush(stdout);
+                }
+            }
+        }
+        unlink(payload->c_str());
+    }
+}
@@ -0,0 +1,71 @@
+#include <csignal>
+#include <cstdlib>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "xvfb.hpp"
+
+namespace xcpp::bench
+{
+
+Xvfb::Xvfb() : pid_{-1}
+{
+    int display_pipe[2];
+    if (pipe(display_pipe) == -1)
+    {
+        return;
+    }
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(display_pipe[0]);
+        int null_fd = open("/dev/null", O_RDWR);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        std::string fd = std::to_string(display_pipe[1]);
+        // as many clients as Xvfb allows for stress runs
+        execlp(
+            "Xvfb", "Xvfb", "-displayfd", fd.c_str(), "-nolisten", "tcp", "-maxclients", "2048",
+            "-screen", "0", "64x64x24", nullptr);
+        std::_Exit(127);
+    }
+    close(display_pipe[1]);
+    // Xvfb writes the display number once it's ready to accept connections
+    std::string display = ":";
+    char c = 0;
+    while (pid != -1 && read(display_pipe[0], &c, 1) == 1 && c != '\n')
+    {
+        display += c;
+    }
+    close(display_pipe[0]);
+    if (pid != -1 && display.size() == 1)
+    {
+        waitpid(pid, nullptr, 0);
+        return;
+    }
+    if (pid != -1)
+    {
+        setenv("DISPLAY", display.c_str(), 1);
+        pid_ = pid;
+    }
+}
+
+Xvfb::~Xvfb()
+{
+    if (pid_ != -1)
+    {
+        kill(pid_, SIGTERM);
+        waitpid(pid_, nullptr, 0);
+    }
+}
+
+bool Xvfb::IsRunning() const noexcept
+{
+    return pid_ != -1;
+}
+
+} // namespace xcpp::bench
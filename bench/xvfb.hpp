@@ -0,0 +1,32 @@
+#pragma once
+
+#ifndef XCLIPP_BENCH_XVFB_HPP
+#define XCLIPP_BENCH_XVFB_HPP
+
+#include <sys/types.h>
+
+namespace xcpp::bench
+{
+
+// Xvfb on a free display, DISPLAY points to it while it's running
+class Xvfb
+{
+public:
+    Xvfb();
+
+    Xvfb(const Xvfb&) = delete;
+
+    Xvfb& operator=(const Xvfb&) = delete;
+
+    ~Xvfb();
+
+    // false if Xvfb can't be started, e.g. it's not installed
+    bool IsRunning() const noexcept;
+
+private:
+    pid_t pid_;
+};
+
+} // namespace xcpp::bench
+
+#endif // XCLIPP_BENCH_XVFB_HPP
@@ -0,0 +1,375 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <source_location>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+#include <xcb/bigreq.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+#include "client.hpp"
+#include "transport.hpp"
+#include "utils.hpp"
+
+namespace xcpp
+{
+
+Client::Client(
+    std::span<const std::string_view> atom_names,
+    const std::string& display,
+    const Transport* transport) :
+    connection_{nullptr, xcb_disconnect}
+{
+    int screen_id = 0;
+    std::tie(connection_, screen_id) =
+        transport != nullptr ? transport->Connect() : DisplayTransport{display}.Connect();
+
+    xcb_prefetch_extension_data(connection_.get(), &xcb_big_requests_id);
+    xcb_prefetch_maximum_request_length(connection_.get());
+
+    xcb_screen_t *screen = nullptr;
+    for (auto it = xcb_setup_roots_iterator(xcb_get_setup(connection_.get())); it.rem > 0; xcb_screen_next(&it))
+    {
+        if (screen_id == 0)
+        {
+            screen = it.data;
+            break;
+        }
+        --screen_id;
+    }
+    if (screen == nullptr)
+    {
+        throw std::runtime_error("Failed to get default screen");
+    }
+
+    // create window
+    window_ = xcb_generate_id(connection_.get());
+    xcb_event_mask_t event_mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+    auto window_cookie = xcb_create_window_checked(
+        connection_.get(),
+        0,
+        window_,
+        screen->root,
+        0, 0, 1, 1, 0,
+        XCB_WINDOW_CLASS_INPUT_ONLY,
+        XCB_COPY_FROM_PARENT,
+        XCB_CW_EVENT_MASK, &event_mask);
+
+    // get atoms
+    std::unordered_map<std::string_view, xcb_intern_atom_cookie_t> atom_cookies;
+    for (auto name : atom_names)
+    {
+        atom_cookies[name] = xcb_intern_atom(connection_.get(), 0, name.size(), name.data());
+    }
+    xcb_intern_atom_cookie_t clipboard_cookie = xcb_intern_atom(connection_.get(), 0, 9, "CLIPBOARD");
+    xcb_intern_atom_cookie_t atom_pair_cookie = xcb_intern_atom(connection_.get(), 0, 9, "ATOM_PAIR");
+    xcb_intern_atom_cookie_t incr_cookie = xcb_intern_atom(connection_.get(), 0, 4, "INCR");
+    xcb_intern_atom_cookie_t targets_cookie = xcb_intern_atom(connection_.get(), 0, 7, "TARGETS");
+    xcb_intern_atom_cookie_t property_cookie = xcb_intern_atom(connection_.get(), 0, 16, "XCLIPP_SELECTION");
+
+    // trigger event to get timestamp for selection acquiring and conversion requests
+    auto time_cookie = xcb_change_property_checked(
+        connection_.get(), XCB_PROP_MODE_REPLACE, window_, XCB_ATOM_PRIMARY, XCB_ATOM_PRIMARY, 8, 0, nullptr);
+
+    xcb_flush(connection_.get());
+
+    Await(window_cookie, "Failed to create window");
+
+    for (auto& [name, cookie] : atom_cookies)
+    {
+        auto atom = Await(
+            cookie, xcb_intern_atom_reply, &xcb_intern_atom_reply_t::atom,
+            ErrorLogger{std::format("Failed to get {} atom", name)});
+        if (atom)
+        {
+            atoms_[name] = *atom;
+        }
+    }
+    clipboard_atom_ = Await(
+        clipboard_cookie, xcb_intern_atom_reply, &xcb_intern_atom_reply_t::atom, "Failed to get CLIPBOARD atom");
+    atom_pair_atom_ = Await(
+        atom_pair_cookie, xcb_intern_atom_reply, &xcb_intern_atom_reply_t::atom, "Failed to get ATOM_PAIR atom");
+    incr_atom_ = Await(incr_cookie, xcb_intern_atom_reply, &xcb_intern_atom_reply_t::atom, "Failed to get INCR atom");
+    targets_atom_ = Await(
+        targets_cookie, xcb_intern_atom_reply, &xcb_intern_atom_reply_t::atom, "Failed to get TARGETS atom");
+    property_atom_ = Await(
+        property_cookie, xcb_intern_atom_reply, &xcb_intern_atom_reply_t::atom,
+        "Failed to get XCLIPP_SELECTION atom");
+
+    Await(time_cookie, "Failed to get server timestamp by dummy property change");
+    xcb_generic_event_t* time_event = nullptr;
+    while ((time_event = xcb_wait_for_event(connection_.get())))
+    {
+        if (time_event->response_type == XCB_PROPERTY_NOTIFY &&
+            reinterpret_cast<xcb_property_notify_event_t*>(time_event)->window == window_)
+        {
+            break;
+        }
+        std::free(time_event);
+    }
+    if (time_event == nullptr)
+    {
+        throw std::runtime_error("Failed to get server timestamp by dummy property change, I/O error");
+    }
+    timestamp_ = reinterpret_cast<xcb_property_notify_event_t*>(time_event)->time;
+    std::free(time_event);
+}
+
+void Client::Await(xcb_void_cookie_t cookie, std::string_view err_msg, std::source_location loc)
+{
+    if (xcb_generic_error_t* err = xcb_request_check(connection_.get(), cookie))
+    {
+        using namespace std::literals;
+        auto err_code = err->error_code;
+        std::free(err);
+        std::string_view file_name = loc.file_name();
+        file_name.remove_prefix(file_name.rfind('/') + 1);
+        std::string what =
+            err_msg.empty() ?
+            std::format("{}:{}: {}", file_name, loc.line(), error_string(err_code)) :
+            std::format("{}:{}: {}: {}", file_name, loc.line(), error_string(err_code), err_msg);
+        throw std::runtime_error(std::move(what));
+    }
+}
+
+std::unique_ptr<xcb_generic_event_t, decltype(&std::free)> Client::WaitForEvent(
+    const std::function<bool(xcb_generic_event_t*)>& is_awaited)
+{
+    using namespace std::chrono;
+
+    xcb_flush(connection_.get());
+    auto deadline = steady_clock::now() + milliseconds{receive_timeout_ms};
+    while (true)
+    {
+        // not awaited events are dropped
+        while (xcb_generic_event_t* event = xcb_poll_for_event(connection_.get()))
+        {
+            if (is_awaited(event))
+            {
+                return {event, std::free};
+            }
+            std::free(event);
+        }
+        auto left = duration_cast<milliseconds>(deadline - steady_clock::now()).count();
+        if (xcb_connection_has_error(connection_.get()) || left <= 0)
+        {
+            return {nullptr, std::free};
+        }
+        pollfd fd = {xcb_get_file_descriptor(connection_.get()), POLLIN, 0};
+        poll(&fd, 1, static_cast<int>(left));
+    }
+}
+
+bool Client::RequestConversion(xcb_atom_t selection, xcb_atom_t target, xcb_atom_t property)
+{
+    xcb_convert_selection(connection_.get(), window_, selection, target, property, timestamp_);
+    auto notify = WaitForEvent([this, selection, target](xcb_generic_event_t* event)
+    {
+        auto notify = reinterpret_cast<xcb_selection_notify_event_t*>(event);
+        return
+            (event->response_type & ~0x80) == XCB_SELECTION_NOTIFY &&
+            notify->requestor == window_ &&
+            notify->selection == selection &&
+            notify->target == target;
+    });
+    return
+        notify != nullptr &&
+        reinterpret_cast<xcb_selection_notify_event_t*>(notify.get())->property != XCB_ATOM_NONE;
+}
+
+bool Client::ReceiveProperty(
+    xcb_atom_t property,
+    const std::function<bool(xcb_atom_t, std::uint8_t, std::size_t, bool)>& on_size,
+    const std::function<bool(std::string_view)>& on_chunk)
+{
+    return ReceiveProperties(
+        {&property, 1},
+        [&on_size](std::size_t, xcb_atom_t type, std::uint8_t format, std::size_t size, bool is_incremental)
+        {
+            return on_size(type, format, size, is_incremental);
+        },
+        [&on_chunk](std::size_t, std::string_view chunk) { return on_chunk(chunk); });
+}
+
+bool Client::ReceiveProperties(
+    std::span<const xcb_atom_t> properties,
+    const std::function<bool(std::size_t, xcb_atom_t, std::uint8_t, std::size_t, bool)>& on_size,
+    const std::function<bool(std::size_t, std::string_view)>& on_chunk)
+{
+    struct Progress
+    {
+        std::size_t size;
+        bool is_incremental;
+        bool is_first;
+    };
+    std::vector<Progress> progress(properties.size());
+
+    std::vector<xcb_get_property_cookie_t> cookies;
+    for (auto property : properties)
+    {
+        cookies.push_back(xcb_get_property(connection_.get(), 0, window_, property, XCB_ATOM_ANY, 0, 0));
+    }
+    auto get_info = [](xcb_get_property_reply_t* r) { return std::tuple{r->type, r->bytes_after}; };
+    for (std::size_t i = 0; i < properties.size(); ++i)
+    {
+        auto info = Await(cookies[i], xcb_get_property_reply, get_info, ErrorLogger{"Failed to get property size"});
+        if (!info)
+        {
+            return false;
+        }
+        auto [type, size] = *info;
+        progress[i] = {size, type == incr_atom_, true};
+    }
+
+    // deleting INCR properties starts the transfers, all of them go on at once
+    cookies.clear();
+    for (std::size_t i = 0; i < properties.size(); ++i)
+    {
+        if (progress[i].is_incremental)
+        {
+            cookies.push_back(xcb_get_property(connection_.get(), 1, window_, properties[i], incr_atom_, 0, 1));
+        }
+    }
+    auto read_hint = [](xcb_get_property_reply_t* r)
+    {
+        std::uint32_t size_hint = 0;
+        if (xcb_get_property_value_length(r) == sizeof(size_hint))
+        {
+            std::memcpy(&size_hint, xcb_get_property_value(r), sizeof(size_hint));
+        }
+        return size_hint;
+    };
+    for (std::size_t i = 0, cookie = 0; i < properties.size(); ++i)
+    {
+        if (progress[i].is_incremental)
+        {
+            progress[i].size = Await(
+                cookies[cookie++],
+                xcb_get_property_reply,
+                read_hint,
+                ErrorLogger{"Failed to get property value"}).value_or(0);
+        }
+    }
+
+    // reading deletes the property to let the owner know it can send the next chunk, returns chunk's size;
+    // type and format of incrementally transferred data are known only from its first chunk
+    auto read_chunk = [&](std::size_t i) -> std::optional<std::size_t>
+    {
+        // the whole property is read, reply size is limited only by its 32-bit length in 4-byte units
+        auto cookie = xcb_get_property(
+            connection_.get(), 1, window_, properties[i], XCB_ATOM_ANY, 0,
+            std::numeric_limits<std::uint32_t>::max() / 4);
+        auto consume = [&](xcb_get_property_reply_t* r)
+        {
+            std::string_view chunk{
+                static_cast<const char*>(xcb_get_property_value(r)),
+                static_cast<std::size_t>(xcb_get_property_value_length(r))};
+            auto& [size, is_incremental, is_first] = progress[i];
+            if (std::exchange(is_first, false) && !on_size(i, r->type, r->format, size, is_incremental))
+            {
+                return std::pair{chunk.size(), false};
+            }
+            return std::pair{chunk.size(), chunk.empty() || on_chunk(i, chunk)};
+        };
+        auto res = Await(cookie, xcb_get_property_reply, consume, ErrorLogger{"Failed to get property value"});
+        if (!res || !res->second)
+        {
+            return {};
+        }
+        return res->first;
+    };
+
+    std::size_t incremental_count = 0;
+    for (std::size_t i = 0; i < properties.size(); ++i)
+    {
+        if (progress[i].is_incremental)
+        {
+            ++incremental_count;
+        }
+        else if (!read_chunk(i))
+        {
+            return false;
+        }
+    }
+
+    while (incremental_count != 0)
+    {
+        auto notify = WaitForEvent([this, properties](xcb_generic_event_t* event)
+        {
+            auto notify = reinterpret_cast<xcb_property_notify_event_t*>(event);
+            return
+                (event->response_type & ~0x80) == XCB_PROPERTY_NOTIFY &&
+                notify->window == window_ &&
+                notify->state == XCB_PROPERTY_NEW_VALUE &&
+                std::ranges::find(properties, notify->atom) != properties.end();
+        });
+        if (notify == nullptr)
+        {
+            return false;
+        }
+        auto atom = reinterpret_cast<xcb_property_notify_event_t*>(notify.get())->atom;
+        std::size_t i = std::ranges::find(properties, atom) - properties.begin();
+        if (!progress[i].is_incremental)
+        {
+            continue;
+        }
+        auto chunk_size = read_chunk(i);
+        if (!chunk_size)
+        {
+            return false;
+        }
+        // 0-size chunk finishes transfer
+        if (*chunk_size == 0)
+        {
+            progress[i].is_incremental = false;
+            --incremental_count;
+        }
+    }
+    return true;
+}
+
+std::optional<std::vector<xcb_atom_t>> Client::GetTargets(xcb_atom_t selection)
+{
+    if (!RequestConversion(selection, targets_atom_, property_atom_))
+    {
+        return {};
+    }
+    std::vector<xcb_atom_t> targets;
+    auto accept_targets = [&targets](xcb_atom_t type, std::uint8_t, std::size_t size, bool)
+    {
+        targets.reserve(size / sizeof(xcb_atom_t));
+        return type == XCB_ATOM_ATOM;
+    };
+    auto append = [&targets](std::string_view chunk)
+    {
+        // chunks are sent in whole 32-bit items
+        std::size_t count = chunk.size() / sizeof(xcb_atom_t);
+        targets.resize(targets.size() + count);
+        std::memcpy(targets.data() + targets.size() - count, chunk.data(), count * sizeof(xcb_atom_t));
+        return true;
+    };
+    if (!ReceiveProperty(property_atom_, accept_targets, append))
+    {
+        return {};
+    }
+    return targets;
+}
+
+} // namespace xcpp
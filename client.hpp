@@ -0,0 +1,204 @@
+#pragma once
+
+#ifndef XCLIPP_CLIENT_HPP
+#define XCLIPP_CLIENT_HPP
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <source_location>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+#include "transport.hpp"
+#include "utils.hpp"
+
+namespace xcpp
+{
+
+// connection to X server with a window for selection exchange, shared by selection owner and requestor
+class Client
+{
+protected:
+    // connects through `transport` or to `display` ($DISPLAY if empty) if it's null, and interns `atom_names`
+    // (must outlive the object) into atoms_, failed ones are logged and left out
+    explicit Client(
+        std::span<const std::string_view> atom_names = {},
+        const std::string& display = {},
+        const Transport* transport = nullptr);
+
+    template <class Reply, class Cookie, std::invocable<Reply*> Callback>
+    auto Await(
+        Cookie cookie,
+        Reply*(*reply_getter)(xcb_connection_t*, Cookie, xcb_generic_error_t**),
+        Callback&& callback,
+        std::string_view msg = {},
+        std::source_location loc = std::source_location::current()) ->
+            std::remove_reference_t<std::invoke_result_t<Callback, Reply*>>;
+
+    template <class Reply, class Cookie, std::invocable<Reply*> Callback, std::invocable<xcb_generic_error_t*> Handler>
+    auto Await(
+        Cookie cookie,
+        Reply*(*reply_getter)(xcb_connection_t*, Cookie, xcb_generic_error_t**),
+        Callback&& callback,
+        Handler&& handler) ->
+            std::conditional_t<
+                std::is_same_v<void, std::invoke_result_t<Callback, Reply*>>,
+                void,
+                std::optional<std::remove_reference_t<std::invoke_result_t<Callback, Reply*>>>
+            >;
+
+    void Await(
+        xcb_void_cookie_t cookie,
+        std::string_view msg = {},
+        std::source_location loc = std::source_location::current());
+
+    template <std::invocable<xcb_generic_error_t*> Handler>
+    bool Await(xcb_void_cookie_t cookie, Handler&& handler);
+
+    // waits up to receive_timeout_ms for an awaited event, other events are dropped
+    std::unique_ptr<xcb_generic_event_t, decltype(&std::free)> WaitForEvent(
+        const std::function<bool(xcb_generic_event_t*)>& is_awaited);
+
+    // asks selection owner to convert `selection` to `target` into `property` of window_,
+    // returns false if conversion was refused or timed out
+    bool RequestConversion(xcb_atom_t selection, xcb_atom_t target, xcb_atom_t property);
+
+    // reads converted data from `property` of window_ in one shot or with INCR, `on_size` gets type, format, size
+    // (lower bound for INCR) and whether INCR is used before data is passed to `on_chunk`,
+    // returning false from either stops receiving
+    bool ReceiveProperty(
+        xcb_atom_t property,
+        const std::function<bool(xcb_atom_t, std::uint8_t, std::size_t, bool)>& on_size,
+        const std::function<bool(std::string_view)>& on_chunk);
+
+    // receives several properties at once, as after MULTIPLE conversion, their INCR transfers go on concurrently,
+    // callbacks get index of the property in addition to ReceiveProperty() arguments
+    bool ReceiveProperties(
+        std::span<const xcb_atom_t> properties,
+        const std::function<bool(std::size_t, xcb_atom_t, std::uint8_t, std::size_t, bool)>& on_size,
+        const std::function<bool(std::size_t, std::string_view)>& on_chunk);
+
+    // targets offered by the owner of `selection`, nullopt if there is no owner or it failed to answer
+    std::optional<std::vector<xcb_atom_t>> GetTargets(xcb_atom_t selection);
+
+    // how long to wait for each step of conversion when acting as a requestor
+    inline static constexpr int receive_timeout_ms = 5000;
+
+    Connection connection_;
+    xcb_window_t window_;
+    // server time of connection, used as ownership and conversion request time
+    xcb_timestamp_t timestamp_;
+    xcb_atom_t clipboard_atom_;
+    xcb_atom_t atom_pair_atom_;
+    xcb_atom_t incr_atom_;
+    xcb_atom_t targets_atom_;
+    // property of window_ receiving converted data
+    xcb_atom_t property_atom_;
+    std::unordered_map<std::string_view, xcb_atom_t> atoms_;
+};
+
+template <class Reply, class Cookie, std::invocable<Reply*> Callback>
+auto Client::Await(
+    Cookie cookie,
+    Reply*(*reply_getter)(xcb_connection_t*, Cookie, xcb_generic_error_t**),
+    Callback&& callback,
+    std::string_view err_msg,
+    std::source_location loc) -> std::remove_reference_t<std::invoke_result_t<Callback, Reply*>>
+{
+    xcb_generic_error_t* err = nullptr;
+    Reply* reply = reply_getter(connection_.get(), cookie, &err);
+    if (err != nullptr)
+    {
+        using namespace std::literals;
+        auto err_code = err->error_code;
+        std::free(err);
+        std::string_view file_name = loc.file_name();
+        file_name.remove_prefix(file_name.rfind('/') + 1);
+        std::string what =
+            err_msg.empty() ?
+            std::format("{}:{}: {}", file_name, loc.line(), error_string(err_code)) :
+            std::format("{}:{}: {}: {}", file_name, loc.line(), error_string(err_code), err_msg);
+        throw std::runtime_error(std::move(what));
+    }
+    if constexpr (std::is_same_v<void, std::invoke_result_t<Callback, Reply*>>)
+    {
+        std::invoke(std::forward<Callback>(callback), reply);
+        std::free(reply);
+    }
+    else
+    {
+        auto res = std::invoke(std::forward<Callback>(callback), reply);
+        std::free(reply);
+        return res;
+    }
+}
+
+template <class Reply, class Cookie, std::invocable<Reply*> Callback, std::invocable<xcb_generic_error_t*> Handler>
+auto Client::Await(
+    Cookie cookie,
+    Reply*(*reply_getter)(xcb_connection_t*, Cookie, xcb_generic_error_t**),
+    Callback&& callback,
+    Handler&& handler) ->
+        std::conditional_t<
+            std::is_same_v<void, std::invoke_result_t<Callback, Reply*>>,
+            void,
+            std::optional<std::remove_reference_t<std::invoke_result_t<Callback, Reply*>>>
+        >
+{
+    xcb_generic_error_t* err = nullptr;
+    Reply* reply = reply_getter(connection_.get(), cookie, &err);
+    if (err != nullptr)
+    {
+        std::invoke(std::forward<Handler>(handler), err);
+        std::free(err);
+        if constexpr (std::is_same_v<void, std::invoke_result_t<Callback, Reply*>>) {
+            return;
+        }
+        else
+        {
+            return {};
+        }
+    }
+    if constexpr (std::is_same_v<void, std::invoke_result_t<Callback, Reply*>>)
+    {
+        std::invoke(std::forward<Callback>(callback), reply);
+        std::free(reply);
+    }
+    else
+    {
+        auto res = std::invoke(std::forward<Callback>(callback), reply);
+        std::free(reply);
+        return res;
+    }
+}
+
+template <std::invocable<xcb_generic_error_t*> Handler>
+bool Client::Await(xcb_void_cookie_t cookie, Handler&& handler)
+{
+    if (xcb_generic_error_t* err = xcb_request_check(connection_.get(), cookie))
+    {
+        std::invoke(std::forward<Handler>(handler), err);
+        std::free(err);
+        return false;
+    }
+    return true;
+}
+
+} // namespace xcpp
+
+#endif // XCLIPP_CLIENT_HPP
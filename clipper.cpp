@@ -1,7 +1,11 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <concepts>
 #include <cstddef>
+#include <cerrno>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <deque>
@@ -9,155 +13,242 @@
 #include <functional>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <source_location>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <variant>
+#include <vector>
 
-#include <xcb/bigreq.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
 #include <xcb/xcb.h>
 #include <xcb/xproto.h>
 
+#include "client.hpp"
 #include "clipper.hpp"
+#include "digest.hpp"
+#include "forwarder.hpp"
+#include "memfd_channel.hpp"
+#include "memory.hpp"
+#include "metrics.hpp"
+#include "predictor.hpp"
+#include "probes.hpp"
+#include "rate_limiter.hpp"
+#include "reader.hpp"
+#include "recorder.hpp"
+#include "transport.hpp"
 #include "utils.hpp"
 
 namespace xcpp
 {
 
-Clipper::Clipper(std::string_view data, bool is_file) :
-    data_{data},
-    connection_{nullptr, xcb_disconnect}
+// Await() for requests sent through `connection`, which may be a transfer worker's one
+template <std::invocable<xcb_generic_error_t*> Handler>
+static bool check(xcb_connection_t* connection, xcb_void_cookie_t cookie, Handler&& handler)
 {
-    int screen_id = 0;
-    connection_.reset(xcb_connect(nullptr, &screen_id));
-
-    if (int err = xcb_connection_has_error(connection_.get()))
+    if (xcb_generic_error_t* err = xcb_request_check(connection, cookie))
     {
-        throw std::runtime_error("Failed to connect to X server, XCB_CONN_* error code " + std::to_string(err));
+        std::invoke(std::forward<Handler>(handler), err);
+        std::free(err);
+        return false;
     }
+    return true;
+}
 
-    xcb_prefetch_extension_data(connection_.get(), &xcb_big_requests_id);
-    xcb_prefetch_maximum_request_length(connection_.get());
+// stops property change and destruction events of `requestor` once no INCR transfers to it go through `connection`
+static xcb_void_cookie_t unsubscribe(xcb_connection_t* connection, xcb_window_t requestor)
+{
+    xcb_event_mask_t event_mask = XCB_EVENT_MASK_NO_EVENT;
+    return xcb_change_window_attributes_checked(connection, requestor, XCB_CW_EVENT_MASK, &event_mask);
+}
 
-    xcb_screen_t *screen = nullptr;
-    for (auto it = xcb_setup_roots_iterator(xcb_get_setup(connection_.get())); it.rem > 0; xcb_screen_next(&it))
+// resets eventfds found readable by poll, returns whether there were any
+static bool drain(std::span<const pollfd> fds) noexcept
+{
+    bool is_readable = false;
+    for (auto& fd : fds)
     {
-        if (screen_id == 0)
+        if (fd.revents & POLLIN)
         {
-            screen = it.data;
-            break;
+            std::uint64_t count = 0;
+            [[maybe_unused]] auto size = read(fd.fd, &count, sizeof(count));
+            is_readable = true;
         }
-        --screen_id;
     }
-    if (screen == nullptr)
+    return is_readable;
+}
+
+Clipper::Clipper(std::string_view data, const ClipperOptions& options) :
+    Client{TargetNames(options), {}, options.transport},
+    data_{data},
+    text_encoding_{TextEncoding::UNKNOWN},
+    input_encoding_{TextEncoding::UNKNOWN}
+{
+    if (is_icccm_utf8_string(data_))
+    {
+        text_encoding_ = is_ascii(data_) ? TextEncoding::ASCII : TextEncoding::UTF8;
+    }
+    else if (is_icccm_string(data_))
     {
-        throw std::runtime_error("Failed to get default screen");
+        text_encoding_ = TextEncoding::LATIN1;
     }
 
-    // create window
-    owner_ = xcb_generate_id(connection_.get());
-    xcb_event_mask_t event_mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
-    auto window_cookie = xcb_create_window_checked(
-        connection_.get(),
-        0,
-        owner_,
-        screen->root,
-        0, 0, 1, 1, 0,
-        XCB_WINDOW_CLASS_INPUT_ONLY,
-        XCB_COPY_FROM_PARENT,
-        XCB_CW_EVENT_MASK, &event_mask);
-
-    // get required and supported atoms
-    std::unordered_map<std::string_view, xcb_intern_atom_cookie_t> target_cookies;
-    for (auto t : required_targets)
+    // text with other whitespace controls, e.g. \r\n line ends, isn't served as is, but is still transcoded
+    // from the encoding it's in
+    if (text_encoding_ != TextEncoding::UNKNOWN)
     {
-        target_cookies[t] = xcb_intern_atom(connection_.get(), 0, t.size(), t.data());
+        input_encoding_ = text_encoding_;
     }
-    for (auto t : text_targets)
+    else if (is_text_utf8(data_))
     {
-        if (auto f = text_validators.find(t); f == text_validators.end() || f->second(data))
-        {
-            target_cookies[t] = xcb_intern_atom(connection_.get(), 0, t.size(), t.data());
-        }
+        input_encoding_ = is_ascii(data_) ? TextEncoding::ASCII : TextEncoding::UTF8;
     }
-    if (is_file)
+    else if (is_text_latin1(data_))
     {
-        for (auto t : file_targets)
+        input_encoding_ = TextEncoding::LATIN1;
+    }
+
+    for (auto t : required_targets)
+    {
+        if (!atoms_.contains(t))
         {
-            target_cookies[t] = xcb_intern_atom(connection_.get(), 0, t.size(), t.data());
+            throw std::runtime_error(std::format("Failed to get {} atom", t));
         }
     }
-    xcb_intern_atom_cookie_t clipboard_cookie = xcb_intern_atom(connection_.get(), 0, 9, "CLIPBOARD");
-    xcb_intern_atom_cookie_t atom_pair_cookie = xcb_intern_atom(connection_.get(), 0, 9, "ATOM_PAIR");
-    xcb_intern_atom_cookie_t incr_cookie = xcb_intern_atom(connection_.get(), 0, 4, "INCR");
 
-    // trigger event to get timestamp for selection acquiring
-    auto time_cookie = xcb_change_property_checked(
-        connection_.get(), XCB_PROP_MODE_REPLACE, owner_, XCB_ATOM_PRIMARY, XCB_ATOM_PRIMARY, 8, 0, nullptr);
+    // ownership is taken as soon as the source's targets are known, its data is read only on requests
+    if (options.source)
+    {
+        source_ = options.source;
+        InternForwardedTargets(*source_);
+    }
+
+    if (options.skip_same_content && HasSameContent(atoms_, options.is_file))
+    {
+        return; // ownership is left untouched, Run() returns immediately
+    }
 
-    xcb_flush(connection_.get());
+    if (!options.record_path.empty())
+    {
+        recorder_.emplace(options.record_path, connection_.get(), data_.size());
+    }
+    if (!options.trace_path.empty())
+    {
+        tracer_.emplace(options.trace_path, connection_.get());
+    }
 
-    Await(window_cookie, "Failed to create window");
+    auto set_owner_cookie =
+        xcb_set_selection_owner_checked(connection_.get(), window_, clipboard_atom_, timestamp_);
+    Await(set_owner_cookie, "Failed to acquire CLIPBOARD selection");
 
-    std::unordered_map<std::string_view, xcb_atom_t> targets;
-    for (auto t : required_targets)
+    // taking half of max request size (it's in 4-byte words)
+    max_transfer_size_ = 2 * xcb_get_maximum_request_length(connection_.get());
+
+    if (options.memfd_channel)
     {
-        targets[t] = Await(
-            target_cookies[t], xcb_intern_atom_reply, &xcb_intern_atom_reply_t::atom,
-            std::format("Failed to get {} atom", t));
+        memfd_server_.emplace(memory_.memfds);
     }
-    for (auto& [t, cookie] : target_cookies)
+
+    RegisterHandlers(atoms_);
+    for (auto [name, atom] : atoms_)
     {
-        if (targets.contains(t))
+        if (handlers_.contains(atom))
         {
-            continue;
+            metrics_.AddTarget(atom, name);
         }
-        auto atom = Await(
-            cookie, xcb_intern_atom_reply, &xcb_intern_atom_reply_t::atom,
-            ErrorLogger{std::format("Failed to get {} atom", t)});
-        if (atom)
+        if (tracer_)
         {
-            targets[t] = *atom;
+            tracer_->AddTarget(atom, name);
         }
     }
-    clipboard_atom_ = Await(
-        clipboard_cookie, xcb_intern_atom_reply, &xcb_intern_atom_reply_t::atom, "Failed to get CLIPBOARD atom");
-    atom_pair_atom_ = Await(
-        atom_pair_cookie, xcb_intern_atom_reply, &xcb_intern_atom_reply_t::atom, "Failed to get ATOM_PAIR atom");
-    incr_atom_ = Await(incr_cookie, xcb_intern_atom_reply, &xcb_intern_atom_reply_t::atom, "Failed to get INCR atom");
-
-    Await(time_cookie, "Failed to get server timestamp by dummy property change");
-    xcb_generic_event_t* time_event = nullptr;
-    while ((time_event = xcb_wait_for_event(connection_.get())))
+    if (!options.metrics_socket.empty())
+    {
+        metrics_server_.emplace(options.metrics_socket);
+    }
+    progress_fd_ = options.progress_fd;
+    memory_budget_ = options.memory_budget;
+    resource_id_mask_ = xcb_get_setup(connection_.get())->resource_id_mask;
+    // forwarded targets are converted by the source, so there is nothing to prefetch
+    if (!options.prefetch_path.empty() && !prefetchers_.empty())
+    {
+        predictor_.emplace(options.prefetch_path, atoms_);
+    }
+    if (options.rate_limit > 0)
+    {
+        requestor_limiter_.emplace(options.rate_limit, options.rate_limit);
+        client_limiter_.emplace(options.rate_limit, options.rate_limit);
+    }
+    if (options.metrics_dump_signal != 0)
     {
-        if (time_event->response_type == XCB_PROPERTY_NOTIFY &&
-            reinterpret_cast<xcb_property_notify_event_t*>(time_event)->window == owner_)
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, options.metrics_dump_signal);
+        metrics_signal_fd_.Reset(signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC));
+        if (!metrics_signal_fd_)
         {
-            break;
+            throw std::system_error(errno, std::generic_category(), "Failed to create signalfd");
         }
-        std::free(time_event);
     }
-    if (time_event == nullptr)
+    if (options.transfer_threads != 0)
     {
-        throw std::runtime_error("Failed to get server timestamp by dummy property change, I/O error");
+        transfer_end_fd_.Reset(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+        if (!transfer_end_fd_)
+        {
+            throw std::system_error(errno, std::generic_category(), "Failed to create eventfd");
+        }
     }
-    ownership_timestamp_ = reinterpret_cast<xcb_property_notify_event_t*>(time_event)->time;
-    std::free(time_event);
-
-    auto set_owner_cookie =
-        xcb_set_selection_owner_checked(connection_.get(), owner_, clipboard_atom_, ownership_timestamp_);
-    Await(set_owner_cookie, "Failed to acquire CLIPBOARD selection");
-
-    // taking half of max request size (it's in 4-byte words)
-    max_transfer_size_ = 2 * xcb_get_maximum_request_length(connection_.get());
+    for (unsigned i = 0; i < options.transfer_threads; ++i)
+    {
+        workers_.push_back(std::make_unique<TransferWorker>(*this, options.transport));
+    }
+}
 
-    RegisterHandlers(targets);
+std::vector<std::string_view> Clipper::TargetNames(const ClipperOptions& options)
+{
+    std::vector<std::string_view> names;
+    for (auto t : required_targets)
+    {
+        names.push_back(t);
+    }
+    if (options.source)
+    {
+        return names;
+    }
+    for (auto t : text_targets)
+    {
+        names.push_back(t);
+    }
+    for (auto t : utf16_targets)
+    {
+        names.push_back(t);
+    }
+    names.push_back(digest_target);
+    if (options.memfd_channel)
+    {
+        names.push_back(memfd_socket_target);
+    }
+    if (options.is_file)
+    {
+        for (auto t : file_targets)
+        {
+            names.push_back(t);
+        }
+    }
+    return names;
 }
 
 void Clipper::Run()
@@ -166,28 +257,59 @@ void Clipper::Run()
     auto curr_owner = Await(
         get_owner_cookie, xcb_get_selection_owner_reply, &xcb_get_selection_owner_reply_t::owner,
         "Failed to get owner of CLIPBOARD selection");
-    if (owner_ != curr_owner)
+    if (window_ != curr_owner)
     {
         return; // outraced by another client or lost ownership in a standard way
     }
 
     xcb_generic_event_t* event = nullptr;
     bool own = true;
-    while ((own || !req_queues_.empty()) && (event = xcb_wait_for_event(connection_.get())))
+    while ((own || !req_queues_.empty() || !transfers_.empty()) && (event = NextEvent()))
     {
+        XCLIPP_PROBE(event, event->response_type & ~0x80);
         switch (event->response_type & ~0x80)
         {
             // conversion request
             case XCB_SELECTION_REQUEST:
             {
                 auto req = reinterpret_cast<xcb_selection_request_event_t*>(event);
-                req_queues_[req->requestor].emplace_back(req, true);
+                if (recorder_)
+                {
+                    recorder_->RecordRequest(*req);
+                }
+                // flooding requestor is answered right away, so its requests never pile up in queues
+                if (requestor_limiter_ && !IsWithinRateLimit(*req))
+                {
+                    XCLIPP_PROBE(request__throttled, req->requestor, req->target, req->property);
+                    // counted as refused requests as well, so totals stay consistent
+                    auto& target_metrics = metrics_.Get(req->target);
+                    target_metrics.requests.Add();
+                    target_metrics.refused.Add();
+                    target_metrics.throttled.Add();
+                    if (tracer_)
+                    {
+                        tracer_->Instant("throttled", req->requestor, req->target);
+                    }
+                    RefuseUnchecked(*req);
+                    std::free(event);
+                    break;
+                }
+                if (tracer_)
+                {
+                    tracer_->Instant("enqueue", req->requestor, req->target);
+                }
+                req_queues_[req->requestor].emplace_back(req).charge =
+                    MemoryCharge{memory_.requests, sizeof(Request) + sizeof(*req)};
                 break;
             }
             // another client now owns the clipboard
             case XCB_SELECTION_CLEAR:
             {
                 own = false;
+                if (memfd_server_)
+                {
+                    memfd_server_->Clear();
+                }
                 std::free(event);
                 break;
             }
@@ -195,22 +317,35 @@ void Clipper::Run()
             case XCB_PROPERTY_NOTIFY:
             {
                 auto notify = reinterpret_cast<xcb_property_notify_event_t*>(event);
-                auto req = req_queues_.find(notify->window);
-                if (notify->state == XCB_PROPERTY_DELETE &&
-                    req != req_queues_.end() &&
-                    !req->second.empty() &&
-                    req->second.front().req->property == notify->atom)
+                if (recorder_ && notify->state == XCB_PROPERTY_DELETE)
+                {
+                    recorder_->RecordPropertyDelete(notify->window, notify->atom);
+                }
+                if (ContinueTransfer(connection_.get(), transfers_, *notify))
                 {
-                    req->second.front().is_ready = true;
+                    ReleaseRequestor(notify->window);
                 }
                 std::free(event);
                 break;
             }
-            // connection broken
+            // requestor has gone away in the middle of INCR transfer, it will never delete the property
+            case XCB_DESTROY_NOTIFY:
+            {
+                auto notify = reinterpret_cast<xcb_destroy_notify_event_t*>(event);
+                if (recorder_)
+                {
+                    recorder_->RecordDestroy(notify->window);
+                }
+                std::erase_if(transfers_, [notify](auto& t) { return t.first.first == notify->window; });
+                std::free(event);
+                break;
+            }
+            // error of unchecked request, e.g. to a window destroyed meanwhile, the request is just dropped
             case 0:
             {
+                ErrorLogger<LogLevel::WARNING>{"Request failed"}(reinterpret_cast<xcb_generic_error_t*>(event));
                 std::free(event);
-                return;
+                break;
             }
             default:
             {
@@ -219,268 +354,1010 @@ void Clipper::Run()
             }
         }
 
-        for (auto& [w, q] : req_queues_)
+        ProcessRequests();
+    }
+}
+
+void Clipper::ProcessRequests()
+{
+    // requests don't wait for INCR transfers, each one either finishes, puts its subrequests in front
+    // or is deferred by the memory budget holding the rest of the queue
+    for (auto& [w, q] : req_queues_)
+    {
+        while (!q.empty())
+        {
+            StartRequestProcessing(q.front().req);
+            if (!q.empty() && q.front().is_deferred)
+            {
+                break;
+            }
+        }
+    }
+
+    std::erase_if(req_queues_, [](auto& q) { return q.second.empty(); });
+    queued_requests_count_.store(req_queues_.size(), std::memory_order_relaxed);
+    transfers_count_.store(TransferCount(), std::memory_order_relaxed);
+}
+
+ClipperStats Clipper::Stats() const noexcept
+{
+    return {
+        queued_requests_count_.load(std::memory_order_relaxed),
+        transfers_count_.load(std::memory_order_relaxed)};
+}
+
+xcb_generic_event_t* Clipper::NextEvent()
+{
+    while (true)
+    {
+        // checked before events too, as they may keep coming without a wait during fast transfers
+        int timeout = ReportProgress(transfers_, next_progress_);
+        if (xcb_generic_event_t* event = xcb_poll_for_event(connection_.get()))
+        {
+            return event;
+        }
+        if (xcb_connection_has_error(connection_.get()))
+        {
+            return nullptr;
+        }
+        xcb_flush(connection_.get());
+
+        // replies are flushed, so speculative work overlaps requestors handling them, a prefetch at a time
+        if (!prefetch_queue_.empty())
+        {
+            Prefetch(prefetch_queue_.front());
+            prefetch_queue_.pop_front();
+            continue;
+        }
+
+        // negative descriptors are ignored by poll
+        std::vector<pollfd> fds =
+        {
+            {xcb_get_file_descriptor(connection_.get()), POLLIN, 0},
+            {memfd_server_ ? memfd_server_->Fd() : -1, POLLIN, 0},
+            {metrics_server_ ? metrics_server_->Fd() : -1, POLLIN, 0},
+            {metrics_signal_fd_.Get(), POLLIN, 0},
+            {transfer_end_fd_.Get(), POLLIN, 0}
+        };
+        // forwarded data is awaited here rather than by converters, so other requestors aren't held
+        std::size_t fixed_fds = fds.size();
+        for (auto& [key, transfer] : transfers_)
+        {
+            if (transfer.is_stalled)
+            {
+                fds.push_back({transfer.Fd(), POLLIN, 0});
+            }
+        }
+        for (auto& [key, pending] : pending_forwards_)
+        {
+            fds.push_back({pending.second->Fd(), POLLIN, 0});
+        }
+        if (poll(fds.data(), fds.size(), timeout) == -1 && errno != EINTR)
         {
-            if (q.front().is_ready)
+            return nullptr;
+        }
+        if (drain(std::span{fds}.subspan(fixed_fds)))
+        {
+            for (auto& key : ResumeTransfers(connection_.get(), transfers_))
             {
-                StartRequestProcessing(q.front().req);
+                ReleaseRequestor(key.first);
             }
+            ProcessRequests();
+        }
+        // transfers ended by workers free memory budget, so requests deferred by it are retried
+        std::uint64_t ended_transfers = 0;
+        if ((fds[4].revents & POLLIN) &&
+            read(transfer_end_fd_.Get(), &ended_transfers, sizeof(ended_transfers)) == sizeof(ended_transfers))
+        {
+            ProcessRequests();
+        }
+        if (fds[1].revents & POLLIN)
+        {
+            memfd_server_->Serve([this](std::uint32_t target) { return MakeMemfdConverter(target); });
+        }
+        if (fds[2].revents & POLLIN)
+        {
+            metrics_server_->Serve([this] { return FormatMetrics(); });
+        }
+        signalfd_siginfo info;
+        if ((fds[3].revents & POLLIN) && read(metrics_signal_fd_.Get(), &info, sizeof(info)) == sizeof(info))
+        {
+            std::string text = FormatMetrics();
+            std::fwrite(text.data(), 1, text.size(), stderr);
+        }
+    }
+}
+
+std::string Clipper::FormatMetrics() const
+{
+    std::string gauges = std::format(
+        "# TYPE xclipp_queued_requestors gauge\n"
+        "# HELP xclipp_queued_requestors Requestors with requests waiting to be processed.\n"
+        "xclipp_queued_requestors {}\n"
+        "# TYPE xclipp_transfers gauge\n"
+        "# HELP xclipp_transfers Transfers in progress.\n"
+        "xclipp_transfers {}\n",
+        req_queues_.size(), TransferCount());
+    if (requestor_limiter_)
+    {
+        gauges += std::format(
+            "# TYPE xclipp_throttled counter\n"
+            "# HELP xclipp_throttled Times requestor windows and clients have exceeded the rate limit.\n"
+            "xclipp_throttled_total{{by=\"requestor\"}} {}\n"
+            "xclipp_throttled_total{{by=\"client\"}} {}\n",
+            requestor_limiter_->Exhausted(), client_limiter_->Exhausted());
+    }
+
+    std::size_t content_resident = resident_size(data_.data(), data_.size());
+    content_resident_peak_ = std::max(content_resident_peak_, content_resident);
+    std::pair<std::string_view, const MemoryAccount*> accounts[] =
+    {
+        {"cache", &memory_.cache},
+        {"transfers", &memory_.transfers},
+        {"requests", &memory_.requests},
+        {"memfds", &memory_.memfds}
+    };
+    for (bool is_peak : {false, true})
+    {
+        std::string_view name = is_peak ? "xclipp_memory_peak_bytes" : "xclipp_memory_bytes";
+        gauges += std::format(
+            "# TYPE {} gauge\n# UNIT {} bytes\n# HELP {} {} by area, content is the data mapped by the owner.\n",
+            name, name, name, is_peak ? "Peak memory use" : "Memory use");
+        gauges += std::format("{}{{area=\"content_mapped\"}} {}\n", name, data_.size());
+        gauges += std::format(
+            "{}{{area=\"content_resident\"}} {}\n", name, is_peak ? content_resident_peak_ : content_resident);
+        for (auto [area, account] : accounts)
+        {
+            gauges += std::format(
+                "{}{{area=\"{}\"}} {}\n", name, area, is_peak ? account->Peak() : account->Current());
+        }
+    }
+    return metrics_.Format(gauges);
+}
+
+int Clipper::ReportProgress(TransferMap& transfers, std::chrono::steady_clock::time_point& next_report)
+{
+    if (progress_fd_ == -1 || transfers.empty())
+    {
+        return -1;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now < next_report)
+    {
+        return std::chrono::ceil<std::chrono::milliseconds>(next_report - now).count();
+    }
+
+    std::string report;
+    for (auto& [key, transfer] : transfers)
+    {
+        // short transfers are left out
+        if (!transfer.is_incremental || now - transfer.started < progress_interval)
+        {
+            continue;
+        }
+        auto [type, format, size] = transfer.GetInfo();
+        std::string_view target = "unknown";
+        for (auto& [name, atom] : atoms_)
+        {
+            if (atom == transfer.req.target)
+            {
+                target = name;
+                break;
+            }
+        }
+        std::chrono::duration<double> elapsed = now - transfer.reported_at;
+        double rate = (transfer.tranferred - transfer.reported_bytes) / elapsed.count();
+        // size of streamed data may be only an upper bound
+        report += std::format(
+            "0x{:x} {}: {:.1f} MB of {}{:.1f} MB ({}%), {:.1f} MB/s",
+            key.first, target, transfer.tranferred / 1e6, transfer.IsSizeExact() ? "" : "~", size / 1e6,
+            size == 0 ? 100 : std::min<std::size_t>(100 * transfer.tranferred / size, 100), rate / 1e6);
+        if (rate > 0 && size > transfer.tranferred)
+        {
+            report += std::format(", ETA {:.0f} s\n", (size - transfer.tranferred) / rate);
+        }
+        else
+        {
+            report += rate > 0 ? "\n" : ", stalled\n";
+        }
+        transfer.reported_bytes = transfer.tranferred;
+        transfer.reported_at = now;
+    }
+    for (std::string_view rest = report; !rest.empty();)
+    {
+        ssize_t written = write(progress_fd_, rest.data(), rest.size());
+        if (written == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            break;
+        }
+        rest.remove_prefix(written);
+    }
+    next_report = now + progress_interval;
+    return std::chrono::ceil<std::chrono::milliseconds>(progress_interval).count();
+}
+
+std::unique_ptr<ChunkConverter> Clipper::MakeMemfdConverter(xcb_atom_t target)
+{
+    // memfd of the target is filled once on the memfd server's thread, the converter only reads data_
+    auto factory = converters_.find(target);
+    return factory == converters_.end() ? nullptr : factory->second.make();
+}
+
+void Clipper::InternForwardedTargets(const ReaderOptions& source)
+{
+    auto names = Reader{source}.ListTargets();
+    if (!names)
+    {
+        throw std::runtime_error("Failed to get targets of the source selection");
+    }
+    std::erase_if(*names, [](const std::string& name)
+    {
+        return std::ranges::find(not_forwarded_targets, name) != std::end(not_forwarded_targets);
+    });
+    forwarded_targets_ = std::move(*names);
+
+    std::vector<xcb_intern_atom_cookie_t> cookies;
+    for (auto& t : forwarded_targets_)
+    {
+        cookies.push_back(xcb_intern_atom(connection_.get(), 0, t.size(), t.data()));
+    }
+    for (std::size_t i = 0; i < cookies.size(); ++i)
+    {
+        auto atom = Await(
+            cookies[i], xcb_intern_atom_reply, &xcb_intern_atom_reply_t::atom,
+            ErrorLogger{std::format("Failed to get {} atom", forwarded_targets_[i])});
+        if (atom)
+        {
+            atoms_[forwarded_targets_[i]] = *atom;
+        }
+    }
+}
+
+bool Clipper::HasSameContent(std::unordered_map<std::string_view, xcb_atom_t>& targets, bool is_file)
+{
+    auto owner_targets = GetTargets(clipboard_atom_);
+    if (!owner_targets)
+    {
+        return false;
+    }
+    auto offers = [&owner_targets, &targets](std::string_view t)
+    {
+        return targets.contains(t) && std::ranges::find(*owner_targets, targets[t]) != owner_targets->end();
+    };
+
+    // the data is served either as a file name or as text, an owner serving the same text doesn't offer the file
+    if (is_file && !std::ranges::all_of(file_targets, offers))
+    {
+        return false;
+    }
+
+    // digest is enough if the owner can provide it
+    if (offers(digest_target))
+    {
+        if (!RequestConversion(clipboard_atom_, targets[digest_target], property_atom_))
+        {
+            return false;
+        }
+        Digest digest = content_digest(data_);
+        std::string owner_digest;
+        auto accept_digest = [&digest](xcb_atom_t, std::uint8_t, std::size_t size, bool)
+        {
+            return size == digest.size();
+        };
+        auto append_digest = [&owner_digest](std::string_view chunk) { owner_digest += chunk; return true; };
+        return
+            ReceiveProperty(property_atom_, accept_digest, append_digest) &&
+            std::ranges::equal(owner_digest, digest, {}, [](char c) { return static_cast<std::uint8_t>(c); });
+    }
+
+    // otherwise data is compared chunk by chunk in the encoding it's served as is
+    std::string_view compare_target = "C_STRING";
+    if (is_file)
+    {
+        compare_target = "FILE_NAME";
+    }
+    else if (text_encoding_ == TextEncoding::ASCII || text_encoding_ == TextEncoding::UTF8)
+    {
+        compare_target = "UTF8_STRING";
+    }
+    else if (text_encoding_ == TextEncoding::LATIN1)
+    {
+        compare_target = "STRING";
+    }
+    if (!offers(compare_target) || !RequestConversion(clipboard_atom_, targets[compare_target], property_atom_))
+    {
+        return false;
+    }
+    std::string_view rest = data_;
+    // INCR size is only a lower bound
+    auto check_size = [this](xcb_atom_t, std::uint8_t, std::size_t size, bool is_incremental)
+    {
+        return is_incremental ? size <= data_.size() : size == data_.size();
+    };
+    auto compare = [&rest](std::string_view chunk)
+    {
+        if (!rest.starts_with(chunk))
+        {
+            return false;
+        }
+        rest.remove_prefix(chunk.size());
+        return true;
+    };
+    return ReceiveProperty(property_atom_, check_size, compare) && rest.empty();
+}
+
+bool Clipper::SendFinishNotification(xcb_selection_request_event_t* req)
+{
+    xcb_selection_notify_event_t resp = {};
+    resp.response_type = XCB_SELECTION_NOTIFY;
+    resp.requestor = req->requestor;
+    resp.selection = req->selection;
+    resp.target = req->target;
+    resp.time = req->time;
+    resp.property = req->property;
+
+    auto send_cookie = xcb_send_event_checked(
+        connection_.get(), 1, req->requestor, XCB_EVENT_MASK_NO_EVENT, reinterpret_cast<char*>(&resp));
+
+    return Await(send_cookie, ErrorLogger{"Failed to send finish notification"});
+}
+
+bool Clipper::IsWithinRateLimit(const xcb_selection_request_event_t& req)
+{
+    auto now = RateLimiter::Clock::now();
+    // both buckets are charged, so a client can't evade its limit by spreading requests over windows
+    bool is_requestor_within = requestor_limiter_->Take(req.requestor, now);
+    bool is_client_within = client_limiter_->Take(req.requestor & ~resource_id_mask_, now);
+    return is_requestor_within && is_client_within;
+}
+
+void Clipper::RefuseUnchecked(const xcb_selection_request_event_t& req)
+{
+    xcb_selection_notify_event_t resp = {};
+    resp.response_type = XCB_SELECTION_NOTIFY;
+    resp.requestor = req.requestor;
+    resp.selection = req.selection;
+    resp.target = req.target;
+    resp.time = req.time;
+    resp.property = XCB_ATOM_NONE;
+    xcb_send_event(
+        connection_.get(), 1, req.requestor, XCB_EVENT_MASK_NO_EVENT, reinterpret_cast<const char*>(&resp));
+}
+
+void Clipper::Predict(const xcb_selection_request_event_t& req)
+{
+    auto client = req.requestor & ~resource_id_mask_;
+    if (req.target != targets_atom_)
+    {
+        if (predictor_->Observe(client, req.target))
+        {
+            metrics_.Get(req.target).prediction_hits.Add();
+        }
+        return;
+    }
+    // requestors often use hidden windows without WM_CLASS, such clients are learned on their own
+    for (auto target : predictor_->StartPaste(client, ApplicationName(req.requestor)))
+    {
+        metrics_.Get(target).predictions.Add();
+        if (prefetchers_.contains(target) && std::ranges::find(prefetch_queue_, target) == prefetch_queue_.end())
+        {
+            prefetch_queue_.push_back(target);
+        }
+    }
+}
+
+std::optional<std::string> Clipper::ApplicationName(xcb_window_t window)
+{
+    auto cookie = xcb_get_property(connection_.get(), 0, window, XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, 0, 64);
+    auto name = Await(
+        cookie,
+        xcb_get_property_reply,
+        [](xcb_get_property_reply_t* r)
+        {
+            // instance and class names, each null-terminated
+            std::string_view value{
+                static_cast<const char*>(xcb_get_property_value(r)),
+                static_cast<std::size_t>(xcb_get_property_value_length(r))};
+            auto instance = value.substr(0, value.find('\0'));
+            auto class_name = value.substr(std::min(instance.size() + 1, value.size()));
+            class_name = class_name.substr(0, class_name.find('\0'));
+            return std::string{class_name.empty() ? instance : class_name};
+        },
+        ErrorLogger<LogLevel::WARNING>{"Failed to get WM_CLASS of requestor"});
+    if (!name || name->empty())
+    {
+        return {};
+    }
+    return name;
+}
+
+void Clipper::Prefetch(xcb_atom_t target)
+{
+    auto start = std::chrono::steady_clock::now();
+    if (prefetchers_[target]())
+    {
+        XCLIPP_PROBE(prefetch, target);
+        metrics_.Get(target).prefetches.Add();
+        if (tracer_)
+        {
+            tracer_->Complete("prefetch", start, XCB_WINDOW_NONE, target);
+        }
+    }
+}
+
+void Clipper::FinishRequestProcessing(xcb_selection_request_event_t* req)
+{
+    TraceSpan span{tracer_, "finish processing", *req};
+    XCLIPP_PROBE(request__done, req->requestor, req->target, req->property);
+    auto requestor = req->requestor;
+    auto& target_metrics = metrics_.Get(req->target);
+    target_metrics.refused.Add(req->property == XCB_ATOM_NONE);
+    target_metrics.request_duration.Record(std::chrono::steady_clock::now() - req_queues_[requestor].front().received);
+    if (auto& on_finish = req_queues_[requestor].front().on_finish)
+    {
+        (*on_finish)(req);
+    }
+    else
+    {
+        SendFinishNotification(req);
+    }
+    if (tracer_)
+    {
+        tracer_->Async("request", req_queues_[requestor].front().received, requestor, req->target);
+    }
+    req_queues_[requestor].pop_front();
+}
+
+void Clipper::StartRequestProcessing(xcb_selection_request_event_t* req)
+{
+    // MULTIPLE comes back once its subrequests finish and deferred requests are retried,
+    // only the first pass is counted, traced and predicted
+    auto& request = req_queues_[req->requestor].front();
+    bool is_first_pass = !request.is_started;
+    request.is_started = true;
+    std::optional<TraceSpan> span;
+    if (is_first_pass)
+    {
+        span.emplace(tracer_, "start processing", *req);
+        XCLIPP_PROBE(request__start, req->requestor, req->target, req->property);
+        metrics_.Get(req->target).requests.Add();
+        if (predictor_)
+        {
+            Predict(*req);
+        }
+    }
+    if (req->owner != window_ ||
+        (req->time < timestamp_ && req->time != XCB_CURRENT_TIME) ||
+        req->selection != clipboard_atom_ ||
+        !handlers_.contains(req->target))
+    {
+        req->property = XCB_ATOM_NONE;
+        FinishRequestProcessing(req);
+    }
+    else
+    {
+        handlers_[req->target](req);
+    }
+}
+
+std::tuple<xcb_atom_t, std::uint8_t, std::size_t> Clipper::TransferState::GetInfo() const noexcept
+{
+    if (auto converted = std::get_if<ConvertedData>(&data))
+    {
+        auto& [type, format, ptr, size] = *converted;
+        return {type, format, size};
+    }
+    if (auto view = std::get_if<ConvertedDataView>(&data))
+    {
+        auto& [type, format, ptr, size] = *view;
+        return {type, format, size};
+    }
+    auto& streamed = std::get<StreamedData>(data);
+    return {streamed.type, streamed.converter->Format(), streamed.converter->Size()};
+}
+
+bool Clipper::TransferState::IsSizeExact() const noexcept
+{
+    auto streamed = std::get_if<StreamedData>(&data);
+    return streamed == nullptr || streamed->converter->IsSizeExact();
+}
+
+std::pair<const char*, std::size_t> Clipper::TransferState::GetChunk(std::size_t max_size)
+{
+    if (auto streamed = std::get_if<StreamedData>(&data))
+    {
+        // single buffer is reused for all chunks
+        std::size_t capacity = ChunkCapacity(max_size);
+        if (streamed->buf == nullptr)
+        {
+            streamed->buf.reset(new char[capacity]);
+            charge.Add(capacity);
+        }
+        return {streamed->buf.get(), streamed->converter->Convert(streamed->buf.get(), capacity)};
+    }
+
+    auto [type, format, size] = GetInfo();
+    const char* data_ptr = nullptr;
+    if (auto converted = std::get_if<ConvertedData>(&data))
+    {
+        data_ptr = std::get<2>(*converted).get();
+    }
+    else
+    {
+        data_ptr = std::get<2>(std::get<ConvertedDataView>(data));
+    }
+    std::size_t offset = tranferred == TRANSFER_PREINIT ? 0 : tranferred;
+    std::size_t chunk_size = std::min(max_size, size - offset);
+    chunk_size -= (8 * chunk_size) % format;
+    return {data_ptr + offset, chunk_size};
+}
+
+bool Clipper::TransferState::IsReady(std::size_t max_size) const noexcept
+{
+    auto streamed = std::get_if<StreamedData>(&data);
+    return streamed == nullptr || streamed->converter->IsReady(ChunkCapacity(max_size));
+}
+
+int Clipper::TransferState::Fd() const noexcept
+{
+    auto streamed = std::get_if<StreamedData>(&data);
+    return streamed == nullptr ? -1 : streamed->converter->Fd();
+}
+
+std::size_t Clipper::TransferState::ChunkCapacity(std::size_t max_size) const noexcept
+{
+    // chunks hold whole items of the format
+    auto& converter = *std::get<StreamedData>(data).converter;
+    std::size_t capacity = converter.IsSizeExact() ? std::min(max_size, converter.Size()) : max_size;
+    return capacity - capacity % (converter.Format() / 8);
+}
+
+bool Clipper::TransferState::NeedsIncr(std::size_t max_size) const noexcept
+{
+    return std::get<2>(GetInfo()) > max_size || !IsSizeExact();
+}
+
+std::size_t Clipper::TransferState::MemorySize() const noexcept
+{
+    auto converted = std::get_if<ConvertedData>(&data);
+    return sizeof(TransferState) + (converted == nullptr ? 0 : std::get<3>(*converted));
+}
+
+std::optional<bool> Clipper::Transfer(
+    xcb_connection_t* connection, TransferMap& transfers, xcb_selection_request_event_t* req)
+{
+    TraceSpan span{tracer_, "transfer", *req};
+    auto& transfer = transfers[{req->requestor, req->property}];
+    auto [type, format, size] = transfer.GetInfo();
+
+    // transfer has not been started yet
+    if (transfer.tranferred == TransferState::TRANSFER_PREINIT)
+    {
+        // can transfer in one shot
+        if (!transfer.NeedsIncr(max_transfer_size_))
+        {
+            XCLIPP_PROBE(chunk__start, req->requestor, req->property, size);
+            auto [data, chunk_size] = transfer.GetChunk(size);
+            auto change_prop_cookie = xcb_change_property_checked(
+                connection,
+                XCB_PROP_MODE_REPLACE,
+                req->requestor,
+                req->property,
+                type, format, 8 * chunk_size / format, data);
+            if (!check(connection, change_prop_cookie, ErrorLogger{"Failed to change property"}))
+            {
+                return {};
+            }
+            transfer.tranferred = chunk_size;
+            metrics_.Get(req->target).bytes.Add(chunk_size);
+            XCLIPP_PROBE(chunk__done, req->requestor, req->property, chunk_size);
+            return true;
+        }
+
+        // subscribe for notifications about requestor's properties and destruction of its window
+        std::uint32_t event_mask = XCB_EVENT_MASK_PROPERTY_CHANGE | XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+        auto subscribe_for_prop_cookie =
+            xcb_change_window_attributes_checked(connection, req->requestor, XCB_CW_EVENT_MASK, &event_mask);
+
+        std::uint32_t size_hint = std::min(size, static_cast<std::size_t>(std::numeric_limits<std::uint32_t>::max()));
+        // initiate multistage transfer with INCR
+        auto change_prop_cookie = xcb_change_property_checked(
+            connection, XCB_PROP_MODE_REPLACE, req->requestor, req->property, incr_atom_, 32, 1, &size_hint);
+        if (!check(connection, subscribe_for_prop_cookie, ErrorLogger{"Failed to subscribe for property changes"}) ||
+            !check(connection, change_prop_cookie, ErrorLogger{"Failed to change property"}))
+        {
+            return {};
+        }
+        transfer.tranferred = 0;
+        transfer.is_incremental = true;
+        XCLIPP_PROBE(incr__start, req->requestor, req->property, size);
+        if (tracer_)
+        {
+            transfer.chunk_sent = std::chrono::steady_clock::now();
+        }
+        return false;
+    }
+
+    // the next chunk is written once its data arrives, when the converter's descriptor is polled
+    transfer.is_stalled = !transfer.IsReady(max_transfer_size_);
+    if (transfer.is_stalled)
+    {
+        return false;
+    }
+
+    // transfer the next chunk of data
+    XCLIPP_PROBE(chunk__start, req->requestor, req->property, max_transfer_size_);
+    auto [data, chunk_size] = transfer.GetChunk(max_transfer_size_);
+    auto change_prop_cookie = xcb_change_property_checked(
+        connection,
+        XCB_PROP_MODE_REPLACE,
+        req->requestor,
+        req->property,
+        type, format, 8 * chunk_size / format, data);
+    if (!check(connection, change_prop_cookie, ErrorLogger{"Failed to change property"}))
+    {
+        return {};
+    }
+    transfer.tranferred += chunk_size;
+    auto& target_metrics = metrics_.Get(req->target);
+    target_metrics.bytes.Add(chunk_size);
+    target_metrics.incr_chunks.Add(chunk_size != 0);
+    XCLIPP_PROBE(chunk__done, req->requestor, req->property, chunk_size);
+
+    // more data yet to transfer (at least final 0-size transfer)
+    if (chunk_size != 0)
+    {
+        if (tracer_)
+        {
+            transfer.chunk_sent = std::chrono::steady_clock::now();
+        }
+        return false;
+    }
+
+    // the caller unsubscribes from the requestor once no other INCR transfers to it need notifications
+    return true;
+}
+
+bool Clipper::ContinueTransfer(
+    xcb_connection_t* connection, TransferMap& transfers, const xcb_property_notify_event_t& notify)
+{
+    auto transfer = transfers.find({notify.window, notify.atom});
+    if (notify.state != XCB_PROPERTY_DELETE || transfer == transfers.end() || !transfer->second.is_incremental)
+    {
+        return false;
+    }
+    if (tracer_)
+    {
+        auto& req = transfer->second.req;
+        tracer_->Async("wait for property delete", transfer->second.chunk_sent, req.requestor, req.target);
+    }
+    auto transfer_res = Transfer(connection, transfers, &transfer->second.req);
+    if (!transfer_res || *transfer_res) // transfer failed or finished
+    {
+        transfers.erase(transfer);
+        return true;
+    }
+    return false;
+}
+
+std::vector<Clipper::TransferKey> Clipper::ResumeTransfers(xcb_connection_t* connection, TransferMap& transfers)
+{
+    std::vector<TransferKey> ended;
+    for (auto it = transfers.begin(); it != transfers.end();)
+    {
+        if (!it->second.is_stalled || !it->second.IsReady(max_transfer_size_))
+        {
+            ++it;
+            continue;
+        }
+        auto transfer_res = Transfer(connection, transfers, &it->second.req);
+        if (!transfer_res || *transfer_res) // transfer failed or finished
+        {
+            ended.push_back(it->first);
+            it = transfers.erase(it);
+            continue;
         }
+        ++it;
+    }
+    return ended;
+}
 
-        std::erase_if(req_queues_, [](auto& q) { return q.second.empty(); });
+void Clipper::ReleaseRequestor(xcb_window_t requestor)
+{
+    auto is_other_transfer = [requestor](auto& t) { return t.first.first == requestor && t.second.is_incremental; };
+    if (std::ranges::none_of(transfers_, is_other_transfer))
+    {
+        Await(unsubscribe(connection_.get(), requestor), ErrorLogger{"Failed to unsubscribe from property changes"});
     }
 }
 
-template <class Reply, class Cookie, std::invocable<Reply*> Callback>
-auto Clipper::Await(
-    Cookie cookie,
-    Reply*(*reply_getter)(xcb_connection_t*, Cookie, xcb_generic_error_t**),
-    Callback&& callback,
-    std::string_view err_msg,
-    std::source_location loc) -> std::remove_reference_t<std::invoke_result_t<Callback, Reply*>>
+bool Clipper::IsHandedOver(const TransferKey& key) const
+{
+    return !workers_.empty() && WorkerOf(key.first).Contains(key);
+}
+
+std::size_t Clipper::TransferCount() const
 {
-    xcb_generic_error_t* err = nullptr;
-    Reply* reply = reply_getter(connection_.get(), cookie, &err);
-    if (err != nullptr)
+    std::size_t count = transfers_.size();
+    for (auto& worker : workers_)
     {
-        using namespace std::literals;
-        auto err_code = err->error_code;
-        std::free(err);
-        std::string_view file_name = loc.file_name();
-        file_name.remove_prefix(file_name.rfind('/') + 1);
-        std::string what =
-            err_msg.empty() ?
-            std::format("{}:{}: {}", file_name, loc.line(), error_string(err_code)) :
-            std::format("{}:{}: {}: {}", file_name, loc.line(), error_string(err_code), err_msg);
-        throw std::runtime_error(std::move(what));
+        count += worker->Count();
     }
-    if constexpr (std::is_same_v<void, std::invoke_result_t<Callback, Reply*>>)
+    return count;
+}
+
+Clipper::TransferWorker& Clipper::WorkerOf(xcb_window_t requestor) const noexcept
+{
+    // transfers to a requestor share a worker, which subscribes for the requestor's events once for all of them
+    return *workers_[requestor % workers_.size()];
+}
+
+Clipper::TransferWorker::TransferWorker(Clipper& owner, const Transport* transport) :
+    owner_{owner},
+    connection_{(transport != nullptr ? transport->Connect() : DisplayTransport{}.Connect()).first},
+    wake_fd_{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)}
+{
+    if (!wake_fd_)
     {
-        std::invoke(std::forward<Callback>(callback), reply);
-        std::free(reply);
+        throw std::system_error(errno, std::generic_category(), "Failed to create eventfd");
     }
-    else
+    // enables BIG-REQUESTS, so the connection takes chunks of the owner's size
+    xcb_get_maximum_request_length(connection_.get());
+    thread_ = std::thread{[this] { Run(); }};
+}
+
+Clipper::TransferWorker::~TransferWorker()
+{
     {
-        auto res = std::invoke(std::forward<Callback>(callback), reply);
-        std::free(reply);
-        return res;
+        std::lock_guard lock{mutex_};
+        is_stopping_ = true;
     }
+    Wake();
+    thread_.join();
 }
 
-template <class Reply, class Cookie, std::invocable<Reply*> Callback, std::invocable<xcb_generic_error_t*> Handler>
-auto Clipper::Await(
-    Cookie cookie,
-    Reply*(*reply_getter)(xcb_connection_t*, Cookie, xcb_generic_error_t**),
-    Callback&& callback,
-    Handler&& handler) ->
-        std::conditional_t<
-            std::is_same_v<void, std::invoke_result_t<Callback, Reply*>>,
-            void,
-            std::optional<std::remove_reference_t<std::invoke_result_t<Callback, Reply*>>>
-        >
+std::optional<bool> Clipper::TransferWorker::Start(TransferMap::node_type transfer)
 {
-    xcb_generic_error_t* err = nullptr;
-    Reply* reply = reply_getter(connection_.get(), cookie, &err);
-    if (err != nullptr)
+    TransferMap started;
+    auto it = started.insert(std::move(transfer)).position;
+    TransferKey key = it->first;
     {
-        std::invoke(std::forward<Handler>(handler), err);
-        std::free(err);
-        if constexpr (std::is_same_v<void, std::invoke_result_t<Callback, Reply*>>) {
-            return;
-        }
-        else
-        {
-            return {};
-        }
+        // known before subscribing, so transfers to the requestor ending meanwhile don't unsubscribe from it
+        std::lock_guard lock{mutex_};
+        keys_.insert(key);
     }
-    if constexpr (std::is_same_v<void, std::invoke_result_t<Callback, Reply*>>)
+    auto res = owner_.Transfer(connection_.get(), started, &it->second.req);
+    if (res && !*res)
     {
-        std::invoke(std::forward<Callback>(callback), reply);
-        std::free(reply);
+        std::lock_guard lock{mutex_};
+        handed_over_.push_back(started.extract(it));
     }
     else
     {
-        auto res = std::invoke(std::forward<Callback>(callback), reply);
-        std::free(reply);
-        return res;
+        End(key);
     }
+    // events read from the connection meanwhile wait in its queue
+    Wake();
+    return res;
 }
 
-void Clipper::Await(xcb_void_cookie_t cookie, std::string_view err_msg, std::source_location loc)
+void Clipper::TransferWorker::End(const TransferKey& key)
 {
-    if (xcb_generic_error_t* err = xcb_request_check(connection_.get(), cookie))
+    std::optional<xcb_void_cookie_t> unsubscribe_cookie;
     {
-        using namespace std::literals;
-        auto err_code = err->error_code;
-        std::free(err);
-        std::string_view file_name = loc.file_name();
-        file_name.remove_prefix(file_name.rfind('/') + 1);
-        std::string what =
-            err_msg.empty() ?
-            std::format("{}:{}: {}", file_name, loc.line(), error_string(err_code)) :
-            std::format("{}:{}: {}: {}", file_name, loc.line(), error_string(err_code), err_msg);
-        throw std::runtime_error(std::move(what));
+        std::lock_guard lock{mutex_};
+        keys_.erase(key);
+        // sent under the lock, so a transfer to the requestor being started subscribes after it
+        if (std::ranges::none_of(keys_, [&key](auto& k) { return k.first == key.first; }))
+        {
+            unsubscribe_cookie = unsubscribe(connection_.get(), key.first);
+        }
     }
-}
-
-template <std::invocable<xcb_generic_error_t*> Handler>
-bool Clipper::Await(xcb_void_cookie_t cookie, Handler&& handler)
-{
-    if (xcb_generic_error_t* err = xcb_request_check(connection_.get(), cookie))
+    if (unsubscribe_cookie)
     {
-        std::invoke(std::forward<Handler>(handler), err);
-        std::free(err);
-        return false;
+        check(connection_.get(), *unsubscribe_cookie, ErrorLogger{"Failed to unsubscribe from property changes"});
     }
-    return true;
+    owner_.NotifyTransferEnd();
 }
 
-bool Clipper::SendFinishNotification(xcb_selection_request_event_t* req)
+bool Clipper::TransferWorker::Contains(const TransferKey& key)
 {
-    xcb_selection_notify_event_t resp = {};
-    resp.response_type = XCB_SELECTION_NOTIFY;
-    resp.requestor = req->requestor;
-    resp.selection = req->selection;
-    resp.target = req->target;
-    resp.time = req->time;
-    resp.property = req->property;
+    std::lock_guard lock{mutex_};
+    return keys_.contains(key);
+}
 
-    auto send_cookie = xcb_send_event_checked(
-        connection_.get(), 1, req->requestor, XCB_EVENT_MASK_NO_EVENT, reinterpret_cast<char*>(&resp));
+std::size_t Clipper::TransferWorker::Count()
+{
+    std::lock_guard lock{mutex_};
+    return keys_.size();
+}
 
-    return Await(send_cookie, ErrorLogger{"Failed to send finish notification"});
+void Clipper::NotifyTransferEnd() noexcept
+{
+    std::uint64_t one = 1;
+    [[maybe_unused]] auto written = write(transfer_end_fd_.Get(), &one, sizeof(one));
 }
 
-void Clipper::FinishRequestProcessing(xcb_selection_request_event_t* req, bool send_notification)
+void Clipper::TransferWorker::Wake() noexcept
 {
-    auto requestor = req->requestor;
-    if (auto& on_finish = req_queues_[requestor].front().on_finish)
-    {
-        (*on_finish)(req);
-    }
-    else if (send_notification)
-    {
-        SendFinishNotification(req);
-    }
-    req_queues_[requestor].pop_front();
+    std::uint64_t one = 1;
+    [[maybe_unused]] auto written = write(wake_fd_.Get(), &one, sizeof(one));
 }
 
-void Clipper::StartRequestProcessing(xcb_selection_request_event_t* req)
+void Clipper::TransferWorker::Adopt()
 {
-    if (req->owner != owner_ ||
-        (req->time < ownership_timestamp_ && req->time != XCB_CURRENT_TIME) ||
-        req->selection != clipboard_atom_ ||
-        !handlers_.contains(req->target))
-    {
-        req->property = XCB_ATOM_NONE;
-        FinishRequestProcessing(req);
-    }
-    else
+    std::lock_guard lock{mutex_};
+    for (auto& transfer : handed_over_)
     {
-        handlers_[req->target](req);
+        transfers_.insert(std::move(transfer));
     }
+    handed_over_.clear();
 }
 
-std::optional<bool> Clipper::Transfer(xcb_selection_request_event_t* req)
+void Clipper::TransferWorker::Run()
 {
-    auto& transfer = transfers_[{req->requestor, req->property}];
-    ConvertedDataView view = transfer.GetData();
-    std::size_t transferred = transfer.tranferred;
-    auto [type, format, data, size] = view;
-
-    // transfer has not been started yet
-    if (transferred == TransferState::TRANSFER_PREINIT)
+    auto connection = connection_.get();
+    while (true)
     {
-        // can transfer in one shot
-        if (size <= max_transfer_size_)
+        Adopt();
         {
-            auto change_prop_cookie = xcb_change_property_checked(
-                connection_.get(),
-                XCB_PROP_MODE_REPLACE,
-                req->requestor,
-                req->property,
-                type, format, 8 * size / format, data);
-            if (!Await(change_prop_cookie, ErrorLogger{"Failed to change property"}))
+            std::lock_guard lock{mutex_};
+            // transfers fail with a broken connection, requestors time out as with the owner's one
+            if ((is_stopping_ && transfers_.empty() && handed_over_.empty()) || xcb_connection_has_error(connection))
             {
-                return {};
+                break;
             }
-            transfer.tranferred = size;
-            return true;
         }
 
-        // subscribe for notifications about requestor's properties
-        xcb_event_mask_t event_mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
-        auto subscribe_for_prop_cookie =
-            xcb_change_window_attributes(connection_.get(), req->requestor, XCB_CW_EVENT_MASK, &event_mask);
+        int timeout = owner_.ReportProgress(transfers_, next_progress_);
+        if (xcb_generic_event_t* event = xcb_poll_for_event(connection))
+        {
+            // a transfer is handed over after its first notification is sent, so its DELETE may already be here
+            Adopt();
+            switch (event->response_type & ~0x80)
+            {
+                case XCB_PROPERTY_NOTIFY:
+                {
+                    auto notify = reinterpret_cast<xcb_property_notify_event_t*>(event);
+                    if (owner_.ContinueTransfer(connection, transfers_, *notify))
+                    {
+                        End({notify->window, notify->atom});
+                    }
+                    break;
+                }
+                case XCB_DESTROY_NOTIFY:
+                {
+                    auto notify = reinterpret_cast<xcb_destroy_notify_event_t*>(event);
+                    std::erase_if(transfers_, [notify](auto& t) { return t.first.first == notify->window; });
+                    {
+                        std::lock_guard lock{mutex_};
+                        std::erase_if(keys_, [notify](auto& key) { return key.first == notify->window; });
+                    }
+                    owner_.NotifyTransferEnd();
+                    break;
+                }
+                case 0:
+                {
+                    ErrorLogger<LogLevel::WARNING>{"Request failed"}(reinterpret_cast<xcb_generic_error_t*>(event));
+                    break;
+                }
+            }
+            std::free(event);
+            continue;
+        }
+        if (xcb_connection_has_error(connection))
+        {
+            continue;
+        }
+        xcb_flush(connection);
 
-        std::uint32_t size_hint = std::min(size, static_cast<std::size_t>(std::numeric_limits<std::uint32_t>::max()));
-        // initiate multistage transfer with INCR
-        auto change_prop_cookie = xcb_change_property_checked(
-            connection_.get(), XCB_PROP_MODE_REPLACE, req->requestor, req->property, incr_atom_, 32, 1, &size_hint);
-        if (!Await(subscribe_for_prop_cookie, ErrorLogger{"Failed to subscribe for property changes"}) ||
-            !Await(change_prop_cookie, ErrorLogger{"Failed to change property"}))
+        std::vector<pollfd> fds =
         {
-            return {};
+            {xcb_get_file_descriptor(connection), POLLIN, 0},
+            {wake_fd_.Get(), POLLIN, 0}
+        };
+        for (auto& [key, transfer] : transfers_)
+        {
+            if (transfer.is_stalled)
+            {
+                fds.push_back({transfer.Fd(), POLLIN, 0});
+            }
         }
-        if (!SendFinishNotification(req))
+        if (poll(fds.data(), fds.size(), timeout) == -1 && errno != EINTR)
         {
-            return {};
+            Drop();
+            continue;
+        }
+        if (fds[1].revents & POLLIN)
+        {
+            std::uint64_t wakes = 0;
+            [[maybe_unused]] auto size = read(wake_fd_.Get(), &wakes, sizeof(wakes));
+        }
+        if (drain(std::span{fds}.subspan(2)))
+        {
+            for (auto& key : owner_.ResumeTransfers(connection, transfers_))
+            {
+                End(key);
+            }
         }
-        transfer.tranferred = 0;
-        return false;
     }
 
-    // transfer the next chunk of data
-    std::size_t chunk_size = std::min(max_transfer_size_, size - transferred);
-    chunk_size -= (8 * chunk_size) % format;
-    auto change_prop_cookie = xcb_change_property_checked(
-        connection_.get(),
-        XCB_PROP_MODE_REPLACE,
-        req->requestor,
-        req->property,
-        type, format, 8 * chunk_size / format, data + transferred);
-    if (!Await(change_prop_cookie, ErrorLogger{"Failed to change property"}))
-    {
-        return {};
-    }
-    transfer.tranferred += chunk_size;
+    Drop();
+}
 
-    // more data yet to transfer (at least final 0-size transfer)
-    if (transferred < size)
+void Clipper::TransferWorker::Drop()
+{
     {
-        return false;
+        std::lock_guard lock{mutex_};
+        handed_over_.clear();
+        keys_.clear();
     }
-
-    // unsubscribe from notifications about requestor's properties, transfer finished, don't need them any more
-    xcb_event_mask_t event_mask = XCB_EVENT_MASK_NO_EVENT;
-    auto unsubscribe_from_prop_cookie =
-        xcb_change_window_attributes(connection_.get(), req->requestor, XCB_CW_EVENT_MASK, &event_mask);
-    Await(unsubscribe_from_prop_cookie, ErrorLogger{"Failed to unsubscribe from property changes"});
-    return true;
+    transfers_.clear();
+    owner_.NotifyTransferEnd();
 }
 
 template <class Convert>
 requires
     std::is_invocable_r_v<std::optional<Clipper::ConvertedData>, Convert, xcb_selection_request_event_t*> ||
-    std::is_invocable_r_v<Clipper::ConvertedDataView, Convert, xcb_selection_request_event_t*>
+    std::is_invocable_r_v<Clipper::ConvertedDataView, Convert, xcb_selection_request_event_t*> ||
+    std::is_invocable_r_v<std::optional<Clipper::StreamedData>, Convert, xcb_selection_request_event_t*>
 void Clipper::ProceedRequest(xcb_selection_request_event_t* req, Convert&& convert)
 {
-    std::pair key = {req->requestor, req->property};
+    TransferKey key = {req->requestor, req->property};
     auto transfer = transfers_.find(key);
+    // property is still used by unfinished INCR transfer
+    if ((transfer != transfers_.end() && transfer->second.is_incremental) ||
+        (transfer == transfers_.end() && IsHandedOver(key)))
+    {
+        req->property = XCB_ATOM_NONE;
+        FinishRequestProcessing(req);
+        return;
+    }
     if (transfer == transfers_.end())
     {
-        if constexpr (std::is_same_v<ConvertedDataView, std::invoke_result_t<Convert, xcb_selection_request_event_t*>>)
+        using Result = std::invoke_result_t<Convert, xcb_selection_request_event_t*>;
+        // buffer of a new transfer is bounded by max_transfer_size_, it's admitted within the budget or if there
+        // are no transfers, so deferred requests can't starve
+        if constexpr (!std::is_same_v<ConvertedDataView, Result>)
+        {
+            if (memory_budget_ != 0)
+            {
+                auto& request = req_queues_[req->requestor].front();
+                if (TransferCount() != 0 && memory_.transfers.Current() + max_transfer_size_ > memory_budget_)
+                {
+                    metrics_.Get(req->target).deferred.Add(!request.is_deferred);
+                    request.is_deferred = true;
+                    return;
+                }
+                request.is_deferred = false;
+            }
+        }
+        auto conversion_start = std::chrono::steady_clock::now();
+        auto res = std::forward<Convert>(convert)(req);
+        metrics_.Get(req->target).conversion_duration.Record(std::chrono::steady_clock::now() - conversion_start);
+        if (tracer_)
+        {
+            tracer_->Complete("conversion", conversion_start, req->requestor, req->target);
+        }
+        if constexpr (
+            !std::is_same_v<std::optional<ConvertedData>, Result> &&
+            !std::is_same_v<std::optional<StreamedData>, Result>)
         {
             transfer = transfers_.emplace(
-                key, TransferState{std::forward<Convert>(convert)(req), TransferState::TRANSFER_PREINIT}).first;
+                key, TransferState{std::move(res), TransferState::TRANSFER_PREINIT, false, *req}).first;
+            transfer->second.charge = MemoryCharge{memory_.transfers, transfer->second.MemorySize()};
         }
         else
         {
-            auto res = std::forward<Convert>(convert)(req);
             if (res)
             {
-                transfer =
-                    transfers_.emplace(key, TransferState{std::move(*res), TransferState::TRANSFER_PREINIT}).first;
+                transfer = transfers_.emplace(
+                    key, TransferState{std::move(*res), TransferState::TRANSFER_PREINIT, false, *req}).first;
+                transfer->second.charge = MemoryCharge{memory_.transfers, transfer->second.MemorySize()};
             }
             else
             {
@@ -493,23 +1370,25 @@ void Clipper::ProceedRequest(xcb_selection_request_event_t* req, Convert&& conve
     // in case MULTIPLE has put subrequests before itself
     if (req_queues_[req->requestor].front().req == req)
     {
-        auto transfer_res = Transfer(req);
-        if (!transfer_res) // fatal transfer error, discard request
+        std::optional<bool> transfer_res;
+        if (!workers_.empty() && transfer->second.NeedsIncr(max_transfer_size_))
         {
-            req->property = XCB_ATOM_NONE;
-            transfers_.erase(transfer);
-            FinishRequestProcessing(req, false);
+            transfer_res = WorkerOf(req->requestor).Start(transfers_.extract(transfer));
         }
-        else if (*transfer_res) // transfer finished
+        else
         {
-            bool send_notification = transfer->second.tranferred <= max_transfer_size_;
-            transfers_.erase(transfer);
-            FinishRequestProcessing(req, send_notification);
+            transfer_res = Transfer(connection_.get(), transfers_, req);
+            if (!transfer_res || *transfer_res) // transfer failed or finished
+            {
+                transfers_.erase(transfer);
+            }
         }
-        else // transfer partly finished, have to wait for notification to continue
+        if (!transfer_res) // fatal transfer error, refuse request
         {
-            req_queues_[req->requestor].front().is_ready = false;
+            req->property = XCB_ATOM_NONE;
         }
+        // otherwise INCR transfer goes on after requestor is notified, driven by deletions of the property
+        FinishRequestProcessing(req);
     }
 }
 
@@ -521,7 +1400,14 @@ auto Clipper::Cached(Convert&& convert) noexcept
     {
         if (!cache_.contains(req->target))
         {
-            cache_[req->target] = convert(req);
+            XCLIPP_PROBE(cache__miss, req->target);
+            auto& converted = cache_[req->target] = convert(req);
+            memory_.cache.Add(std::get<3>(converted));
+        }
+        else
+        {
+            XCLIPP_PROBE(cache__hit, req->target);
+            metrics_.Get(req->target).cache_hits.Add();
         }
         auto& [type, format, data, size] = cache_[req->target];
 
@@ -537,7 +1423,7 @@ void Clipper::RegisterHandlers(std::unordered_map<std::string_view, xcb_atom_t>&
         auto convert = [this](xcb_selection_request_event_t*)
         {
             return ConvertedDataView{
-                XCB_ATOM_INTEGER, 32, reinterpret_cast<char*>(&ownership_timestamp_), sizeof(ownership_timestamp_)};
+                XCB_ATOM_INTEGER, 32, reinterpret_cast<char*>(&timestamp_), sizeof(timestamp_)};
         };
         ProceedRequest(req, convert);
     };
@@ -603,39 +1489,45 @@ void Clipper::RegisterHandlers(std::unordered_map<std::string_view, xcb_atom_t>&
                 auto data = std::unique_ptr<char[]>{reinterpret_cast<char*>(new xcb_atom_t[n])};
                 std::memcpy(data.get(), xcb_get_property_value(r), n * sizeof(xcb_atom_t));
                 xcb_atom_t* subreqs = reinterpret_cast<xcb_atom_t*>(data.get());
-                auto init_subreq = [this, subreqs, req](int i, xcb_atom_t next_target, xcb_atom_t next_prop)
+                auto init_subreq = [this, subreqs, req](int i)
                 {
                     if (subreqs[i + 1] == XCB_ATOM_NONE || // subrequest's property can't be None
                         (subreqs[i] == req->target &&
-                            transfers_.contains({req->requestor, subreqs[i + 1]}))) // loop detection
+                            (transfers_.contains({req->requestor, subreqs[i + 1]}) ||
+                                IsHandedOver({req->requestor, subreqs[i + 1]})))) // loop detection
                     {
                         subreqs[i + 1] = XCB_ATOM_NONE;
                     }
                     else
                     {
-                        auto on_finish = [this, subreqs, i, next_target, next_prop](xcb_selection_request_event_t* req)
+                        // put subrequest result into buffer
+                        auto on_finish = [subreqs, i](xcb_selection_request_event_t* subreq)
                         {
-                            // put subrequest result into buffer
-                            if (req->property == XCB_ATOM_NONE)
+                            if (subreq->property == XCB_ATOM_NONE)
                             {
                                 subreqs[i + 1] = XCB_ATOM_NONE;
                             }
-                            // restore target and property for the next request in queue
-                            req->target = next_target;
-                            req->property = next_prop;
                         };
-                        req_queues_[req->requestor].emplace_front(req, true, on_finish);
+                        // each subrequest is a separate request with its own target and property
+                        auto subreq = static_cast<xcb_selection_request_event_t*>(std::malloc(sizeof(*req)));
+                        if (subreq == nullptr)
+                        {
+                            subreqs[i + 1] = XCB_ATOM_NONE;
+                            return;
+                        }
+                        *subreq = *req;
+                        subreq->target = subreqs[i];
+                        subreq->property = subreqs[i + 1];
+                        req_queues_[req->requestor].emplace_front(subreq, on_finish).charge =
+                            MemoryCharge{memory_.requests, sizeof(Request) + sizeof(*subreq)};
                     }
                 };
 
                 // put subrequests to the front of queue in reverse order
-                init_subreq(n - 2, req->target, req->property);
-                for (int i = static_cast<int>(n) - 4; i >= 0; i -= 2)
+                for (int i = static_cast<int>(n) - 2; i >= 0; i -= 2)
                 {
-                    init_subreq(i, subreqs[i + 2], subreqs[i + 3]);
+                    init_subreq(i);
                 }
-                req->target = subreqs[0];
-                req->property = subreqs[1];
                 return std::pair{std::move(data), n * sizeof(xcb_atom_t)};
             };
 
@@ -651,60 +1543,110 @@ void Clipper::RegisterHandlers(std::unordered_map<std::string_view, xcb_atom_t>&
         ProceedRequest(req, convert);
     };
 
-    auto as_is_convert = [this](xcb_selection_request_event_t* req)
+    // all data targets come from the source selection
+    if (source_)
     {
-        req->property = req->property == XCB_ATOM_NONE ? req->target : req->property; // support obsolete clients
-        auto convert = [this](xcb_selection_request_event_t* req)
+        for (auto& t : forwarded_targets_)
         {
-            return ConvertedDataView{req->target, 8, data_.data(), data_.size()};
-        };
-        ProceedRequest(req, convert);
-    };
-
-    if (targets.contains("C_STRING"))
-    {
-        handlers_[targets["C_STRING"]] = as_is_convert;
-    }
-    if (targets.contains("STRING"))
-    {
-        handlers_[targets["STRING"]] = as_is_convert;
-    }
-    if (targets.contains("UTF8_STRING"))
-    {
-        handlers_[targets["UTF8_STRING"]] = as_is_convert;
+            if (!targets.contains(t))
+            {
+                continue;
+            }
+            handlers_[targets[t]] = [this, &t](xcb_selection_request_event_t* req)
+            {
+                // support obsolete clients
+                req->property = req->property == XCB_ATOM_NONE ? req->target : req->property;
+                TransferKey key = {req->requestor, req->property};
+                auto& [target, converter] = pending_forwards_[key];
+                if (converter == nullptr || target != req->target)
+                {
+                    ReaderOptions source = *source_;
+                    source.target = t;
+                    target = req->target;
+                    converter = std::make_unique<ForwardingConverter>(std::move(source));
+                }
+                // the request holds its queue till the source answers, the converter's descriptor is polled meanwhile
+                auto& request = req_queues_[req->requestor].front();
+                request.is_deferred = !converter->IsStarted();
+                if (request.is_deferred)
+                {
+                    return;
+                }
+                auto convert = [this, &converter](xcb_selection_request_event_t*) -> std::optional<StreamedData>
+                {
+                    auto type_name = converter->TypeName();
+                    if (!type_name ||
+                        std::ranges::find(not_forwarded_types, *type_name) != std::end(not_forwarded_types))
+                    {
+                        return {};
+                    }
+                    // source may be on another display, so atoms are matched by names
+                    auto type = forwarded_types_.find(*type_name);
+                    if (type == forwarded_types_.end())
+                    {
+                        auto atom = Await(
+                            xcb_intern_atom(connection_.get(), 0, type_name->size(), type_name->data()),
+                            xcb_intern_atom_reply,
+                            &xcb_intern_atom_reply_t::atom,
+                            ErrorLogger{"Failed to get type atom"});
+                        if (!atom)
+                        {
+                            return {};
+                        }
+                        type = forwarded_types_.emplace(std::move(*type_name), *atom).first;
+                    }
+                    return StreamedData{type->second, std::move(converter), nullptr};
+                };
+                ProceedRequest(req, convert);
+                // kept only while the memory budget defers the request, a deferred request is the queue's front
+                auto queue = req_queues_.find(key.first);
+                if (queue == req_queues_.end() || queue->second.empty() || !queue->second.front().is_deferred)
+                {
+                    pending_forwards_.erase(key);
+                }
+            };
+        }
+        return;
     }
 
-    xcb_atom_t text_mapping_atom = XCB_ATOM_NONE;
-    if (targets.contains("UTF8_STRING"))
-    {
-        text_mapping_atom = targets["UTF8_STRING"];
-    }
-    else if (targets.contains("STRING"))
-    {
-        text_mapping_atom = targets["STRING"];
-    }
-    else if (targets.contains("C_STRING"))
+    if (targets.contains(digest_target))
     {
-        text_mapping_atom = targets["C_STRING"];
+        handlers_[targets[digest_target]] = [this](xcb_selection_request_event_t* req)
+        {
+            req->property = req->property == XCB_ATOM_NONE ? req->target : req->property; // support obsolete clients
+            auto convert = [this](xcb_selection_request_event_t* req)
+            {
+                Digest digest = content_digest(data_);
+                auto data = std::make_unique<char[]>(digest.size());
+                std::memcpy(data.get(), digest.data(), digest.size());
+                return ConvertedData{req->target, 8, std::move(data), digest.size()};
+            };
+            ProceedRequest(req, Cached(convert));
+        };
     }
-    if (text_mapping_atom != XCB_ATOM_NONE && targets.contains("TEXT"))
+
+    if (targets.contains(memfd_socket_target) && memfd_server_)
     {
-        // TEXT type should be replaced with actual encoding
-        handlers_[targets["TEXT"]] = [this, type = text_mapping_atom](xcb_selection_request_event_t* req)
+        handlers_[targets[memfd_socket_target]] = [this](xcb_selection_request_event_t* req)
         {
             req->property = req->property == XCB_ATOM_NONE ? req->target : req->property; // support obsolete clients
-            auto convert = [this, type](xcb_selection_request_event_t*)
+            auto convert = [this](xcb_selection_request_event_t* req)
             {
-                return ConvertedDataView{type, 8, data_.data(), data_.size()};
+                auto address = memfd_server_->Address();
+                return ConvertedDataView{req->target, 8, address.data(), address.size()};
             };
             ProceedRequest(req, convert);
         };
     }
 
-    if (targets.contains("FILE_NAME") && targets.contains("C_STRING"))
+    // data is served as is
+    auto serve_as_is = [this](xcb_atom_t target, xcb_atom_t type)
     {
-        // file names are null-terminated strings
-        handlers_[targets["FILE_NAME"]] = [this, type = targets["C_STRING"]](xcb_selection_request_event_t* req)
+        converters_[target] = {type, [this]
+        {
+            return std::make_unique<TranscodingConverter>(copy_transcoder, data_, data_.size());
+        }};
+        handlers_[target] = [this, type](xcb_selection_request_event_t* req)
         {
             req->property = req->property == XCB_ATOM_NONE ? req->target : req->property; // support obsolete clients
             auto convert = [this, type](xcb_selection_request_event_t*)
@@ -713,47 +1655,131 @@ void Clipper::RegisterHandlers(std::unordered_map<std::string_view, xcb_atom_t>&
             };
             ProceedRequest(req, convert);
         };
-    }
+    };
 
-    if (targets.contains("text/uri-list"))
+    // data not in the target's format is transcoded chunk by chunk during transfer
+    auto serve_transcoded = [this](
+        xcb_atom_t target,
+        xcb_atom_t type,
+        Transcoder transcoder,
+        std::string_view prefix = {},
+        std::string_view suffix = {})
     {
-        handlers_[targets["text/uri-list"]] = [this](xcb_selection_request_event_t* req)
+        // sizing takes a pass over the data, so it's done once per type and can be done ahead of requests
+        auto prepare = [this, type, transcoder]
+        {
+            if (transcoded_sizes_.contains(type))
+            {
+                return false;
+            }
+            transcoded_sizes_.emplace(type, transcoder.size(data_));
+            return true;
+        };
+        converters_[target] = {type, [this, type, transcoder, prefix, suffix, prepare]
+        {
+            prepare();
+            return std::make_unique<TranscodingConverter>(
+                transcoder, data_, transcoded_sizes_[type], prefix, suffix);
+        }};
+        prefetchers_[target] = prepare;
+        handlers_[target] = [this](xcb_selection_request_event_t* req)
         {
             req->property = req->property == XCB_ATOM_NONE ? req->target : req->property; // support obsolete clients
             auto convert = [this](xcb_selection_request_event_t* req)
             {
-                auto [data, size] = to_uri(data_);
-                return ConvertedData{req->target, 8, std::move(data), size};
+                auto& [type, make_converter] = converters_[req->target];
+                return StreamedData{type, make_converter(), nullptr};
             };
-            ProceedRequest(req, Cached(convert));
+            ProceedRequest(req, convert);
         };
+    };
+
+    bool is_utf8 = text_encoding_ == TextEncoding::ASCII || text_encoding_ == TextEncoding::UTF8;
+    bool is_latin1 = text_encoding_ == TextEncoding::ASCII || text_encoding_ == TextEncoding::LATIN1;
+    // transcoders pass whitespace controls through, so they only need the encoding to convert from
+    bool is_utf8_input = input_encoding_ == TextEncoding::ASCII || input_encoding_ == TextEncoding::UTF8;
+    bool is_latin1_input = input_encoding_ == TextEncoding::ASCII || input_encoding_ == TextEncoding::LATIN1;
+    bool is_utf8_source = is_utf8_input || !is_latin1_input;
+    Transcoder to_latin1 = is_utf8_source ? utf8_to_latin1_transcoder : copy_transcoder;
+    Transcoder to_utf8 = is_utf8_source ? sanitize_utf8_transcoder : latin1_to_utf8_transcoder;
+    Transcoder to_utf16le = is_utf8_source ? utf8_to_utf16le_transcoder : latin1_to_utf16le_transcoder;
+    Transcoder to_utf16be = is_utf8_source ? utf8_to_utf16be_transcoder : latin1_to_utf16be_transcoder;
+
+    if (targets.contains("C_STRING"))
+    {
+        serve_as_is(targets["C_STRING"], targets["C_STRING"]);
+    }
+    if (targets.contains("STRING") && is_latin1)
+    {
+        serve_as_is(targets["STRING"], targets["STRING"]);
+    }
+    else if (targets.contains("STRING"))
+    {
+        serve_transcoded(targets["STRING"], targets["STRING"], to_latin1);
+    }
+    if (targets.contains("UTF8_STRING") && is_utf8)
+    {
+        serve_as_is(targets["UTF8_STRING"], targets["UTF8_STRING"]);
+    }
+    else if (targets.contains("UTF8_STRING"))
+    {
+        serve_transcoded(targets["UTF8_STRING"], targets["UTF8_STRING"], to_utf8);
     }
 
-    auto file_convert = [this](xcb_selection_request_event_t* req)
+    // TEXT type should be replaced with actual encoding, the one not requiring transcoding is preferred
+    if (targets.contains("TEXT") && targets.contains("UTF8_STRING") && is_utf8)
     {
-        req->property = req->property == XCB_ATOM_NONE ? req->target : req->property; // support obsolete clients
-        auto convert = [this](xcb_selection_request_event_t *req)
-        {
-            auto [data, size] = to_file_manager_clipboard_format(data_);
-            return ConvertedData{req->target, 8, std::move(data), size};
-        };
-        ProceedRequest(req, Cached(convert));
-    };
-    if (targets.contains("x-special/gnome-copied-files"))
+        serve_as_is(targets["TEXT"], targets["UTF8_STRING"]);
+    }
+    else if (targets.contains("TEXT") && targets.contains("STRING") && is_latin1)
+    {
+        serve_as_is(targets["TEXT"], targets["STRING"]);
+    }
+    else if (targets.contains("TEXT") && targets.contains("C_STRING"))
+    {
+        // data in neither encoding, e.g. with other controls, is served unchanged as with no validation at all
+        serve_as_is(targets["TEXT"], targets["C_STRING"]);
+    }
+    else if (targets.contains("TEXT") && targets.contains("UTF8_STRING"))
+    {
+        serve_transcoded(targets["TEXT"], targets["UTF8_STRING"], to_utf8);
+    }
+
+    // UTF-16 without explicit byte order is little-endian with BOM
+    if (targets.contains("text/plain;charset=utf-16"))
+    {
+        auto type = targets["text/plain;charset=utf-16"];
+        serve_transcoded(type, type, to_utf16le, utf16le_bom);
+    }
+    if (targets.contains("text/plain;charset=utf-16le"))
+    {
+        auto type = targets["text/plain;charset=utf-16le"];
+        serve_transcoded(type, type, to_utf16le);
+    }
+    if (targets.contains("text/plain;charset=utf-16be"))
     {
-        handlers_[targets["x-special/gnome-copied-files"]] = file_convert;
+        auto type = targets["text/plain;charset=utf-16be"];
+        serve_transcoded(type, type, to_utf16be);
     }
-    if (targets.contains("x-special/KDE-copied-files"))
+
+    if (targets.contains("FILE_NAME") && targets.contains("C_STRING"))
     {
-        handlers_[targets["x-special/KDE-copied-files"]] = file_convert;
+        // file names are null-terminated strings
+        serve_as_is(targets["FILE_NAME"], targets["C_STRING"]);
     }
-    if (targets.contains("x-special/mate-copied-files"))
+
+    if (targets.contains("text/uri-list"))
     {
-        handlers_[targets["x-special/mate-copied-files"]] = file_convert;
+        auto type = targets["text/uri-list"];
+        serve_transcoded(type, type, uri_path_transcoder, "file://", "\r\n");
     }
-    if (targets.contains("x-special/nautilus-clipboard"))
+
+    for (auto t : file_targets)
     {
-        handlers_[targets["x-special/nautilus-clipboard"]] = file_convert;
+        if (t.starts_with("x-special/") && targets.contains(t))
+        {
+            serve_transcoded(targets[t], targets[t], uri_path_transcoder, "copy\nfile://");
+        }
     }
 }
 
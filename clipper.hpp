@@ -3,84 +3,203 @@
 #ifndef XCLIPP_CLIPPER_HPP
 #define XCLIPP_CLIPPER_HPP
 
+#include <atomic>
+#include <chrono>
 #include <concepts>
 #include <cstddef>
 #include <cstdint>
+#include <cstdlib>
 #include <deque>
 #include <functional>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <optional>
-#include <source_location>
+#include <string>
 #include <string_view>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <variant>
+#include <vector>
 
 #include <xcb/xcb.h>
 #include <xcb/xproto.h>
 
+#include "client.hpp"
+#include "converter.hpp"
+#include "forwarder.hpp"
+#include "memfd_channel.hpp"
+#include "memory.hpp"
+#include "metrics.hpp"
+#include "predictor.hpp"
+#include "rate_limiter.hpp"
+#include "reader.hpp"
+#include "recorder.hpp"
+#include "tracer.hpp"
+#include "transport.hpp"
 #include "utils.hpp"
 
 namespace xcpp
 {
 
-class Clipper
+struct ClipperOptions
+{
+    // data is a file path, advertise file targets
+    bool is_file = false;
+    // don't acquire ownership if the current owner holds the same content
+    bool skip_same_content = false;
+    // offer data to local clients as sealed memfd passed over Unix socket, bypassing X server
+    bool memfd_channel = false;
+    // serve targets of another selection forwarding its data during each transfer, data is ignored then
+    std::optional<ReaderOptions> source;
+    // connects through it instead of $DISPLAY if set
+    const Transport* transport = nullptr;
+    // logs incoming selection traffic to this file for replay_bench if not empty
+    std::string record_path;
+    // serves metrics as OpenMetrics text on this Unix socket if not empty, '@' starts an abstract address
+    std::string metrics_socket;
+    // dumps metrics to stderr on this signal if not 0, it must be blocked in all threads
+    int metrics_dump_signal = 0;
+    // writes Chrome trace events of request lifecycles to this file if not empty
+    std::string trace_path;
+    // writes progress of INCR transfers to this descriptor once a second if not -1, it's not closed
+    int progress_fd = -1;
+    // new transfers needing a buffer wait while transfers hold more than this many bytes if not 0
+    std::size_t memory_budget = 0;
+    // requests per second allowed to each requestor window and to all windows of each client if not 0,
+    // bursts up to a second's worth are allowed, excess requests are refused
+    double rate_limit = 0;
+    // learns which targets each application requests after TARGETS keeping the model in this file if not empty,
+    // and prepares their conversions ahead
+    std::string prefetch_path;
+    // INCR transfers are handed over to this many threads with their own connections if not 0, so transfers
+    // to different requestors go on in parallel while the owner's connection only serves requests
+    unsigned transfer_threads = 0;
+};
+
+// sizes of owner's bookkeeping, which must drop back to zero once requestors are gone
+struct ClipperStats
+{
+    // requestors with requests waiting to be processed
+    std::size_t queued_requests;
+    // transfers in progress, mostly INCR ones
+    std::size_t transfers;
+};
+
+class Clipper : private Client
 {
 public:
-    explicit Clipper(std::string_view data, bool is_file = false);
+    explicit Clipper(std::string_view data, const ClipperOptions& options = {});
 
     void Run();
 
+    // as of the last handled event, can be called from another thread while Run() is going on
+    ClipperStats Stats() const noexcept;
+
 private:
-    template <class Reply, class Cookie, std::invocable<Reply*> Callback>
-    auto Await(
-        Cookie cookie,
-        Reply*(*reply_getter)(xcb_connection_t*, Cookie, xcb_generic_error_t**),
-        Callback&& callback,
-        std::string_view msg = {},
-        std::source_location loc = std::source_location::current()) ->
-            std::remove_reference_t<std::invoke_result_t<Callback, Reply*>>;
-
-    template <class Reply, class Cookie, std::invocable<Reply*> Callback, std::invocable<xcb_generic_error_t*> Handler>
-    auto Await(
-        Cookie cookie,
-        Reply*(*reply_getter)(xcb_connection_t*, Cookie, xcb_generic_error_t**),
-        Callback&& callback,
-        Handler&& handler) ->
-            std::conditional_t<
-                std::is_same_v<void, std::invoke_result_t<Callback, Reply*>>,
-                void,
-                std::optional<std::remove_reference_t<std::invoke_result_t<Callback, Reply*>>>
-            >;
-
-    void Await(
-        xcb_void_cookie_t cookie,
-        std::string_view msg = {},
-        std::source_location loc = std::source_location::current());
-
-    template <std::invocable<xcb_generic_error_t*> Handler>
-    bool Await(xcb_void_cookie_t cookie, Handler&& handler);
+    static std::vector<std::string_view> TargetNames(const ClipperOptions& options);
+
+    // waits for the next X event serving memfd channel and metrics clients meanwhile, returns nullptr on I/O error
+    xcb_generic_event_t* NextEvent();
+
+    // OpenMetrics text of metrics_ and current state
+    std::string FormatMetrics() const;
+
+    // starts processing of queued requests, retrying deferred ones
+    void ProcessRequests();
+
+    // wakes the owner's thread up from a worker's one, so requests deferred by ended transfers are retried
+    void NotifyTransferEnd() noexcept;
+
+    // converter of the data to `target` for a memfd, nullptr if the target can't be served this way
+    std::unique_ptr<ChunkConverter> MakeMemfdConverter(xcb_atom_t target);
+
+    // fetches targets of the source selection and interns them as own ones
+    void InternForwardedTargets(const ReaderOptions& source);
+
+    bool HasSameContent(std::unordered_map<std::string_view, xcb_atom_t>& targets, bool is_file);
 
     bool SendFinishNotification(xcb_selection_request_event_t* req);
 
-    void FinishRequestProcessing(xcb_selection_request_event_t* req, bool send_notification = true);
+    // whether `req` is within the rate limits of its requestor window and its client
+    bool IsWithinRateLimit(const xcb_selection_request_event_t& req);
+
+    // refuses request without waiting for the X server, errors are logged as they come as events
+    void RefuseUnchecked(const xcb_selection_request_event_t& req);
+
+    // learns from `req`, and queues prefetches of targets predicted to follow it if it's TARGETS
+    void Predict(const xcb_selection_request_event_t& req);
+
+    // WM_CLASS class name of `window`, nullopt if it has none
+    std::optional<std::string> ApplicationName(xcb_window_t window);
+
+    void Prefetch(xcb_atom_t target);
+
+    void FinishRequestProcessing(xcb_selection_request_event_t* req);
 
     void StartRequestProcessing(xcb_selection_request_event_t* req);
 
-    std::optional<bool> Transfer(xcb_selection_request_event_t* req);
+    struct TransferState;
+    using TransferKey = std::pair<xcb_window_t, xcb_atom_t>;
+    using TransferMap = std::unordered_map<TransferKey, TransferState, PairHash>;
+
+    // writes the next part of data of transfer of `req` in `transfers` to requestor's property through `connection`,
+    // which is the owner's one or the one of the worker driving `transfers`; returns whether the transfer has
+    // finished, nullopt on failure
+    std::optional<bool> Transfer(
+        xcb_connection_t* connection, TransferMap& transfers, xcb_selection_request_event_t* req);
+
+    // writes the next chunk of INCR transfer in `transfers` whose property is deleted by `notify`; returns whether
+    // the transfer has ended and is erased, the caller unsubscribes from the requestor if it was the last one
+    bool ContinueTransfer(
+        xcb_connection_t* connection, TransferMap& transfers, const xcb_property_notify_event_t& notify);
+
+    // writes chunks of stalled transfers in `transfers` whose data has arrived, returns keys of the ended ones,
+    // which are erased
+    std::vector<TransferKey> ResumeTransfers(xcb_connection_t* connection, TransferMap& transfers);
+
+    // unsubscribes from `requestor` once the owner has no INCR transfers to it
+    void ReleaseRequestor(xcb_window_t requestor);
+
+    // writes a line per INCR transfer in `transfers` going on for at least progress_interval if `next_report`
+    // has come, then schedules the next one; returns poll timeout till the next report, -1 if none is due
+    int ReportProgress(TransferMap& transfers, std::chrono::steady_clock::time_point& next_report);
+
+    // whether INCR transfer under `key` is driven by a worker
+    bool IsHandedOver(const TransferKey& key) const;
+
+    // transfers going on, including handed over ones
+    std::size_t TransferCount() const;
 
     void RegisterHandlers(std::unordered_map<std::string_view, xcb_atom_t>& targets);
 
     using ConvertedData = std::tuple<xcb_atom_t, std::uint8_t, std::unique_ptr<char[]>, std::size_t>;
     using ConvertedDataView = std::tuple<xcb_atom_t, std::uint8_t, const char*, std::size_t>;
 
+    // data converted chunk by chunk during transfer, only a single chunk is kept in memory
+    struct StreamedData
+    {
+        xcb_atom_t type;
+        std::unique_ptr<ChunkConverter> converter;
+        std::unique_ptr<char[]> buf;
+    };
+
+    // makes converter of the data to a target, which doesn't depend on request
+    struct ConverterFactory
+    {
+        xcb_atom_t type;
+        std::function<std::unique_ptr<ChunkConverter>()> make;
+    };
+
     template <class Convert>
     requires
         std::is_invocable_r_v<std::optional<ConvertedData>, Convert, xcb_selection_request_event_t*> ||
-        std::is_invocable_r_v<ConvertedDataView, Convert, xcb_selection_request_event_t*>
+        std::is_invocable_r_v<ConvertedDataView, Convert, xcb_selection_request_event_t*> ||
+        std::is_invocable_r_v<std::optional<StreamedData>, Convert, xcb_selection_request_event_t*>
     void ProceedRequest(xcb_selection_request_event_t* req, Convert&& convert);
 
     template <class Convert>
@@ -89,18 +208,44 @@ private:
 
     struct TransferState
     {
-        ConvertedDataView GetData() const noexcept
-        {
-            if (data.index() == 0)
-            {
-                auto& [type, format, ptr, size] = std::get<ConvertedData>(data);
-                return ConvertedDataView{type, format, ptr.get(), size};
-            }
-            return std::get<ConvertedDataView>(data);
-        }
+        // type, format and size (or its upper bound) of the whole data
+        std::tuple<xcb_atom_t, std::uint8_t, std::size_t> GetInfo() const noexcept;
+
+        // if not, size is only a hint and data has to be transferred with INCR
+        bool IsSizeExact() const noexcept;
+
+        // next chunk of at most `max_size` bytes
+        std::pair<const char*, std::size_t> GetChunk(std::size_t max_size);
 
-        std::variant<ConvertedData, ConvertedDataView> data;
+        // whether GetChunk() returns without waiting for data being produced, e.g. forwarded
+        bool IsReady(std::size_t max_size) const noexcept;
+
+        // readable when a stalled transfer's data arrives, -1 if it never stalls
+        int Fd() const noexcept;
+
+        // size of a chunk buffer of streamed data
+        std::size_t ChunkCapacity(std::size_t max_size) const noexcept;
+
+        // whether the data can't be written in one shot of at most `max_size` bytes
+        bool NeedsIncr(std::size_t max_size) const noexcept;
+
+        // bytes of the state and the data it owns, a buffer for streamed data is charged when allocated
+        std::size_t MemorySize() const noexcept;
+
+        std::variant<ConvertedData, ConvertedDataView, StreamedData> data;
         std::size_t tranferred;
+        bool is_incremental = false;
+        // copy of the request, INCR transfer outlives it
+        xcb_selection_request_event_t req;
+        // the property is deleted but the next chunk isn't ready, its converter's Fd() is polled
+        bool is_stalled = false;
+        // when the last INCR chunk was written, only kept when tracing
+        std::chrono::steady_clock::time_point chunk_sent = {};
+        std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+        // progress as of the previous report, for transfer rate
+        std::size_t reported_bytes = 0;
+        std::chrono::steady_clock::time_point reported_at = started;
+        MemoryCharge charge = {};
 
         enum : std::size_t { TRANSFER_PREINIT = std::numeric_limits<std::size_t>::max() };
     };
@@ -113,10 +258,79 @@ private:
         }
 
         xcb_selection_request_event_t* req;
-        bool is_ready;
         std::optional<std::function<void(xcb_selection_request_event_t*)>> on_finish;
+        std::chrono::steady_clock::time_point received = std::chrono::steady_clock::now();
+        MemoryCharge charge = {};
+        // waits for transfers to release memory, it's retried after each event
+        bool is_deferred = false;
+        // has been through StartRequestProcessing(), e.g. MULTIPLE waiting for its subrequests
+        bool is_started = false;
+    };
+
+    // memory of owner's own copies of data and bookkeeping, data_ itself is examined with mincore()
+    struct MemoryAccounts
+    {
+        MemoryAccount cache;
+        MemoryAccount transfers;
+        MemoryAccount requests;
+        MemoryAccount memfds;
+    };
+
+    // drives INCR transfers handed over by the owner through its own connection, which is subscribed for
+    // requestors' property changes instead of the owner's one, so chunks are written in parallel with other workers
+    class TransferWorker
+    {
+    public:
+        TransferWorker(Clipper& owner, const Transport* transport);
+
+        // lets the transfers going on finish
+        ~TransferWorker();
+
+        TransferWorker(const TransferWorker&) = delete;
+        TransferWorker& operator=(const TransferWorker&) = delete;
+
+        // starts INCR transfer through the worker's connection from the owner's thread, so the requestor is
+        // subscribed for before it's notified, then hands it over; returns Transfer() result
+        std::optional<bool> Start(TransferMap::node_type transfer);
+
+        bool Contains(const TransferKey& key);
+
+        std::size_t Count();
+
+    private:
+        void Run();
+
+        // moves handed over transfers to transfers_
+        void Adopt();
+
+        // forgets ended transfer under `key`, unsubscribes from its requestor if it was the last one and notifies
+        // the owner
+        void End(const TransferKey& key);
+
+        // drops all transfers, e.g. on I/O error, and notifies the owner
+        void Drop();
+
+        void Wake() noexcept;
+
+        Clipper& owner_;
+        Connection connection_;
+        // wakes the thread up for handed over transfers, events read from connection_ by the owner's thread
+        // and stopping
+        FileDescriptor wake_fd_;
+        // only touched by the worker's thread
+        TransferMap transfers_;
+        std::chrono::steady_clock::time_point next_progress_ = {};
+        // guards the members below
+        std::mutex mutex_;
+        std::vector<TransferMap::node_type> handed_over_;
+        // of transfers_, handed_over_ and ones being started, for the owner's lookups
+        std::unordered_set<TransferKey, PairHash> keys_;
+        bool is_stopping_ = false;
+        std::thread thread_;
     };
 
+    TransferWorker& WorkerOf(xcb_window_t requestor) const noexcept;
+
     inline static constexpr std::string_view required_targets[] =
     {
         "TIMESTAMP",
@@ -132,6 +346,43 @@ private:
         "C_STRING",
     };
 
+    inline static constexpr std::string_view utf16_targets[] =
+    {
+        "text/plain;charset=utf-16",
+        "text/plain;charset=utf-16le",
+        "text/plain;charset=utf-16be"
+    };
+
+    // carries content_digest() of the data, so cooperating clients can detect changes without fetching the data
+    inline static constexpr std::string_view digest_target = "application/x-xclipp-digest";
+
+    // targets of the source selection which are served by the owner itself or have side effects
+    inline static constexpr std::string_view not_forwarded_targets[] =
+    {
+        "TIMESTAMP",
+        "TARGETS",
+        "MULTIPLE",
+        "DELETE",
+        "SAVE_TARGETS",
+        "INSERT_SELECTION",
+        "INSERT_PROPERTY",
+        memfd_socket_target
+    };
+
+    // types of data holding atoms or resource ids of the source's X server, which mean nothing to requestors
+    inline static constexpr std::string_view not_forwarded_types[] =
+    {
+        "ATOM",
+        "ATOM_PAIR",
+        "BITMAP",
+        "COLORMAP",
+        "CURSOR",
+        "DRAWABLE",
+        "FONT",
+        "PIXMAP",
+        "WINDOW"
+    };
+
     inline static constexpr std::string_view file_targets[] =
     {
         "FILE_NAME",
@@ -142,24 +393,63 @@ private:
         "x-special/nautilus-clipboard"
     };
 
-    inline static const std::unordered_map<std::string_view, bool(*)(std::string_view)> text_validators =
+    inline static constexpr std::chrono::seconds progress_interval{1};
+
+    enum class TextEncoding
     {
-        {"STRING", is_icccm_string},
-        {"UTF8_STRING", is_icccm_utf8_string},
+        ASCII,
+        UTF8,
+        LATIN1,
+        UNKNOWN
     };
 
     std::string_view data_;
-    std::unique_ptr<xcb_connection_t, decltype(&xcb_disconnect)> connection_;
-    xcb_window_t owner_;
-    xcb_timestamp_t ownership_timestamp_;
-    xcb_atom_t clipboard_atom_;
-    xcb_atom_t atom_pair_atom_;
-    xcb_atom_t incr_atom_;
+    // encoding data is served as is in
+    TextEncoding text_encoding_;
+    // encoding data is transcoded from, it may also be text with controls not allowed as is
+    TextEncoding input_encoding_;
     std::size_t max_transfer_size_;
+    // outlives containers whose elements are charged to it
+    MemoryAccounts memory_;
+    std::size_t memory_budget_ = 0;
+    // resident part of data_ is only known when metrics are formatted, so it's the peak of these moments
+    mutable std::size_t content_resident_peak_ = 0;
     std::unordered_map<xcb_window_t, std::deque<Request>> req_queues_;
-    std::unordered_map<std::pair<xcb_window_t, xcb_atom_t>, TransferState, PairHash> transfers_;
+    TransferMap transfers_;
     std::unordered_map<xcb_atom_t, std::function<void(xcb_selection_request_event_t*)>> handlers_;
     std::unordered_map<xcb_atom_t, ConvertedData> cache_;
+    std::unordered_map<xcb_atom_t, ConverterFactory> converters_;
+    std::unordered_map<xcb_atom_t, std::size_t> transcoded_sizes_;
+    // do up front the work of the first conversion to a target, return false if it's done already
+    std::unordered_map<xcb_atom_t, std::function<bool()>> prefetchers_;
+    std::optional<TargetPredictor> predictor_;
+    // run while the owner has no events to handle
+    std::deque<xcb_atom_t> prefetch_queue_;
+    std::optional<MemfdServer> memfd_server_;
+    std::optional<ReaderOptions> source_;
+    // names of targets keys of atoms_ refer to, must not be modified after interning
+    std::vector<std::string> forwarded_targets_;
+    std::unordered_map<std::string, xcb_atom_t> forwarded_types_;
+    // target and converter by requestor and property of a forwarded request deferred till the source answers
+    std::unordered_map<TransferKey, std::pair<xcb_atom_t, std::unique_ptr<ForwardingConverter>>, PairHash>
+        pending_forwards_;
+    std::optional<Recorder> recorder_;
+    std::optional<Tracer> tracer_;
+    Metrics metrics_;
+    std::optional<MetricsServer> metrics_server_;
+    FileDescriptor metrics_signal_fd_;
+    int progress_fd_ = -1;
+    // bits of resource ids set by the client, the rest identify it
+    std::uint32_t resource_id_mask_ = 0;
+    std::optional<RateLimiter> requestor_limiter_;
+    std::optional<RateLimiter> client_limiter_;
+    std::chrono::steady_clock::time_point next_progress_ = {};
+    std::atomic<std::size_t> queued_requests_count_ = 0;
+    std::atomic<std::size_t> transfers_count_ = 0;
+    // counts transfers ended by workers
+    FileDescriptor transfer_end_fd_;
+    // destroyed first, so the transfers they drive finish while the rest of the owner is alive
+    std::vector<std::unique_ptr<TransferWorker>> workers_;
 };
 
 } // namespace xcpp
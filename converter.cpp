@@ -0,0 +1,56 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+
+#include "converter.hpp"
+#include "transcode.hpp"
+
+namespace xcpp
+{
+
+// copies as much of `s` as fits into `capacity` bytes of `buf`, returns number of copied bytes
+static std::size_t put(std::string_view& s, char* buf, std::size_t capacity) noexcept
+{
+    std::size_t n = std::min(s.size(), capacity);
+    std::memcpy(buf, s.data(), n);
+    s.remove_prefix(n);
+    return n;
+}
+
+TranscodingConverter::TranscodingConverter(
+    Transcoder transcoder,
+    std::string_view src,
+    std::size_t transcoded_size,
+    std::string_view prefix,
+    std::string_view suffix) noexcept :
+    transcoder_{transcoder},
+    src_{src},
+    prefix_{prefix},
+    suffix_{suffix},
+    size_{prefix.size() + transcoded_size + suffix.size()}
+{
+}
+
+std::size_t TranscodingConverter::Size() const noexcept
+{
+    return size_;
+}
+
+std::size_t TranscodingConverter::Convert(char* buf, std::size_t capacity)
+{
+    std::size_t written = put(prefix_, buf, capacity);
+    if (prefix_.empty())
+    {
+        auto [consumed, size] = transcoder_.transcode(src_, buf + written, capacity - written);
+        src_.remove_prefix(consumed);
+        written += size;
+    }
+    if (src_.empty())
+    {
+        written += put(suffix_, buf + written, capacity - written);
+    }
+    return written;
+}
+
+} // namespace xcpp
@@ -0,0 +1,79 @@
+#pragma once
+
+#ifndef XCLIPP_CONVERTER_HPP
+#define XCLIPP_CONVERTER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "transcode.hpp"
+
+namespace xcpp
+{
+
+// produces converted data incrementally, chunk by chunk, into buffers provided by caller
+class ChunkConverter
+{
+public:
+    virtual ~ChunkConverter() = default;
+
+    // exact size or upper bound of the whole output, only a hint if IsSizeExact() is false
+    virtual std::size_t Size() const noexcept = 0;
+
+    // inexact size is known for data produced while it's transferred, such data is always sent with INCR
+    virtual bool IsSizeExact() const noexcept
+    {
+        return true;
+    }
+
+    // 8, 16 or 32, the output consists of whole items of this size in bits
+    virtual std::uint8_t Format() const noexcept
+    {
+        return 8;
+    }
+
+    // readable when output Convert() waits for is produced, -1 if it never waits
+    virtual int Fd() const noexcept
+    {
+        return -1;
+    }
+
+    // whether Convert() with the given capacity returns without waiting
+    virtual bool IsReady(std::size_t) const noexcept
+    {
+        return true;
+    }
+
+    // writes as much of the remaining output as fits into `capacity` bytes of `buf` (at least 4 bytes),
+    // returns number of written bytes, 0 means the output is finished
+    virtual std::size_t Convert(char* buf, std::size_t capacity) = 0;
+};
+
+// transcodes data surrounded by optional prefix and suffix
+class TranscodingConverter : public ChunkConverter
+{
+public:
+    // `transcoded_size` is the result of `transcoder.size(src)`, passed in as it's usually cached
+    TranscodingConverter(
+        Transcoder transcoder,
+        std::string_view src,
+        std::size_t transcoded_size,
+        std::string_view prefix = {},
+        std::string_view suffix = {}) noexcept;
+
+    std::size_t Size() const noexcept override;
+
+    std::size_t Convert(char* buf, std::size_t capacity) override;
+
+private:
+    Transcoder transcoder_;
+    std::string_view src_;
+    std::string_view prefix_;
+    std::string_view suffix_;
+    std::size_t size_;
+};
+
+} // namespace xcpp
+
+#endif // XCLIPP_CONVERTER_HPP
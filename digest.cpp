@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "digest.hpp"
+
+namespace xcpp
+{
+
+// accumulation scheme follows XXH3: 8 lanes of 64 bits fed with 64-byte stripes, scrambled after every block
+
+static constexpr std::size_t lanes = 8;
+static constexpr std::size_t stripe_size = lanes * sizeof(std::uint64_t);
+static constexpr std::size_t stripes_per_block = 16;
+
+static constexpr std::uint64_t prime32_1 = 0x9E37'79B1;
+static constexpr std::uint64_t prime64_1 = 0x9E37'79B1'85EB'CA87;
+static constexpr std::uint64_t prime64_2 = 0xC2B2'AE3D'27D4'EB4F;
+static constexpr std::uint64_t prime64_3 = 0x1656'67B1'9E37'79F9;
+
+// stripe `i` of a block is keyed with secret[i, i + lanes), scrambling uses the last `lanes` words
+static constexpr std::uint64_t secret[stripes_per_block + 2 * lanes] =
+{
+    0xBE4B'A423'396C'FEB8, 0x1CAD'21F7'2C81'017C, 0xDB97'9083'E96D'D4DE, 0x1F67'B3B7'A4A4'4072,
+    0x78E5'C0CC'4EE6'79CB, 0x2172'FFCC'7DD0'5A82, 0x8E24'43F7'7441'08B0, 0x4C26'3A81'E690'35E0,
+    0xCB00'C391'BB52'283C, 0xA32E'531B'8B65'D088, 0x4EF9'0DA2'97C8'6B3F, 0xD881'4A43'A3AF'0E7E,
+    0x6B6E'0A5B'C1D2'5E37, 0xE24F'1BB6'4C4E'9B4D, 0x3D4C'89A5'1F60'47C0, 0x58B8'3E1E'7B3E'9A4F,
+    0x7F6A'0B3C'5E1D'9C27, 0x93D5'67A8'2B4E'F016, 0x2E8C'4F91'B7A3'6D05, 0xC4B1'D8E2'0F73'5A9E,
+    0x1A9F'3C6E'84D2'B750, 0xE7C2'5B08'9F41'36AD, 0x5D36'A1F4'C28E'07B9, 0xB08E'72D9'4A6C'1F33,
+    0x6C41'E97A'03B5'D8F2, 0xF2A7'0D5C'B869'413E, 0x0B5E'C3A6'1F97'E284, 0x8D13'F64B'72C0'A95D,
+    0x47F8'2A1D'E6B3'0C79, 0xD96C'B5E0'3A48'F127, 0x30A2'7E94'C15F'6BD8, 0xA5D7'1863'F02C'9E4B
+};
+
+static std::uint64_t load64(const unsigned char* p) noexcept
+{
+    std::uint64_t v = 0;
+    std::memcpy(&v, p, sizeof(v));
+    if constexpr (std::endian::native == std::endian::big)
+    {
+        v = __builtin_bswap64(v);
+    }
+    return v;
+}
+
+static void accumulate_stripe(std::uint64_t* acc, const unsigned char* p, const std::uint64_t* key) noexcept
+{
+#if defined(__SSE2__)
+    if constexpr (std::endian::native == std::endian::little)
+    {
+        for (std::size_t j = 0; j < lanes; j += 2)
+        {
+            __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 8 * j));
+            __m128i k = _mm_xor_si128(data, _mm_loadu_si128(reinterpret_cast<const __m128i*>(key + j)));
+            __m128i product = _mm_mul_epu32(k, _mm_srli_epi64(k, 32));
+            __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + j));
+            a = _mm_add_epi64(a, _mm_add_epi64(product, swapped));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + j), a);
+        }
+        return;
+    }
+#endif
+    for (std::size_t j = 0; j < lanes; ++j)
+    {
+        std::uint64_t data = load64(p + 8 * j);
+        std::uint64_t k = data ^ key[j];
+        acc[j ^ 1] += data;
+        acc[j] += (k & 0xFFFF'FFFF) * (k >> 32);
+    }
+}
+
+static void scramble(std::uint64_t* acc) noexcept
+{
+    for (std::size_t j = 0; j < lanes; ++j)
+    {
+        acc[j] = ((acc[j] ^ (acc[j] >> 47)) ^ secret[stripes_per_block + lanes + j]) * prime32_1;
+    }
+}
+
+static std::uint64_t avalanche(std::uint64_t h) noexcept
+{
+    h ^= h >> 33;
+    h *= prime64_2;
+    h ^= h >> 29;
+    h *= prime64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+Digest content_digest(std::string_view data) noexcept
+{
+    auto p = reinterpret_cast<const unsigned char*>(data.data());
+    std::size_t n = data.size();
+
+    std::uint64_t acc[lanes] = {prime32_1, prime64_1, prime64_2, prime64_3, ~prime32_1, ~prime64_1, ~prime64_2, 0};
+    std::size_t stripe = 0;
+    for (; n >= stripe_size; p += stripe_size, n -= stripe_size)
+    {
+        accumulate_stripe(acc, p, secret + stripe % stripes_per_block);
+        if (++stripe % stripes_per_block == 0)
+        {
+            scramble(acc);
+        }
+    }
+    // last partial stripe is zero-padded, the padding is disambiguated by the length
+    unsigned char last[stripe_size] = {};
+    std::memcpy(last, p, n);
+    accumulate_stripe(acc, last, secret + stripe % stripes_per_block);
+    scramble(acc);
+
+    Digest digest;
+    for (std::size_t i = 0; i < digest.size() / sizeof(std::uint64_t); ++i)
+    {
+        std::uint64_t h = data.size() * prime64_1 + i * prime64_2;
+        for (std::size_t j = 0; j < lanes; ++j)
+        {
+            h = avalanche(h ^ acc[(j + 2 * i) % lanes]) + secret[(j + i) % lanes];
+        }
+        for (std::size_t b = 0; b < sizeof(h); ++b)
+        {
+            digest[i * sizeof(h) + b] = static_cast<std::uint8_t>(h >> (8 * b));
+        }
+    }
+    return digest;
+}
+
+} // namespace xcpp
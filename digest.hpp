@@ -0,0 +1,20 @@
+#pragma once
+
+#ifndef XCLIPP_DIGEST_HPP
+#define XCLIPP_DIGEST_HPP
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace xcpp
+{
+
+using Digest = std::array<std::uint8_t, 32>;
+
+// fast non-cryptographic 256-bit hash for change detection, identical on all platforms
+Digest content_digest(std::string_view data) noexcept;
+
+} // namespace xcpp
+
+#endif // XCLIPP_DIGEST_HPP
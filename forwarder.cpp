@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "forwarder.hpp"
+#include "log.hpp"
+#include "reader.hpp"
+#include "utils.hpp"
+
+namespace xcpp
+{
+
+void ForwardingConverter::State::Notify() noexcept
+{
+    cv.notify_all();
+    std::uint64_t one = 1;
+    [[maybe_unused]] auto written = write(progress_fd.Get(), &one, sizeof(one));
+}
+
+ForwardingConverter::ForwardingConverter(ReaderOptions source) :
+    state_{std::make_shared<State>()}
+{
+    state_->progress_fd.Reset(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    if (!state_->progress_fd)
+    {
+        throw std::system_error(errno, std::generic_category(), "Failed to create eventfd");
+    }
+    std::thread{&ForwardingConverter::Receive, state_, std::move(source)}.detach();
+}
+
+ForwardingConverter::~ForwardingConverter()
+{
+    std::lock_guard lock{state_->mutex};
+    state_->is_cancelled = true;
+    state_->cv.notify_all();
+}
+
+void ForwardingConverter::Receive(std::shared_ptr<State> state, ReaderOptions source)
+{
+    auto on_size = [&state](std::string_view type, std::uint8_t format, std::size_t size, bool is_incremental)
+    {
+        std::lock_guard lock{state->mutex};
+        state->type = type;
+        // malformed replies are forwarded as bytes
+        state->format = format == 16 || format == 32 ? format : 8;
+        state->size = size;
+        state->is_incremental = is_incremental;
+        state->Notify();
+        return !state->is_cancelled;
+    };
+    auto on_chunk = [&state](std::string_view chunk)
+    {
+        std::unique_lock lock{state->mutex};
+        state->cv.wait(lock, [&state] { return state->is_cancelled || state->buffered < buffer_limit; });
+        if (state->is_cancelled)
+        {
+            return false;
+        }
+        state->chunks.emplace_back(chunk);
+        state->buffered += chunk.size();
+        state->Notify();
+        return true;
+    };
+    try
+    {
+        Reader reader{source};
+        reader.Read(on_size, on_chunk);
+    }
+    catch (std::exception& e)
+    {
+        ErrorLogger<LogLevel::WARNING>{e.what()}();
+    }
+    std::lock_guard lock{state->mutex};
+    state->is_finished = true;
+    state->Notify();
+}
+
+bool ForwardingConverter::IsStarted() const noexcept
+{
+    std::lock_guard lock{state_->mutex};
+    return state_->is_finished || (state_->type && state_->is_incremental);
+}
+
+std::optional<std::string> ForwardingConverter::TypeName()
+{
+    std::unique_lock lock{state_->mutex};
+    state_->cv.wait(lock, [this] { return state_->is_finished || (state_->type && state_->is_incremental); });
+    return state_->type;
+}
+
+std::size_t ForwardingConverter::Size() const noexcept
+{
+    std::lock_guard lock{state_->mutex};
+    return state_->size;
+}
+
+bool ForwardingConverter::IsSizeExact() const noexcept
+{
+    std::lock_guard lock{state_->mutex};
+    return !state_->is_incremental;
+}
+
+std::uint8_t ForwardingConverter::Format() const noexcept
+{
+    std::lock_guard lock{state_->mutex};
+    return state_->format;
+}
+
+int ForwardingConverter::Fd() const noexcept
+{
+    return state_->progress_fd.Get();
+}
+
+bool ForwardingConverter::IsReady(std::size_t capacity) const noexcept
+{
+    std::lock_guard lock{state_->mutex};
+    return state_->buffered >= std::min(capacity, buffer_limit) || state_->is_finished;
+}
+
+std::size_t ForwardingConverter::Convert(char* buf, std::size_t capacity)
+{
+    std::unique_lock lock{state_->mutex};
+    std::size_t awaited = std::min(capacity, buffer_limit);
+    state_->cv.wait(lock, [this, awaited] { return state_->buffered >= awaited || state_->is_finished; });
+
+    std::size_t written = 0;
+    while (written < capacity && !state_->chunks.empty())
+    {
+        std::string_view chunk = state_->chunks.front();
+        std::size_t n = std::min(capacity - written, chunk.size() - state_->front_offset);
+        std::memcpy(buf + written, chunk.data() + state_->front_offset, n);
+        written += n;
+        state_->front_offset += n;
+        if (state_->front_offset == chunk.size())
+        {
+            state_->chunks.pop_front();
+            state_->front_offset = 0;
+        }
+    }
+    state_->buffered -= written;
+    state_->cv.notify_all();
+    return written;
+}
+
+} // namespace xcpp
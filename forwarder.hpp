@@ -0,0 +1,87 @@
+#pragma once
+
+#ifndef XCLIPP_FORWARDER_HPP
+#define XCLIPP_FORWARDER_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "converter.hpp"
+#include "reader.hpp"
+#include "utils.hpp"
+
+namespace xcpp
+{
+
+// forwards data of another selection while it's being received, through a bounded buffer;
+// the owner polls Fd() instead of waiting, so the source's pace doesn't hold its event loop
+class ForwardingConverter : public ChunkConverter
+{
+public:
+    // starts reading `source` in background, on its own connection
+    explicit ForwardingConverter(ReaderOptions source);
+
+    // cancels reading without waiting for the background thread, it exits once the source answers or times out
+    ~ForwardingConverter() override;
+
+    // whether TypeName() returns without waiting: the source has refused, finished a one-shot transfer
+    // or started INCR
+    bool IsStarted() const noexcept;
+
+    // waits until IsStarted(), returns name of data type or nullopt if the source refused
+    std::optional<std::string> TypeName();
+
+    // valid after TypeName() has returned
+    std::size_t Size() const noexcept override;
+
+    bool IsSizeExact() const noexcept override;
+
+    // valid after TypeName() has returned
+    std::uint8_t Format() const noexcept override;
+
+    // readable whenever reading progresses, so IsStarted() and IsReady() are worth checking again
+    int Fd() const noexcept override;
+
+    bool IsReady(std::size_t capacity) const noexcept override;
+
+    // waits until `capacity` bytes are received (as much as buffer holds if it's smaller) or the source is finished
+    std::size_t Convert(char* buf, std::size_t capacity) override;
+
+private:
+    // shared with the background thread, which may outlive the converter
+    struct State
+    {
+        // wakes up pollers of Fd()
+        void Notify() noexcept;
+
+        mutable std::mutex mutex;
+        std::condition_variable cv;
+        FileDescriptor progress_fd;
+        std::deque<std::string> chunks;
+        std::size_t front_offset = 0;
+        std::size_t buffered = 0;
+        std::optional<std::string> type;
+        std::size_t size = 0;
+        std::uint8_t format = 8;
+        bool is_incremental = false;
+        bool is_finished = false;
+        bool is_cancelled = false;
+    };
+
+    static void Receive(std::shared_ptr<State> state, ReaderOptions source);
+
+    // received but not yet forwarded data is limited to this, unless a single chunk is bigger
+    inline static constexpr std::size_t buffer_limit = 16 << 20;
+
+    std::shared_ptr<State> state_;
+};
+
+} // namespace xcpp
+
+#endif // XCLIPP_FORWARDER_HPP
@@ -0,0 +1,190 @@
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <unistd.h>
+
+#include "log.hpp"
+#include "utils.hpp"
+
+namespace xcpp
+{
+
+// power of two
+static constexpr std::size_t log_queue_size = 512;
+
+// bounded multi-producer single-consumer queue after D. Vyukov's one, each slot's sequence number tells
+// whether it's free for the producer of position `seq` or filled for the consumer of position `seq - 1`
+class AsyncLog
+{
+public:
+    AsyncLog() : slots_{new Slot[log_queue_size]}
+    {
+        for (std::size_t i = 0; i < log_queue_size; ++i)
+        {
+            slots_[i].seq.store(i, std::memory_order_relaxed);
+        }
+        thread_ = std::thread{[this] { Drain(); }};
+    }
+
+    // writes out what's left at exit
+    ~AsyncLog()
+    {
+        stop_.store(true);
+        Wake();
+        thread_.join();
+    }
+
+    void Push(const LogRecord& record) noexcept
+    {
+        std::uint64_t pos = tail_.load(std::memory_order_relaxed);
+        Slot* slot = nullptr;
+        while (true)
+        {
+            slot = &slots_[pos & (log_queue_size - 1)];
+            auto diff = static_cast<std::int64_t>(slot->seq.load(std::memory_order_acquire) - pos);
+            if (diff == 0)
+            {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0) // full, the logging thread is behind by a whole queue
+            {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            else
+            {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        slot->record = record;
+        slot->seq.store(pos + 1, std::memory_order_release);
+        Wake();
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<std::uint64_t> seq;
+        LogRecord record;
+    };
+
+    // system call is made only if the logging thread sleeps, so storms of messages don't pay for it
+    void Wake() noexcept
+    {
+        // pairs with the fence in Drain(), either the thread sees the new state or it's seen sleeping here
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping_.load(std::memory_order_relaxed) && sleeping_.exchange(false))
+        {
+            sleeping_.notify_one();
+        }
+    }
+
+    bool HasRecord() const noexcept
+    {
+        return slots_[head_ & (log_queue_size - 1)].seq.load(std::memory_order_acquire) == head_ + 1;
+    }
+
+    const LogRecord& Front() const noexcept
+    {
+        return slots_[head_ & (log_queue_size - 1)].record;
+    }
+
+    void Pop() noexcept
+    {
+        slots_[head_ & (log_queue_size - 1)].seq.store(head_ + log_queue_size, std::memory_order_release);
+        ++head_;
+    }
+
+    void Drain()
+    {
+        std::string buf;
+        while (true)
+        {
+            for (; HasRecord(); Pop())
+            {
+                Format(buf, Front());
+            }
+            if (auto dropped = dropped_.exchange(0, std::memory_order_relaxed))
+            {
+                buf += std::format("{} log messages were dropped\n", dropped);
+            }
+            Write(buf);
+            buf.clear();
+
+            sleeping_.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (HasRecord())
+            {
+                sleeping_.store(false);
+                continue;
+            }
+            if (stop_.load())
+            {
+                return;
+            }
+            sleeping_.wait(true);
+        }
+    }
+
+    static void Format(std::string& buf, const LogRecord& record)
+    {
+        static constexpr std::string_view level_prefixes[] = {"", "warning: ", "info: ", "debug: "};
+        std::string_view file_name = record.file;
+        file_name.remove_prefix(file_name.rfind('/') + 1);
+        buf += std::format("{}:{}: {}", file_name, record.line, level_prefixes[static_cast<std::size_t>(record.level)]);
+        if (record.error_code != 0)
+        {
+            buf += error_string(record.error_code);
+            if (record.msg_size != 0)
+            {
+                buf += ": ";
+            }
+        }
+        buf += std::string_view{record.msg, record.msg_size};
+        buf += '\n';
+    }
+
+    static void Write(std::string_view text) noexcept
+    {
+        while (!text.empty())
+        {
+            ssize_t written = write(STDERR_FILENO, text.data(), text.size());
+            if (written == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                return;
+            }
+            text.remove_prefix(written);
+        }
+    }
+
+    std::unique_ptr<Slot[]> slots_;
+    alignas(64) std::atomic<std::uint64_t> tail_ = 0;
+    alignas(64) std::uint64_t head_ = 0;
+    std::atomic<std::uint64_t> dropped_ = 0;
+    std::atomic<bool> sleeping_ = false;
+    std::atomic<bool> stop_ = false;
+    std::thread thread_;
+};
+
+void log_record(const LogRecord& record) noexcept
+{
+    // started on first use and stopped after main() returns
+    static AsyncLog log;
+    log.Push(record);
+}
+
+} // namespace xcpp
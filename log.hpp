@@ -0,0 +1,48 @@
+#pragma once
+
+#ifndef XCLIPP_LOG_HPP
+#define XCLIPP_LOG_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace xcpp
+{
+
+enum class LogLevel : std::uint8_t
+{
+    ERROR,
+    WARNING,
+    INFO,
+    DEBUG
+};
+
+// messages of less severe levels are compiled out, e.g. -DXCLIPP_MAX_LOG_LEVEL=0 leaves only errors
+#ifndef XCLIPP_MAX_LOG_LEVEL
+#define XCLIPP_MAX_LOG_LEVEL 2
+#endif
+inline constexpr LogLevel max_log_level = static_cast<LogLevel>(XCLIPP_MAX_LOG_LEVEL);
+
+// message kept in binary form until the logging thread formats it, so logging costs a copy of a few bytes
+struct LogRecord
+{
+    inline static constexpr std::size_t max_msg_size = 232;
+
+    // from std::source_location, so it's static
+    const char* file;
+    std::uint32_t line;
+    LogLevel level;
+    // X error code, 0 if none
+    std::uint8_t error_code;
+    // longer messages are truncated
+    std::uint8_t msg_size;
+    char msg[max_msg_size];
+};
+
+// puts `record` into a lock-free queue drained to stderr by a background thread started on the first call;
+// if the queue is full, the record is dropped and the count of dropped records is reported later
+void log_record(const LogRecord& record) noexcept;
+
+} // namespace xcpp
+
+#endif // XCLIPP_LOG_HPP
@@ -1,29 +1,88 @@
+#include <algorithm>
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
 #include <fcntl.h>
+#include <getopt.h>
+#include <iterator>
 #include <memory>
+#include <signal.h>
 #include <stdexcept>
 #include <string_view>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <vector>
 
 #include "clipper.hpp"
+#include "reader.hpp"
+#include "utils.hpp"
+#include "watcher.hpp"
 
 enum ErrorType : int
 {
     USAGE_ERROR = 1,
     FILE_ERROR,
-    RUNTIME_ERROR
+    RUNTIME_ERROR,
+    NO_CONTENT_ERROR
 };
 
 static const char* usage =
         "Usage:\n"
-        "\txclipp [--] STRING\n"
-        "\txclipp -f [--] FILE\n"
-        "\txclipp -c [--] FILE\n";
+        "\txclipp [-sm] [OWNER OPTION]... [--] STRING\n"
+        "\txclipp [-sm] [OWNER OPTION]... -f [--] FILE\n"
+        "\txclipp [-sm] [OWNER OPTION]... -c [--] FILE\n"
+        "\txclipp -o [-p] [-t TARGET] [-D DISPLAY] [--] [FILE]\n"
+        "\txclipp -o [-p] -t TARGET... [-D DISPLAY] [--] FILE...\n"
+        "\txclipp -x [-p] [-D DISPLAY] [OWNER OPTION]...\n"
+        "\txclipp -w|--watch [-p] [-t TARGET] [-D DISPLAY] [--] [FILE]\n"
+        "Options:\n"
+        "\t-s  don't take ownership if the clipboard already holds the same content\n"
+        "\t-m  offer the content to local clients as memfd over Unix socket\n"
+        "\t-o  write the clipboard content to FILE or standard output\n"
+        "\t-p  read PRIMARY selection instead of CLIPBOARD\n"
+        "\t-t  request TARGET instead of the preferred text target, several ones are requested at once into FILEs\n"
+        "\t-x  serve CLIPBOARD forwarding data of PRIMARY (-p) or CLIPBOARD of another DISPLAY (-D) on each paste\n"
+        "\t-w  print a line on each ownership change, also fetch the new content into FILE if given\n"
+        "\t-D  read selection of DISPLAY instead of $DISPLAY\n"
+        "Owner options:\n"
+        "\t--memory-budget SIZE  defer requests needing a buffer while transfers hold over SIZE (K, M, G) bytes\n"
+        "\t--metrics SOCKET  serve OpenMetrics text on Unix SOCKET ('@' for abstract address), also dumped on SIGUSR1\n"
+        "\t--prefetch FILE  prepare targets applications usually request after TARGETS, learned in FILE, not with -x\n"
+        "\t--progress[=FD]  report progress and rate of INCR transfers once a second to FD, standard error by default\n"
+        "\t--rate-limit N  refuse requests over N per second from each requestor window and from each client\n"
+        "\t--record LOG  log incoming selection requests to LOG for replaying them with replay_bench, not with -x\n"
+        "\t--transfer-threads N  drive INCR transfers by N threads with their own X connections\n"
+        "\t--trace FILE  write Chrome trace events of each request's processing to FILE\n";
+
+// options needing no STRING or FILE
+static constexpr std::string_view standalone_options[] = {"-o", "-x", "-w", "--watch"};
+
+// bounds --transfer-threads, each thread holds an X connection
+static constexpr long max_threads = 64;
+
+static const option long_options[] =
+{
+    {"watch", no_argument, nullptr, 'w'},
+    {"record", required_argument, nullptr, 'R'},
+    {"metrics", required_argument, nullptr, 'M'},
+    {"trace", required_argument, nullptr, 'T'},
+    {"progress", optional_argument, nullptr, 'P'},
+    {"memory-budget", required_argument, nullptr, 'B'},
+    {"rate-limit", required_argument, nullptr, 'L'},
+    {"prefetch", required_argument, nullptr, 'F'},
+    {"transfer-threads", required_argument, nullptr, 'J'},
+    {nullptr, 0, nullptr, 0}
+};
+
+// indexed by XCB_XFIXES_SELECTION_EVENT_* subtype
+static const char* change_reasons[] =
+{
+    "set-owner",
+    "window-destroy",
+    "client-close"
+};
 
 class MmapDeleter
 {
@@ -48,20 +107,66 @@ private:
     std::size_t size_;
 };
 
+// SIZE argument with optional K, M or G binary suffix, 0 if invalid
+static std::size_t parse_size(const char* str)
+{
+    char* end = nullptr;
+    unsigned long long size = std::strtoull(str, &end, 10);
+    if (end == str || *str == '-')
+    {
+        return 0;
+    }
+    std::string_view suffixes = "KMG";
+    if (auto pos = suffixes.find(*end); *end != '\0' && pos != std::string_view::npos)
+    {
+        size <<= 10 * (pos + 1);
+        ++end;
+    }
+    return *end == '\0' ? size : 0;
+}
+
+// blocks SIGUSR1 before any thread is started, so the owner receives it through signalfd;
+// only done with --metrics, otherwise the signal keeps terminating the owner
+static int block_metrics_signal()
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+    return SIGUSR1;
+}
+
 int main(int argc, char* argv[])
 {
     bool is_content = false;
     bool is_file = false;
+    bool skip_same_content = false;
+    bool memfd_channel = false;
+    bool is_output = false;
+    bool primary = false;
+    bool is_forward = false;
+    bool is_watch = false;
+    std::vector<std::string_view> targets;
+    const char* display = nullptr;
+    const char* record_path = nullptr;
+    const char* metrics_socket = nullptr;
+    const char* trace_path = nullptr;
+    int progress_fd = -1;
+    std::size_t memory_budget = 0;
+    double rate_limit = 0;
+    const char* prefetch_path = nullptr;
+    long transfer_threads = 0;
     char* str = nullptr;
 
-    if (argc == 2)
+    // single argument is a STRING, even if it looks like an option, unless it's an option complete on its own
+    if (argc == 2 && std::ranges::find(standalone_options, std::string_view{argv[1]}) == std::end(standalone_options))
     {
         str = argv[1];
     }
     else
     {
         int opt = 0;
-        while ((opt = getopt(argc, argv, "fc")) != -1)
+        while ((opt = getopt_long(argc, argv, "fcsmopt:xD:w", long_options, nullptr)) != -1)
         {
             switch (opt)
             {
@@ -75,6 +180,109 @@ int main(int argc, char* argv[])
                     is_content = true;
                     break;
                 }
+                case 's':
+                {
+                    skip_same_content = true;
+                    break;
+                }
+                case 'm':
+                {
+                    memfd_channel = true;
+                    break;
+                }
+                case 'o':
+                {
+                    is_output = true;
+                    break;
+                }
+                case 'p':
+                {
+                    primary = true;
+                    break;
+                }
+                case 't':
+                {
+                    targets.push_back(optarg);
+                    break;
+                }
+                case 'x':
+                {
+                    is_forward = true;
+                    break;
+                }
+                case 'D':
+                {
+                    display = optarg;
+                    break;
+                }
+                case 'w':
+                {
+                    is_watch = true;
+                    break;
+                }
+                case 'R':
+                {
+                    record_path = optarg;
+                    break;
+                }
+                case 'M':
+                {
+                    metrics_socket = optarg;
+                    break;
+                }
+                case 'T':
+                {
+                    trace_path = optarg;
+                    break;
+                }
+                case 'B':
+                {
+                    memory_budget = parse_size(optarg);
+                    if (memory_budget == 0)
+                    {
+                        std::fputs(usage, stderr);
+                        return USAGE_ERROR;
+                    }
+                    break;
+                }
+                case 'L':
+                {
+                    char* end = nullptr;
+                    rate_limit = std::strtod(optarg, &end);
+                    if (*optarg == '\0' || *end != '\0' || !(rate_limit > 0))
+                    {
+                        std::fputs(usage, stderr);
+                        return USAGE_ERROR;
+                    }
+                    break;
+                }
+                case 'F':
+                {
+                    prefetch_path = optarg;
+                    break;
+                }
+                case 'J':
+                {
+                    char* end = nullptr;
+                    transfer_threads = std::strtol(optarg, &end, 10);
+                    if (*optarg == '\0' || *end != '\0' || transfer_threads <= 0 || transfer_threads > max_threads)
+                    {
+                        std::fputs(usage, stderr);
+                        return USAGE_ERROR;
+                    }
+                    break;
+                }
+                case 'P':
+                {
+                    char* end = nullptr;
+                    progress_fd = optarg == nullptr ? STDERR_FILENO : std::strtol(optarg, &end, 10);
+                    if (optarg != nullptr && (*optarg == '\0' || *end != '\0' || progress_fd < 0))
+                    {
+                        std::fputs(usage, stderr);
+                        return USAGE_ERROR;
+                    }
+                    break;
+                }
                 default:
                 {
                     std::fputs(usage, stderr);
@@ -82,19 +290,184 @@ int main(int argc, char* argv[])
                 }
             }
         }
-        if (optind == argc)
+        if (optind == argc && !is_output && !is_forward && !is_watch)
         {
             std::fputs("No STRING or FILE was provided\n", stderr);
             std::fputs(usage, stderr);
             return USAGE_ERROR;
         }
-        if (is_file && is_content)
+        bool is_writing = is_file || is_content || skip_same_content || memfd_channel;
+        bool is_reading = is_output || is_watch;
+        if ((is_file && is_content) ||
+            ((record_path != nullptr || prefetch_path != nullptr) && (is_reading || is_forward)) ||
+            ((metrics_socket != nullptr || trace_path != nullptr || progress_fd != -1 || memory_budget != 0 ||
+                rate_limit != 0 || transfer_threads != 0) &&
+                is_reading) ||
+            (is_output && is_watch) ||
+            (is_reading && (is_writing || is_forward)) ||
+            (is_forward && (is_writing || !targets.empty() || optind != argc || (!primary && display == nullptr))) ||
+            (!is_reading && !is_forward && (primary || !targets.empty() || display != nullptr)) ||
+            (is_watch && !targets.empty() && optind == argc) ||
+            (targets.size() > 1 && (!is_output || static_cast<std::size_t>(argc - optind) != targets.size())))
         {
             std::fputs("Conflicting options were provided\n", stderr);
             std::fputs(usage, stderr);
             return USAGE_ERROR;
         }
-        str = argv[optind];
+        str = optind == argc ? nullptr : argv[optind];
+    }
+
+    if (is_output && targets.size() > 1)
+    {
+        std::vector<xcpp::FileDescriptor> files;
+        std::vector<int> fds;
+        for (int i = optind; i < argc; ++i)
+        {
+            files.emplace_back(open(argv[i], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666));
+            if (!files.back())
+            {
+                std::perror(argv[i]);
+                return FILE_ERROR;
+            }
+            fds.push_back(files.back().Get());
+        }
+
+        try
+        {
+            xcpp::ReaderOptions options;
+            options.primary = primary;
+            options.display = display == nullptr ? "" : display;
+            xcpp::Reader reader(options);
+            auto converted = reader.ReadMultiple(targets, fds);
+            if (!converted)
+            {
+                std::fputs("Selection content is not available\n", stderr);
+                return NO_CONTENT_ERROR;
+            }
+            bool all_converted = true;
+            for (std::size_t i = 0; i < targets.size(); ++i)
+            {
+                if (!(*converted)[i])
+                {
+                    int length = static_cast<int>(targets[i].size());
+                    std::fprintf(stderr, "Target %.*s is not available\n", length, targets[i].data());
+                    all_converted = false;
+                }
+            }
+            if (!all_converted)
+            {
+                return NO_CONTENT_ERROR;
+            }
+        }
+        catch (std::exception& e)
+        {
+            std::fprintf(stderr, "%s\n", e.what());
+            return RUNTIME_ERROR;
+        }
+        return 0;
+    }
+
+    if (is_output)
+    {
+        int fd = STDOUT_FILENO;
+        if (str != nullptr && (fd = open(str, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) == -1)
+        {
+            std::perror(str);
+            return FILE_ERROR;
+        }
+        std::unique_ptr<int, void(*)(int*)> fd_ptr{&fd, [](int* ptr) { close(*ptr); }};
+
+        try
+        {
+            xcpp::ReaderOptions options;
+            options.primary = primary;
+            options.target = targets.empty() ? "" : targets.front();
+            options.display = display == nullptr ? "" : display;
+            xcpp::Reader reader(options);
+            if (!reader.Read(fd))
+            {
+                std::fputs("Selection content is not available\n", stderr);
+                return NO_CONTENT_ERROR;
+            }
+        }
+        catch (std::exception& e)
+        {
+            std::fprintf(stderr, "%s\n", e.what());
+            return RUNTIME_ERROR;
+        }
+        return 0;
+    }
+
+    if (is_watch)
+    {
+        try
+        {
+            xcpp::ReaderOptions options;
+            options.primary = primary;
+            options.target = targets.empty() ? "" : targets.front();
+            options.display = display == nullptr ? "" : display;
+            xcpp::Watcher watcher(options);
+            auto on_change = [&options, str](const xcb_xfixes_selection_notify_event_t& notify)
+            {
+                // fresh connection, so its request time is not older than the new ownership
+                if (str != nullptr && notify.owner != XCB_NONE)
+                {
+                    int fd = open(str, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+                    if (fd == -1)
+                    {
+                        std::perror(str);
+                        return false;
+                    }
+                    std::unique_ptr<int, void(*)(int*)> fd_ptr{&fd, [](int* ptr) { close(*ptr); }};
+                    if (!xcpp::Reader{options}.Read(fd))
+                    {
+                        std::fputs("Selection content is not available\n", stderr);
+                    }
+                }
+                const char* reason =
+                    notify.subtype < std::size(change_reasons) ? change_reasons[notify.subtype] : "unknown";
+                std::printf("%u %s 0x%x\n", notify.selection_timestamp, reason, notify.owner);
+                std::fflush(stdout);
+                return true;
+            };
+            if (!watcher.Watch(on_change))
+            {
+                std::fputs("Connection to X server is broken\n", stderr);
+                return RUNTIME_ERROR;
+            }
+        }
+        catch (std::exception& e)
+        {
+            std::fprintf(stderr, "%s\n", e.what());
+            return RUNTIME_ERROR;
+        }
+        return FILE_ERROR; // watching stops only if FILE can't be opened
+    }
+
+    if (is_forward)
+    {
+        try
+        {
+            xcpp::ClipperOptions options;
+            options.source.emplace();
+            options.source->primary = primary;
+            options.source->display = display == nullptr ? "" : display;
+            options.metrics_socket = metrics_socket == nullptr ? "" : metrics_socket;
+            options.metrics_dump_signal = metrics_socket == nullptr ? 0 : block_metrics_signal();
+            options.trace_path = trace_path == nullptr ? "" : trace_path;
+            options.progress_fd = progress_fd;
+            options.memory_budget = memory_budget;
+            options.rate_limit = rate_limit;
+            options.transfer_threads = transfer_threads;
+            xcpp::Clipper clipper({}, options);
+            clipper.Run();
+        }
+        catch (std::exception& e)
+        {
+            std::fprintf(stderr, "%s\n", e.what());
+            return RUNTIME_ERROR;
+        }
+        return 0;
     }
 
     std::string_view data;
@@ -157,7 +530,20 @@ int main(int argc, char* argv[])
 
     try
     {
-        xcpp::Clipper clipper(data, is_file);
+        xcpp::ClipperOptions options;
+        options.is_file = is_file;
+        options.skip_same_content = skip_same_content;
+        options.memfd_channel = memfd_channel;
+        options.record_path = record_path == nullptr ? "" : record_path;
+        options.metrics_socket = metrics_socket == nullptr ? "" : metrics_socket;
+        options.metrics_dump_signal = metrics_socket == nullptr ? 0 : block_metrics_signal();
+        options.trace_path = trace_path == nullptr ? "" : trace_path;
+        options.progress_fd = progress_fd;
+        options.memory_budget = memory_budget;
+        options.rate_limit = rate_limit;
+        options.transfer_threads = transfer_threads;
+        options.prefetch_path = prefetch_path == nullptr ? "" : prefetch_path;
+        xcpp::Clipper clipper(data, options);
         clipper.Run();
     }
     catch (std::exception& e)
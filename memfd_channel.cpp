@@ -0,0 +1,406 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "converter.hpp"
+#include "memfd_channel.hpp"
+#include "memory.hpp"
+#include "utils.hpp"
+
+namespace xcpp
+{
+
+// clients which connect and don't send anything are dropped, so they can't pile up
+static constexpr std::chrono::seconds client_timeout{1};
+
+static constexpr char status_ok = 1;
+static constexpr char status_unavailable = 0;
+
+static void signal(const FileDescriptor& eventfd) noexcept
+{
+    std::uint64_t one = 1;
+    [[maybe_unused]] auto written = write(eventfd.Get(), &one, sizeof(one));
+}
+
+static void drain(const FileDescriptor& eventfd) noexcept
+{
+    std::uint64_t count = 0;
+    [[maybe_unused]] auto size = read(eventfd.Get(), &count, sizeof(count));
+}
+
+MemfdServer::MemfdServer(MemoryAccount& account) :
+    socket_{socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)},
+    account_{account},
+    ready_fd_{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)},
+    wake_fd_{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)}
+{
+    if (!socket_)
+    {
+        throw std::system_error(errno, std::generic_category(), "Failed to create memfd channel socket");
+    }
+    if (!ready_fd_ || !wake_fd_)
+    {
+        throw std::system_error(errno, std::generic_category(), "Failed to create eventfd");
+    }
+
+    // binding only address family assigns unique abstract address
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    socklen_t len = sizeof(addr.sun_family);
+    if (bind(socket_.Get(), reinterpret_cast<sockaddr*>(&addr), len) == -1 ||
+        listen(socket_.Get(), SOMAXCONN) == -1)
+    {
+        throw std::system_error(errno, std::generic_category(), "Failed to listen on memfd channel socket");
+    }
+    len = sizeof(addr);
+    if (getsockname(socket_.Get(), reinterpret_cast<sockaddr*>(&addr), &len) == -1)
+    {
+        throw std::system_error(errno, std::generic_category(), "Failed to get memfd channel socket address");
+    }
+    // abstract address starts with null character
+    address_.assign(addr.sun_path, len - offsetof(sockaddr_un, sun_path));
+    address_.front() = '@';
+    thread_ = std::thread{[this] { Run(); }};
+}
+
+MemfdServer::~MemfdServer()
+{
+    {
+        std::lock_guard lock{mutex_};
+        is_stopping_ = true;
+    }
+    Wake();
+    thread_.join();
+    for (auto& [target, filler] : fillers_)
+    {
+        filler.join();
+    }
+}
+
+void MemfdServer::Serve(const MakeConverter& make_converter)
+{
+    drain(ready_fd_);
+    std::vector<std::uint32_t> requested;
+    {
+        std::lock_guard lock{mutex_};
+        requested.swap(requested_);
+    }
+    if (requested.empty())
+    {
+        return;
+    }
+    std::vector<std::pair<std::uint32_t, std::unique_ptr<ChunkConverter>>> converted;
+    for (auto target : requested)
+    {
+        converted.emplace_back(target, make_converter(target));
+    }
+    {
+        std::lock_guard lock{mutex_};
+        std::ranges::move(converted, std::back_inserter(converted_));
+    }
+    Wake();
+}
+
+void MemfdServer::Clear()
+{
+    {
+        std::lock_guard lock{mutex_};
+        is_clear_pending_ = true;
+    }
+    Wake();
+}
+
+void MemfdServer::Wake() noexcept
+{
+    signal(wake_fd_);
+}
+
+// sends `memfd` or failure status if it's invalid, the descriptor is duplicated into the client's process
+static void send_memfd(const FileDescriptor& socket, const FileDescriptor& memfd)
+{
+    char status = memfd ? status_ok : status_unavailable;
+    iovec iov = {&status, sizeof(status)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (memfd)
+    {
+        int fd = memfd.Get();
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+    // a single small packet fits into an empty socket buffer
+    sendmsg(socket.Get(), &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+void MemfdServer::Run()
+{
+    while (true)
+    {
+        std::vector<std::pair<std::uint32_t, std::unique_ptr<ChunkConverter>>> converted;
+        std::vector<std::pair<std::uint32_t, Memfd>> filled;
+        {
+            std::lock_guard lock{mutex_};
+            if (is_stopping_)
+            {
+                return;
+            }
+            converted.swap(converted_);
+            filled.swap(filled_);
+            is_cleared_ = is_cleared_ || is_clear_pending_;
+        }
+        for (auto& [target, memfd] : filled)
+        {
+            fillers_.at(target).join();
+            fillers_.erase(target);
+            for (auto& client : waiting_[target])
+            {
+                send_memfd(client.socket, memfd.fd);
+            }
+            waiting_.erase(target);
+            // a target which can't be served this way is asked for again, the owner refuses it at once
+            if (memfd.fd && !is_cleared_)
+            {
+                memfds_.emplace(target, std::move(memfd));
+            }
+        }
+        for (auto& [target, converter] : converted)
+        {
+            if (converter == nullptr)
+            {
+                for (auto& client : waiting_[target])
+                {
+                    send_memfd(client.socket, FileDescriptor{});
+                }
+                waiting_.erase(target);
+                continue;
+            }
+            fillers_.emplace(target, std::thread{&MemfdServer::Fill, this, target, std::move(converter)});
+        }
+        if (is_cleared_)
+        {
+            memfds_.clear();
+        }
+
+        // clients are kept in the order they were accepted, so the first one times out first
+        auto now = std::chrono::steady_clock::now();
+        std::erase_if(connected_, [now](auto& client) { return now - client.accepted >= client_timeout; });
+        int timeout = -1;
+        if (!connected_.empty())
+        {
+            auto deadline = connected_.front().accepted + client_timeout;
+            timeout = std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count();
+        }
+
+        std::vector<pollfd> fds =
+        {
+            {socket_.Get(), POLLIN, 0},
+            {wake_fd_.Get(), POLLIN, 0}
+        };
+        for (auto& client : connected_)
+        {
+            fds.push_back({client.socket.Get(), POLLIN, 0});
+        }
+        if (poll(fds.data(), fds.size(), timeout) == -1 && errno != EINTR)
+        {
+            return;
+        }
+        if (fds[1].revents & POLLIN)
+        {
+            drain(wake_fd_);
+        }
+
+        // target comes in a single packet, a client which closes or sends anything else is dropped
+        std::vector<std::uint32_t> requested;
+        for (std::size_t i = 0; i < connected_.size(); ++i)
+        {
+            auto& client = connected_[i];
+            if (fds[2 + i].revents == 0)
+            {
+                continue;
+            }
+            auto size = recv(client.socket.Get(), &client.target, sizeof(client.target), MSG_DONTWAIT);
+            if (size == sizeof(client.target))
+            {
+                Request(std::move(client), requested);
+            }
+            client.socket.Reset();
+        }
+        std::erase_if(connected_, [](auto& client) { return !client.socket; });
+        if (fds[0].revents & POLLIN)
+        {
+            Accept();
+        }
+        if (!requested.empty())
+        {
+            std::lock_guard lock{mutex_};
+            std::ranges::move(requested, std::back_inserter(requested_));
+            signal(ready_fd_);
+        }
+    }
+}
+
+void MemfdServer::Accept()
+{
+    // listening socket is non-blocking, so the loop ends when no connections are pending
+    while (true)
+    {
+        FileDescriptor client{accept4(socket_.Get(), nullptr, nullptr, SOCK_CLOEXEC)};
+        if (!client)
+        {
+            return;
+        }
+        ucred cred = {};
+        socklen_t cred_len = sizeof(cred);
+        if (getsockopt(client.Get(), SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == 0 && cred.uid == getuid())
+        {
+            connected_.emplace_back().socket = std::move(client);
+        }
+    }
+}
+
+void MemfdServer::Request(Client client, std::vector<std::uint32_t>& requested)
+{
+    if (is_cleared_)
+    {
+        send_memfd(client.socket, FileDescriptor{});
+        return;
+    }
+    if (auto memfd = memfds_.find(client.target); memfd != memfds_.end())
+    {
+        send_memfd(client.socket, memfd->second.fd);
+        return;
+    }
+    // the first client of a target asks the owner for a converter, the others wait for the same memfd
+    auto& waiting = waiting_[client.target];
+    if (waiting.empty() && !fillers_.contains(client.target))
+    {
+        requested.push_back(client.target);
+    }
+    waiting.push_back(std::move(client));
+}
+
+void MemfdServer::Fill(std::uint32_t target, std::unique_ptr<ChunkConverter> converter)
+{
+    std::size_t size = converter->Size();
+    Memfd memfd{FileDescriptor{}, MemoryCharge{account_, size}};
+    auto fill = [&converter, size](char* buf)
+    {
+        std::size_t written = 0;
+        while (std::size_t n = converter->Convert(buf + written, size - written))
+        {
+            written += n;
+        }
+        return written;
+    };
+    // clients fall back to ordinary conversion on failure
+    memfd.fd = make_sealed_memfd(size, fill);
+    if (!memfd.fd)
+    {
+        memfd.charge = MemoryCharge{};
+    }
+    {
+        std::lock_guard lock{mutex_};
+        filled_.emplace_back(target, std::move(memfd));
+    }
+    Wake();
+}
+
+FileDescriptor receive_memfd(std::string_view address, std::uint32_t target)
+{
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (!address.starts_with('@') || address.size() > sizeof(addr.sun_path))
+    {
+        return FileDescriptor{};
+    }
+    std::memcpy(addr.sun_path + 1, address.data() + 1, address.size() - 1);
+    socklen_t len = offsetof(sockaddr_un, sun_path) + address.size();
+
+    FileDescriptor server{socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)};
+    if (!server ||
+        connect(server.Get(), reinterpret_cast<sockaddr*>(&addr), len) == -1 ||
+        send(server.Get(), &target, sizeof(target), MSG_NOSIGNAL) != sizeof(target))
+    {
+        return FileDescriptor{};
+    }
+
+    char status = status_unavailable;
+    iovec iov = {&status, sizeof(status)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(server.Get(), &msg, MSG_CMSG_CLOEXEC) != sizeof(status) || status != status_ok)
+    {
+        return FileDescriptor{};
+    }
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+    {
+        return FileDescriptor{};
+    }
+    int memfd = -1;
+    std::memcpy(&memfd, CMSG_DATA(cmsg), sizeof(int));
+    return FileDescriptor{memfd};
+}
+
+FileDescriptor make_sealed_memfd(std::size_t size, const std::function<std::size_t(char*)>& fill)
+{
+    FileDescriptor memfd{memfd_create("xclipp", MFD_CLOEXEC | MFD_ALLOW_SEALING)};
+    if (!memfd || ftruncate(memfd.Get(), size) == -1)
+    {
+        return FileDescriptor{};
+    }
+    if (size != 0)
+    {
+        // content is written in place, without intermediate buffers
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd.Get(), 0);
+        if (ptr == MAP_FAILED)
+        {
+            return FileDescriptor{};
+        }
+        std::size_t written = fill(static_cast<char*>(ptr));
+        munmap(ptr, size);
+        if (written != size && ftruncate(memfd.Get(), written) == -1)
+        {
+            return FileDescriptor{};
+        }
+    }
+    // writable mappings are gone, so write seal can be applied
+    if (fcntl(memfd.Get(), F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1)
+    {
+        return FileDescriptor{};
+    }
+    return memfd;
+}
+
+} // namespace xcpp
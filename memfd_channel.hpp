@@ -0,0 +1,131 @@
+#pragma once
+
+#ifndef XCLIPP_MEMFD_CHANNEL_HPP
+#define XCLIPP_MEMFD_CHANNEL_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "converter.hpp"
+#include "memory.hpp"
+#include "utils.hpp"
+
+namespace xcpp
+{
+
+// Local side channel bypassing X server for large data.
+// Selection owner advertises address of abstract Unix socket (as "@name"),
+// client connects, sends 4-byte atom of the wanted target and receives 1-byte status
+// with sealed read-only memfd holding the converted data attached via SCM_RIGHTS.
+// Only clients of the same user are served. Sealed memfd can't change, so each target is converted once
+// and every client gets a duplicate of the same memfd.
+
+// target carrying address of MemfdServer
+inline constexpr std::string_view memfd_socket_target = "application/x-xclipp-memfd-socket";
+
+// clients are served on the server's thread and memfds are filled on a thread per target,
+// so neither the owner nor clients of other targets wait for a conversion, the owner only makes converters
+class MemfdServer
+{
+public:
+    // makes converter of the data to the target, nullptr if it can't be served this way
+    using MakeConverter = std::function<std::unique_ptr<ChunkConverter>(std::uint32_t)>;
+
+    // listens on automatically chosen abstract address, memfds are charged to `account` till they are released,
+    // throws on failure
+    explicit MemfdServer(MemoryAccount& account);
+
+    // waits for memfds being filled, clients waiting for them are dropped and fall back to ordinary conversion
+    ~MemfdServer();
+
+    MemfdServer(const MemfdServer&) = delete;
+    MemfdServer& operator=(const MemfdServer&) = delete;
+
+    // readable when targets not converted yet wait for Serve()
+    int Fd() const noexcept
+    {
+        return ready_fd_.Get();
+    }
+
+    std::string_view Address() const noexcept
+    {
+        return address_;
+    }
+
+    // makes converters for the targets clients wait for, they are run on the server's threads
+    void Serve(const MakeConverter& make_converter);
+
+    // releases memfds once the data isn't owned anymore, later clients are refused
+    void Clear();
+
+private:
+    struct Client
+    {
+        FileDescriptor socket;
+        std::chrono::steady_clock::time_point accepted = std::chrono::steady_clock::now();
+        std::uint32_t target = 0;
+    };
+
+    struct Memfd
+    {
+        // invalid if the target can't be served this way
+        FileDescriptor fd;
+        MemoryCharge charge;
+    };
+
+    void Run();
+
+    // takes all pending connections of the same user
+    void Accept();
+
+    // sends the client memfd of its target or queues the client till the memfd is filled
+    void Request(Client client, std::vector<std::uint32_t>& requested);
+
+    // fills memfd with the output of the converter on its own thread and hands it over to the server's thread
+    void Fill(std::uint32_t target, std::unique_ptr<ChunkConverter> converter);
+
+    void Wake() noexcept;
+
+    FileDescriptor socket_;
+    std::string address_;
+    MemoryAccount& account_;
+    // signalled by the server's thread for the owner's one
+    FileDescriptor ready_fd_;
+    // signalled by the owner's and filling threads for the server's one
+    FileDescriptor wake_fd_;
+    // only touched by the server's thread: clients which haven't sent their target yet,
+    // clients waiting for memfd of their target, filled memfds and threads filling them
+    std::vector<Client> connected_;
+    std::unordered_map<std::uint32_t, std::vector<Client>> waiting_;
+    std::unordered_map<std::uint32_t, Memfd> memfds_;
+    std::unordered_map<std::uint32_t, std::thread> fillers_;
+    bool is_cleared_ = false;
+    // guards the members below
+    std::mutex mutex_;
+    std::vector<std::uint32_t> requested_;
+    std::vector<std::pair<std::uint32_t, std::unique_ptr<ChunkConverter>>> converted_;
+    std::vector<std::pair<std::uint32_t, Memfd>> filled_;
+    bool is_clear_pending_ = false;
+    bool is_stopping_ = false;
+    std::thread thread_;
+};
+
+// returns memfd with the data of `target` from server at `address`, invalid descriptor on failure
+FileDescriptor receive_memfd(std::string_view address, std::uint32_t target);
+
+// creates sealed read-only memfd of `size` bytes, `fill` writes the content into the given buffer
+// and returns its actual size (not greater than `size`), returns invalid descriptor on failure
+FileDescriptor make_sealed_memfd(std::size_t size, const std::function<std::size_t(char*)>& fill);
+
+} // namespace xcpp
+
+#endif // XCLIPP_MEMFD_CHANNEL_HPP
@@ -0,0 +1,39 @@
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "memory.hpp"
+
+namespace xcpp
+{
+
+std::size_t resident_size(const void* ptr, std::size_t size) noexcept
+{
+    if (size == 0)
+    {
+        return 0;
+    }
+    auto page_size = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+    auto begin = reinterpret_cast<std::uintptr_t>(ptr) & ~(page_size - 1);
+    auto end = reinterpret_cast<std::uintptr_t>(ptr) + size;
+    std::size_t pages = (end - begin + page_size - 1) / page_size;
+
+    // a byte per page, least significant bit is set for resident ones
+    std::unique_ptr<unsigned char[]> vec{new (std::nothrow) unsigned char[pages]};
+    if (vec == nullptr || mincore(reinterpret_cast<void*>(begin), end - begin, vec.get()) == -1)
+    {
+        return 0;
+    }
+    std::size_t resident = 0;
+    for (std::size_t i = 0; i < pages; ++i)
+    {
+        resident += vec[i] & 1;
+    }
+    return resident * page_size;
+}
+
+} // namespace xcpp
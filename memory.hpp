@@ -0,0 +1,109 @@
+#pragma once
+
+#ifndef XCLIPP_MEMORY_HPP
+#define XCLIPP_MEMORY_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace xcpp
+{
+
+// bytes used by a kind of owner's data and their peak, updated by the owner and transfer worker threads
+class MemoryAccount
+{
+public:
+    void Add(std::size_t n) noexcept
+    {
+        std::size_t current = current_.fetch_add(n, std::memory_order_relaxed) + n;
+        std::size_t peak = peak_.load(std::memory_order_relaxed);
+        while (peak < current && !peak_.compare_exchange_weak(peak, current, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    void Sub(std::size_t n) noexcept
+    {
+        current_.fetch_sub(n, std::memory_order_relaxed);
+    }
+
+    std::size_t Current() const noexcept
+    {
+        return current_.load(std::memory_order_relaxed);
+    }
+
+    std::size_t Peak() const noexcept
+    {
+        return peak_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<std::size_t> current_ = 0;
+    std::atomic<std::size_t> peak_ = 0;
+};
+
+// bytes charged to an account for the object's lifetime, so elements of containers are accounted for
+// wherever they are erased
+class MemoryCharge
+{
+public:
+    MemoryCharge() noexcept = default;
+
+    MemoryCharge(MemoryAccount& account, std::size_t bytes) noexcept : account_{&account}, bytes_{bytes}
+    {
+        account_->Add(bytes_);
+    }
+
+    MemoryCharge(MemoryCharge&& other) noexcept :
+        account_{std::exchange(other.account_, nullptr)},
+        bytes_{std::exchange(other.bytes_, 0)}
+    {
+    }
+
+    MemoryCharge& operator=(MemoryCharge&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Release();
+            account_ = std::exchange(other.account_, nullptr);
+            bytes_ = std::exchange(other.bytes_, 0);
+        }
+        return *this;
+    }
+
+    ~MemoryCharge()
+    {
+        Release();
+    }
+
+    // for memory allocated later, e.g. a buffer on first use
+    void Add(std::size_t bytes) noexcept
+    {
+        if (account_ != nullptr)
+        {
+            account_->Add(bytes);
+            bytes_ += bytes;
+        }
+    }
+
+private:
+    void Release() noexcept
+    {
+        if (account_ != nullptr)
+        {
+            account_->Sub(bytes_);
+        }
+    }
+
+    MemoryAccount* account_ = nullptr;
+    std::size_t bytes_ = 0;
+};
+
+// bytes of pages of [ptr, ptr + size) present in RAM according to mincore(), pages partially in the range
+// count as whole, 0 if unknown
+std::size_t resident_size(const void* ptr, std::size_t size) noexcept;
+
+} // namespace xcpp
+
+#endif // XCLIPP_MEMORY_HPP
@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "metrics.hpp"
+#include "utils.hpp"
+
+namespace xcpp
+{
+
+// protects the owner from stalling on clients which connect and don't read
+static constexpr timeval client_timeout = {1, 0};
+
+std::size_t Histogram::BucketIndex(std::uint64_t us) noexcept
+{
+    // values below `sub_buckets` get a bucket each, then each power of two range has `sub_buckets` ones
+    if (us < sub_buckets)
+    {
+        return us;
+    }
+    std::size_t bits = std::bit_width(us);
+    if (bits > max_bits)
+    {
+        return bucket_count - 1;
+    }
+    std::size_t shift = bits - 1 - sub_bucket_bits;
+    return (shift + 1) * sub_buckets + ((us >> shift) - sub_buckets);
+}
+
+void Histogram::Record(std::chrono::steady_clock::duration d) noexcept
+{
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    std::uint64_t value = us < 0 ? 0 : us;
+    // bucket of `value - 1` is taken, so buckets end right at powers of two and `le` bounds are inclusive
+    buckets_[BucketIndex(value == 0 ? 0 : value - 1)].Add();
+    count_.Add();
+    sum_us_.Add(value);
+}
+
+void Histogram::Format(std::string& out, std::string_view name, std::string_view labels) const
+{
+    // power of two bounds fall on bucket edges, so cumulative counts at them are exact
+    std::uint64_t cumulative = 0;
+    std::size_t bucket = 0;
+    for (std::size_t bits = 0; bits <= max_bits; ++bits)
+    {
+        std::uint64_t bound = std::uint64_t{1} << bits;
+        for (; bucket < BucketIndex(bound); ++bucket)
+        {
+            cumulative += buckets_[bucket].Get();
+        }
+        out += std::format("{}_bucket{{{},le=\"{}\"}} {}\n", name, labels, bound / 1e6, cumulative);
+    }
+    out += std::format("{}_bucket{{{},le=\"+Inf\"}} {}\n", name, labels, count_.Get());
+    out += std::format("{}_count{{{}}} {}\n", name, labels, count_.Get());
+    out += std::format("{}_sum{{{}}} {}\n", name, labels, sum_us_.Get() / 1e6);
+}
+
+void Metrics::AddTarget(xcb_atom_t target, std::string_view name)
+{
+    targets_.try_emplace(target, name, std::make_unique<TargetMetrics>());
+}
+
+TargetMetrics& Metrics::Get(xcb_atom_t target) noexcept
+{
+    auto it = targets_.find(target);
+    return it == targets_.end() ? other_ : *it->second.second;
+}
+
+// label value with backslash, quote and newline escaped
+static std::string target_label(std::string_view name)
+{
+    std::string label = "target=\"";
+    for (char c : name)
+    {
+        if (c == '\\' || c == '"')
+        {
+            label += '\\';
+        }
+        label += c == '\n' ? std::string_view{"\\n"} : std::string_view{&c, 1};
+    }
+    label += '"';
+    return label;
+}
+
+std::string Metrics::Format(std::string_view gauges) const
+{
+    std::vector<std::pair<std::string, const TargetMetrics*>> targets;
+    for (auto& [atom, target] : targets_)
+    {
+        targets.emplace_back(target_label(target.first), target.second.get());
+    }
+    targets.emplace_back(target_label("other"), &other_);
+    std::ranges::sort(targets);
+
+    std::string out;
+    auto counter = [&out, &targets](std::string_view name, std::string_view help, auto member)
+    {
+        out += std::format("# TYPE {} counter\n# HELP {} {}\n", name, name, help);
+        for (auto& [label, metrics] : targets)
+        {
+            // targets never requested are left out to keep the output short
+            if (metrics->requests.Get() != 0)
+            {
+                out += std::format("{}_total{{{}}} {}\n", name, label, (metrics->*member).Get());
+            }
+        }
+    };
+    counter("xclipp_requests", "Conversion requests received.", &TargetMetrics::requests);
+    counter("xclipp_refused_requests", "Conversion requests refused.", &TargetMetrics::refused);
+    counter("xclipp_transferred_bytes", "Bytes written to requestors' properties.", &TargetMetrics::bytes);
+    counter("xclipp_incr_chunks", "Chunks sent with INCR.", &TargetMetrics::incr_chunks);
+    counter("xclipp_cache_hits", "Requests served from cached conversions.", &TargetMetrics::cache_hits);
+    counter("xclipp_deferred_requests", "Requests deferred by the memory budget.", &TargetMetrics::deferred);
+    counter("xclipp_throttled_requests", "Requests refused by the rate limit.", &TargetMetrics::throttled);
+    counter("xclipp_predictions", "Times the target was predicted to follow TARGETS.", &TargetMetrics::predictions);
+    counter(
+        "xclipp_prediction_hits", "Predictions followed by a request of the target.", &TargetMetrics::prediction_hits);
+    counter("xclipp_prefetches", "Conversions prepared ahead of requests.", &TargetMetrics::prefetches);
+
+    auto histogram = [&out, &targets](std::string_view name, std::string_view help, auto member)
+    {
+        out += std::format("# TYPE {} histogram\n# UNIT {} seconds\n# HELP {} {}\n", name, name, name, help);
+        for (auto& [label, metrics] : targets)
+        {
+            if (metrics->requests.Get() != 0)
+            {
+                (metrics->*member).Format(out, name, label);
+            }
+        }
+    };
+    histogram(
+        "xclipp_request_duration_seconds", "Time from SelectionRequest to SelectionNotify.",
+        &TargetMetrics::request_duration);
+    histogram(
+        "xclipp_conversion_duration_seconds", "Time spent converting data to a target, cache hits included.",
+        &TargetMetrics::conversion_duration);
+
+    out += gauges;
+    out += "# EOF\n";
+    return out;
+}
+
+MetricsServer::MetricsServer(std::string_view address) :
+    socket_{socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)}
+{
+    if (!socket_)
+    {
+        throw std::system_error(errno, std::generic_category(), "Failed to create metrics socket");
+    }
+
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (address.empty() || address.size() >= sizeof(addr.sun_path))
+    {
+        throw std::system_error(ENAMETOOLONG, std::generic_category(), "Invalid metrics socket address");
+    }
+    std::memcpy(addr.sun_path, address.data(), address.size());
+    socklen_t len = offsetof(sockaddr_un, sun_path) + address.size() + 1;
+    // abstract address starts with null character and isn't null-terminated
+    if (address.front() == '@')
+    {
+        addr.sun_path[0] = '\0';
+        --len;
+    }
+    if (bind(socket_.Get(), reinterpret_cast<sockaddr*>(&addr), len) == -1 ||
+        listen(socket_.Get(), SOMAXCONN) == -1)
+    {
+        throw std::system_error(errno, std::generic_category(), "Failed to listen on metrics socket");
+    }
+}
+
+void MetricsServer::Serve(const std::function<std::string()>& format)
+{
+    FileDescriptor client{accept4(socket_.Get(), nullptr, nullptr, SOCK_CLOEXEC)};
+    if (!client)
+    {
+        return;
+    }
+
+    ucred cred = {};
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(client.Get(), SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == -1 || cred.uid != getuid())
+    {
+        return;
+    }
+
+    setsockopt(client.Get(), SOL_SOCKET, SO_SNDTIMEO, &client_timeout, sizeof(client_timeout));
+    std::string text = format();
+    for (std::string_view rest = text; !rest.empty();)
+    {
+        ssize_t written = send(client.Get(), rest.data(), rest.size(), MSG_NOSIGNAL);
+        if (written <= 0)
+        {
+            return;
+        }
+        rest.remove_prefix(written);
+    }
+}
+
+} // namespace xcpp
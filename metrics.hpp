@@ -0,0 +1,124 @@
+#pragma once
+
+#ifndef XCLIPP_METRICS_HPP
+#define XCLIPP_METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+#include "utils.hpp"
+
+namespace xcpp
+{
+
+// counter updated by the owner and transfer worker threads and read by any
+class Counter
+{
+public:
+    void Add(std::uint64_t n = 1) noexcept
+    {
+        value_.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    std::uint64_t Get() const noexcept
+    {
+        return value_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<std::uint64_t> value_ = 0;
+};
+
+// HDR-style log-linear histogram of durations in microseconds, each power of two range is split into
+// `sub_buckets` equal buckets, so values are kept with at most 1 / sub_buckets relative error; single writer
+class Histogram
+{
+public:
+    void Record(std::chrono::steady_clock::duration d) noexcept;
+
+    // appends OpenMetrics lines of histogram `name` with `labels`, buckets are exposed at powers of two
+    void Format(std::string& out, std::string_view name, std::string_view labels) const;
+
+private:
+    inline static constexpr std::size_t sub_bucket_bits = 2;
+    inline static constexpr std::size_t sub_buckets = 1 << sub_bucket_bits;
+    // up to 2^32 us, about 71 minutes, longer durations fall into the last bucket
+    inline static constexpr std::size_t max_bits = 32;
+    inline static constexpr std::size_t bucket_count = (max_bits - sub_bucket_bits + 1) * sub_buckets;
+
+    static std::size_t BucketIndex(std::uint64_t us) noexcept;
+
+    std::array<Counter, bucket_count> buckets_;
+    Counter count_;
+    Counter sum_us_;
+};
+
+// what the owner does with requests of a single target
+struct TargetMetrics
+{
+    Counter requests;
+    Counter refused;
+    Counter bytes;
+    Counter incr_chunks;
+    Counter cache_hits;
+    Counter deferred;
+    Counter throttled;
+    Counter predictions;
+    Counter prediction_hits;
+    Counter prefetches;
+    // from SelectionRequest to SelectionNotify
+    Histogram request_duration;
+    Histogram conversion_duration;
+};
+
+// owner's metrics per target, targets are registered before serving starts, so lookups need no locking
+class Metrics
+{
+public:
+    // `name` must outlive the object
+    void AddTarget(xcb_atom_t target, std::string_view name);
+
+    // metrics of `target`, of pseudo-target "other" if it isn't registered
+    TargetMetrics& Get(xcb_atom_t target) noexcept;
+
+    // OpenMetrics text exposition, `gauges` are appended as they are
+    std::string Format(std::string_view gauges = {}) const;
+
+private:
+    std::unordered_map<xcb_atom_t, std::pair<std::string_view, std::unique_ptr<TargetMetrics>>> targets_;
+    TargetMetrics other_;
+};
+
+// serves metrics text to anyone of the same user connecting to a Unix stream socket, then closes the connection
+class MetricsServer
+{
+public:
+    // `address` is a path or an abstract address starting with '@', throws on failure
+    explicit MetricsServer(std::string_view address);
+
+    int Fd() const noexcept
+    {
+        return socket_.Get();
+    }
+
+    // serves a pending client with the text `format` returns
+    void Serve(const std::function<std::string()>& format);
+
+private:
+    FileDescriptor socket_;
+};
+
+} // namespace xcpp
+
+#endif // XCLIPP_METRICS_HPP
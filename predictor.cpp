@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include <xcb/xproto.h>
+
+#include "predictor.hpp"
+
+namespace xcpp
+{
+
+// counts of an application are halved once it has that many pastes, so the model follows changing habits
+static constexpr std::uint64_t max_pastes = 64;
+
+// clients kept at once, a paste of another one drops the least recently pasting one
+static constexpr std::size_t max_clients = 64;
+
+static std::optional<std::uint64_t> parse_count(std::string_view s)
+{
+    std::uint64_t n = 0;
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), n);
+    if (ec != std::errc{} || end != s.data() + s.size())
+    {
+        return {};
+    }
+    return n;
+}
+
+TargetPredictor::TargetPredictor(std::string path, const std::unordered_map<std::string_view, xcb_atom_t>& targets) :
+    path_{std::move(path)},
+    targets_{targets}
+{
+    for (auto [name, atom] : targets_)
+    {
+        target_names_.try_emplace(atom, name);
+    }
+    Load();
+}
+
+TargetPredictor::~TargetPredictor()
+{
+    if (is_changed_)
+    {
+        Save();
+    }
+}
+
+std::vector<xcb_atom_t> TargetPredictor::StartPaste(
+    std::uint32_t client, std::optional<std::string_view> app_name)
+{
+    if (!pastes_.contains(client) && pastes_.size() >= max_clients)
+    {
+        pastes_.erase(std::ranges::min_element(pastes_, {}, [](auto& p) { return p.second.last_paste; }));
+    }
+    auto& paste = pastes_[client];
+    paste.last_paste = ++paste_count_;
+    if (app_name)
+    {
+        paste.app = &apps_[std::string{*app_name}];
+        paste.anonymous_app.reset();
+    }
+    else if (paste.anonymous_app == nullptr)
+    {
+        paste.anonymous_app = std::make_unique<App>();
+        paste.app = paste.anonymous_app.get();
+    }
+    paste.requested.clear();
+    paste.predicted.clear();
+    auto& app = *paste.app;
+    for (auto& [name, count] : app.targets)
+    {
+        auto target = targets_.find(name);
+        if (target != targets_.end() && 2 * count >= app.pastes)
+        {
+            paste.predicted.push_back(target->second);
+        }
+    }
+    // counted after predicting, so the first paste of an application predicts nothing
+    if (++app.pastes >= max_pastes)
+    {
+        app.pastes /= 2;
+        for (auto& [name, count] : app.targets)
+        {
+            count /= 2;
+        }
+        std::erase_if(app.targets, [](auto& t) { return t.second == 0; });
+    }
+    is_changed_ = true;
+    return paste.predicted;
+}
+
+bool TargetPredictor::Observe(std::uint32_t client, xcb_atom_t target)
+{
+    auto paste = pastes_.find(client);
+    auto name = target_names_.find(target);
+    // a target requested repeatedly in a paste, e.g. by MULTIPLE and on its own, counts once
+    if (paste == pastes_.end() ||
+        name == target_names_.end() ||
+        std::ranges::find(paste->second.requested, target) != paste->second.requested.end())
+    {
+        return false;
+    }
+    paste->second.requested.push_back(target);
+    auto& count = paste->second.app->targets[std::string{name->second}];
+    count = std::min(count + 1, paste->second.app->pastes);
+    is_changed_ = true;
+    return std::ranges::find(paste->second.predicted, target) != paste->second.predicted.end();
+}
+
+// a line per application: name, pastes, then target names and counts, all separated by tabs
+void TargetPredictor::Load()
+{
+    std::ifstream file{path_};
+    for (std::string line; std::getline(file, line);)
+    {
+        std::vector<std::string_view> fields;
+        for (std::string_view rest = line; !rest.empty();)
+        {
+            auto end = std::min(rest.find('\t'), rest.size());
+            fields.push_back(rest.substr(0, end));
+            rest.remove_prefix(std::min(end + 1, rest.size()));
+        }
+        auto pastes = fields.size() >= 2 ? parse_count(fields[1]) : std::nullopt;
+        // malformed lines are skipped, the model is only a hint
+        if (!pastes || fields.size() % 2 != 0)
+        {
+            continue;
+        }
+        auto& app = apps_[std::string{fields[0]}];
+        app.pastes = std::min(*pastes, max_pastes - 1);
+        for (std::size_t i = 2; i < fields.size(); i += 2)
+        {
+            if (auto count = parse_count(fields[i + 1]))
+            {
+                app.targets[std::string{fields[i]}] = std::min(*count, app.pastes);
+            }
+        }
+    }
+}
+
+void TargetPredictor::Save() const
+{
+    std::string text;
+    auto is_valid = [](std::string_view name)
+    {
+        return !name.empty() && name.find_first_of("\t\n") == std::string_view::npos;
+    };
+    for (auto& [name, app] : apps_)
+    {
+        if (!is_valid(name))
+        {
+            continue;
+        }
+        text += name;
+        text += '\t';
+        text += std::to_string(app.pastes);
+        for (auto& [target, count] : app.targets)
+        {
+            if (is_valid(target))
+            {
+                text += '\t';
+                text += target;
+                text += '\t';
+                text += std::to_string(count);
+            }
+        }
+        text += '\n';
+    }
+
+    // renaming replaces the file atomically, a concurrent owner's model is overwritten rather than mixed in
+    std::string tmp_path = path_ + "." + std::to_string(getpid());
+    std::unique_ptr<std::FILE, decltype(&std::fclose)> file{std::fopen(tmp_path.c_str(), "we"), std::fclose};
+    if (file == nullptr)
+    {
+        return;
+    }
+    bool is_written = std::fwrite(text.data(), 1, text.size(), file.get()) == text.size();
+    if (std::fclose(file.release()) != 0 || !is_written || std::rename(tmp_path.c_str(), path_.c_str()) != 0)
+    {
+        std::remove(tmp_path.c_str());
+    }
+}
+
+} // namespace xcpp
@@ -0,0 +1,78 @@
+#pragma once
+
+#ifndef XCLIPP_PREDICTOR_HPP
+#define XCLIPP_PREDICTOR_HPP
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <xcb/xproto.h>
+
+namespace xcpp
+{
+
+// learns which targets applications request after TARGETS, a paste being the requests of a client from its TARGETS
+// request till the next one; clients are told by resource id base, applications by name, e.g. WM_CLASS;
+// the model is kept in a file by target names, so it carries over to later owners; only the most recently pasting
+// clients are kept, as the X server recycles resource id bases of disconnected ones
+class TargetPredictor
+{
+public:
+    // loads the model from `path` if it exists, only `targets` (must outlive the object) are learned and predicted
+    TargetPredictor(std::string path, const std::unordered_map<std::string_view, xcb_atom_t>& targets);
+
+    // saves the model if it has changed, replacing the file at once, so concurrent owners don't corrupt it
+    ~TargetPredictor();
+
+    TargetPredictor(const TargetPredictor&) = delete;
+    TargetPredictor& operator=(const TargetPredictor&) = delete;
+
+    // starts a paste of `client` of application `app_name`, returns targets requested in at least half of the
+    // application's pastes; the application is given on each paste, so a recycled resource id base doesn't inherit
+    // another one's model, client without application name is learned on its own and isn't saved
+    std::vector<xcb_atom_t> StartPaste(std::uint32_t client, std::optional<std::string_view> app_name);
+
+    // learns request of `target` in the current paste of `client`, true if the target was predicted for it
+    bool Observe(std::uint32_t client, xcb_atom_t target);
+
+private:
+    struct App
+    {
+        std::uint64_t pastes = 0;
+        // by name, as atoms differ between X servers
+        std::unordered_map<std::string, std::uint64_t> targets;
+    };
+
+    struct Paste
+    {
+        App* app;
+        // model of a client without application name, dropped with the client
+        std::unique_ptr<App> anonymous_app;
+        // order of the last paste, the least recent client is dropped first
+        std::uint64_t last_paste = 0;
+        // few targets are requested per paste, so vectors are searched linearly
+        std::vector<xcb_atom_t> requested;
+        std::vector<xcb_atom_t> predicted;
+    };
+
+    void Load();
+
+    void Save() const;
+
+    std::string path_;
+    const std::unordered_map<std::string_view, xcb_atom_t>& targets_;
+    std::unordered_map<xcb_atom_t, std::string_view> target_names_;
+    std::unordered_map<std::string, App> apps_;
+    std::unordered_map<std::uint32_t, Paste> pastes_;
+    std::uint64_t paste_count_ = 0;
+    bool is_changed_ = false;
+};
+
+} // namespace xcpp
+
+#endif // XCLIPP_PREDICTOR_HPP
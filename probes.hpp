@@ -0,0 +1,15 @@
+#pragma once
+
+#ifndef XCLIPP_PROBES_HPP
+#define XCLIPP_PROBES_HPP
+
+// USDT probes of provider "xclipp" for bpftrace, perf and the like, each one is a single NOP until attached;
+// they are compiled out if <sys/sdt.h> (systemtap-sdt-dev) isn't available, arguments aren't evaluated then
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define XCLIPP_PROBE(name, ...) STAP_PROBEV(xclipp, name, __VA_ARGS__)
+#else
+#define XCLIPP_PROBE(name, ...) static_cast<void>(0)
+#endif
+
+#endif // XCLIPP_PROBES_HPP
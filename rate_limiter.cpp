@@ -0,0 +1,50 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+#include "rate_limiter.hpp"
+
+namespace xcpp
+{
+
+static constexpr std::size_t min_prune_size = 64;
+
+RateLimiter::RateLimiter(double rate, double burst) noexcept :
+    rate_{rate},
+    burst_{std::max(burst, 1.0)},
+    prune_size_{min_prune_size}
+{
+}
+
+bool RateLimiter::Take(std::uint32_t key, Clock::time_point now)
+{
+    if (buckets_.size() >= prune_size_)
+    {
+        std::erase_if(buckets_, [this, now](auto& b) { return Refill(b.second, now) >= burst_; });
+        prune_size_ = std::max(min_prune_size, 2 * buckets_.size());
+    }
+
+    auto [it, is_new] = buckets_.try_emplace(key, burst_, now);
+    auto& bucket = it->second;
+    bucket.tokens = Refill(bucket, now);
+    bucket.updated = now;
+    if (bucket.tokens < 1)
+    {
+        exhausted_ += !bucket.is_empty;
+        bucket.is_empty = true;
+        return false;
+    }
+    bucket.tokens -= 1;
+    bucket.is_empty = false;
+    return true;
+}
+
+double RateLimiter::Refill(const Bucket& bucket, Clock::time_point now) const noexcept
+{
+    std::chrono::duration<double> elapsed = now - bucket.updated;
+    return std::min(burst_, bucket.tokens + elapsed.count() * rate_);
+}
+
+} // namespace xcpp
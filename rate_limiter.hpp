@@ -0,0 +1,52 @@
+#pragma once
+
+#ifndef XCLIPP_RATE_LIMITER_HPP
+#define XCLIPP_RATE_LIMITER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+namespace xcpp
+{
+
+// token bucket per key refilled at `rate` tokens per second up to `burst`, keys with full buckets are forgotten,
+// so memory is bounded by keys active recently
+class RateLimiter
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    RateLimiter(double rate, double burst) noexcept;
+
+    // takes a token from the bucket of `key`, false if it's empty
+    bool Take(std::uint32_t key, Clock::time_point now);
+
+    // times buckets have run empty, so it counts throttling episodes rather than refused takes
+    std::uint64_t Exhausted() const noexcept
+    {
+        return exhausted_;
+    }
+
+private:
+    struct Bucket
+    {
+        double tokens;
+        Clock::time_point updated;
+        bool is_empty = false;
+    };
+
+    double Refill(const Bucket& bucket, Clock::time_point now) const noexcept;
+
+    double rate_;
+    double burst_;
+    std::unordered_map<std::uint32_t, Bucket> buckets_;
+    // buckets are pruned when there are that many, then the threshold is doubled to keep pruning amortized
+    std::size_t prune_size_;
+    std::uint64_t exhausted_ = 0;
+};
+
+} // namespace xcpp
+
+#endif // XCLIPP_RATE_LIMITER_HPP
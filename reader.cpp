@@ -0,0 +1,313 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <format>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+#include "client.hpp"
+#include "memfd_channel.hpp"
+#include "reader.hpp"
+
+namespace xcpp
+{
+
+static std::string atom_name(xcb_get_atom_name_reply_t* reply)
+{
+    return std::string{xcb_get_atom_name_name(reply), static_cast<std::size_t>(xcb_get_atom_name_name_length(reply))};
+}
+
+static void write_all(int fd, std::string_view data)
+{
+    while (!data.empty())
+    {
+        ssize_t n = write(fd, data.data(), data.size());
+        if (n == -1 && errno != EINTR)
+        {
+            throw std::system_error(errno, std::generic_category(), "Failed to write output");
+        }
+        data.remove_prefix(std::max<ssize_t>(n, 0));
+    }
+}
+
+// copies the whole memfd inside the kernel, pipe gets references to its pages (safe, as memfd is sealed),
+// returns false if the output doesn't support it and nothing was written
+static bool copy_memfd(int memfd, int fd)
+{
+    struct stat memfd_st;
+    struct stat fd_st;
+    if (fstat(memfd, &memfd_st) == -1 || fstat(fd, &fd_st) == -1)
+    {
+        return false;
+    }
+    bool is_pipe = S_ISFIFO(fd_st.st_mode);
+    off_t offset = 0;
+    while (offset < memfd_st.st_size)
+    {
+        std::size_t left = memfd_st.st_size - offset;
+        ssize_t n =
+            is_pipe ?
+            splice(memfd, &offset, fd, nullptr, left, SPLICE_F_MORE) :
+            sendfile(fd, memfd, &offset, left);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n == -1 && offset == 0 && (errno == EINVAL || errno == ENOSYS))
+        {
+            return false;
+        }
+        if (n == -1)
+        {
+            throw std::system_error(errno, std::generic_category(), "Failed to write output");
+        }
+        if (n == 0)
+        {
+            break; // memfd is sealed against shrinking, but output may be closed
+        }
+    }
+    return true;
+}
+
+Reader::Reader(const ReaderOptions& options) :
+    Client{AtomNames(options), options.display, options.transport},
+    target_{options.target},
+    selection_{options.primary ? xcb_atom_t{XCB_ATOM_PRIMARY} : clipboard_atom_}
+{
+}
+
+std::vector<std::string_view> Reader::AtomNames(const ReaderOptions& options)
+{
+    std::vector<std::string_view> names;
+    if (!options.target.empty())
+    {
+        names.push_back(options.target);
+    }
+    else
+    {
+        for (auto t : preferred_targets)
+        {
+            names.push_back(t);
+        }
+    }
+    names.push_back(memfd_socket_target);
+    return names;
+}
+
+bool Reader::Read(int fd)
+{
+    auto owner_targets = GetTargets(selection_);
+    auto target = ChooseTarget(owner_targets);
+    if (!target)
+    {
+        return false;
+    }
+
+    bool offers_memfd =
+        owner_targets &&
+        atoms_.contains(memfd_socket_target) &&
+        std::ranges::find(*owner_targets, atoms_[memfd_socket_target]) != owner_targets->end();
+    if (offers_memfd && ReadFromMemfd(*target, fd))
+    {
+        return true;
+    }
+
+    if (!RequestConversion(selection_, *target, property_atom_))
+    {
+        return false;
+    }
+    // every chunk is written straight from the reply buffer as soon as it's received
+    auto accept = [](xcb_atom_t, std::uint8_t, std::size_t, bool) { return true; };
+    auto output = [fd](std::string_view chunk) { write_all(fd, chunk); return true; };
+    return ReceiveProperty(property_atom_, accept, output);
+}
+
+bool Reader::Read(
+    const std::function<bool(std::string_view, std::uint8_t, std::size_t, bool)>& on_size,
+    const std::function<bool(std::string_view)>& on_chunk)
+{
+    // listed targets are needed only for negotiation
+    auto target = ChooseTarget(target_.empty() ? GetTargets(selection_) : std::nullopt);
+    if (!target || !RequestConversion(selection_, *target, property_atom_))
+    {
+        return false;
+    }
+    auto on_type = [this, &on_size](xcb_atom_t type, std::uint8_t format, std::size_t size, bool is_incremental)
+    {
+        auto type_name = GetAtomName(type);
+        return type_name && on_size(*type_name, format, size, is_incremental);
+    };
+    return ReceiveProperty(property_atom_, on_type, on_chunk);
+}
+
+std::optional<std::vector<bool>> Reader::ReadMultiple(
+    std::span<const std::string_view> targets, std::span<const int> fds)
+{
+    // every target is received into its own property, all atoms are interned in a single round-trip
+    std::vector<std::string> names{"MULTIPLE"};
+    for (auto target : targets)
+    {
+        names.emplace_back(target);
+    }
+    for (std::size_t i = 0; i < targets.size(); ++i)
+    {
+        names.push_back(std::format("XCLIPP_MULTIPLE_{}", i));
+    }
+    std::vector<xcb_intern_atom_cookie_t> cookies;
+    for (auto& name : names)
+    {
+        cookies.push_back(xcb_intern_atom(connection_.get(), 0, name.size(), name.data()));
+    }
+    std::vector<xcb_atom_t> atoms;
+    for (std::size_t i = 0; i < cookies.size(); ++i)
+    {
+        atoms.push_back(Await(
+            cookies[i], xcb_intern_atom_reply, &xcb_intern_atom_reply_t::atom,
+            std::format("Failed to get {} atom", names[i])));
+    }
+
+    std::vector<xcb_atom_t> pairs;
+    for (std::size_t i = 0; i < targets.size(); ++i)
+    {
+        pairs.push_back(atoms[1 + i]);
+        pairs.push_back(atoms[1 + targets.size() + i]);
+    }
+    auto change_prop_cookie = xcb_change_property_checked(
+        connection_.get(), XCB_PROP_MODE_REPLACE, window_, property_atom_, atom_pair_atom_, 32, pairs.size(),
+        pairs.data());
+    Await(change_prop_cookie, "Failed to change property");
+    if (!RequestConversion(selection_, atoms[0], property_atom_))
+    {
+        return {};
+    }
+
+    // owner replaces properties of failed conversions with None
+    std::vector<xcb_atom_t> results;
+    auto accept_pairs = [this](xcb_atom_t type, std::uint8_t, std::size_t, bool) { return type == atom_pair_atom_; };
+    auto append = [&results](std::string_view chunk)
+    {
+        for (std::size_t i = 0; i + sizeof(xcb_atom_t) <= chunk.size(); i += sizeof(xcb_atom_t))
+        {
+            xcb_atom_t atom;
+            std::memcpy(&atom, chunk.data() + i, sizeof(atom));
+            results.push_back(atom);
+        }
+        return true;
+    };
+    if (!ReceiveProperty(property_atom_, accept_pairs, append) || results.size() != pairs.size())
+    {
+        return {};
+    }
+
+    std::vector<bool> converted(targets.size());
+    std::vector<xcb_atom_t> properties;
+    std::vector<int> outputs;
+    for (std::size_t i = 0; i < targets.size(); ++i)
+    {
+        if (results[2 * i + 1] != XCB_ATOM_NONE)
+        {
+            converted[i] = true;
+            properties.push_back(pairs[2 * i + 1]);
+            outputs.push_back(fds[i]);
+        }
+    }
+    auto accept = [](std::size_t, xcb_atom_t, std::uint8_t, std::size_t, bool) { return true; };
+    auto output = [&outputs](std::size_t i, std::string_view chunk) { write_all(outputs[i], chunk); return true; };
+    if (!ReceiveProperties(properties, accept, output))
+    {
+        return {};
+    }
+    return converted;
+}
+
+std::optional<std::vector<std::string>> Reader::ListTargets()
+{
+    auto targets = GetTargets(selection_);
+    if (!targets)
+    {
+        return {};
+    }
+    std::vector<xcb_get_atom_name_cookie_t> cookies;
+    for (auto atom : *targets)
+    {
+        cookies.push_back(xcb_get_atom_name(connection_.get(), atom));
+    }
+    std::vector<std::string> names;
+    for (auto cookie : cookies)
+    {
+        auto name = Await(cookie, xcb_get_atom_name_reply, atom_name, ErrorLogger{"Failed to get atom name"});
+        if (name)
+        {
+            names.push_back(std::move(*name));
+        }
+    }
+    return names;
+}
+
+std::optional<xcb_atom_t> Reader::ChooseTarget(const std::optional<std::vector<xcb_atom_t>>& owner_targets)
+{
+    // explicitly requested target is tried even if it's not listed, not all owners support TARGETS
+    if (!target_.empty())
+    {
+        if (!atoms_.contains(target_))
+        {
+            return {};
+        }
+        return atoms_[target_];
+    }
+    if (!owner_targets)
+    {
+        return {};
+    }
+    for (auto t : preferred_targets)
+    {
+        if (atoms_.contains(t) && std::ranges::find(*owner_targets, atoms_[t]) != owner_targets->end())
+        {
+            return atoms_[t];
+        }
+    }
+    return {};
+}
+
+std::optional<std::string> Reader::GetAtomName(xcb_atom_t atom)
+{
+    return Await(
+        xcb_get_atom_name(connection_.get(), atom), xcb_get_atom_name_reply, atom_name,
+        ErrorLogger{"Failed to get atom name"});
+}
+
+bool Reader::ReadFromMemfd(xcb_atom_t target, int fd)
+{
+    if (!RequestConversion(selection_, atoms_[memfd_socket_target], property_atom_))
+    {
+        return false;
+    }
+    std::string address;
+    auto accept = [](xcb_atom_t, std::uint8_t, std::size_t size, bool)
+    {
+        return size <= sizeof(sockaddr_un::sun_path);
+    };
+    auto append = [&address](std::string_view chunk) { address += chunk; return true; };
+    if (!ReceiveProperty(property_atom_, accept, append))
+    {
+        return false;
+    }
+    auto memfd = receive_memfd(address, target);
+    return memfd && copy_memfd(memfd.Get(), fd);
+}
+
+} // namespace xcpp
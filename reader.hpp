@@ -0,0 +1,87 @@
+#pragma once
+
+#ifndef XCLIPP_READER_HPP
+#define XCLIPP_READER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+#include "client.hpp"
+#include "transport.hpp"
+
+namespace xcpp
+{
+
+struct ReaderOptions
+{
+    // read PRIMARY instead of CLIPBOARD
+    bool primary = false;
+    // target to request, empty to negotiate the preferred text target via TARGETS
+    std::string_view target;
+    // X display to read from, $DISPLAY if empty
+    std::string display;
+    // connects through it instead of display if set, must outlive readers
+    const Transport* transport = nullptr;
+};
+
+class Reader : private Client
+{
+public:
+    explicit Reader(const ReaderOptions& options = {});
+
+    // writes selection content to `fd`, returns false if there is no owner or it can't provide the target,
+    // throws on output errors
+    bool Read(int fd);
+
+    // passes name of data type, its format, size (lower bound if the last argument is true, meaning INCR is used)
+    // and then data chunks as they are received, returning false from either stops reading
+    bool Read(
+        const std::function<bool(std::string_view, std::uint8_t, std::size_t, bool)>& on_size,
+        const std::function<bool(std::string_view)>& on_chunk);
+
+    // requests all `targets` at once with MULTIPLE writing each one to the corresponding element of `fds`,
+    // INCR transfers are received concurrently; tells which targets were converted, nullopt if there is no owner
+    // or it failed to handle MULTIPLE, throws on output errors
+    std::optional<std::vector<bool>> ReadMultiple(
+        std::span<const std::string_view> targets, std::span<const int> fds);
+
+    // names of targets offered by the selection owner, nullopt if there is no owner or it failed to answer
+    std::optional<std::vector<std::string>> ListTargets();
+
+private:
+    static std::vector<std::string_view> AtomNames(const ReaderOptions& options);
+
+    // requested target, nullopt if none of preferred_targets is offered
+    std::optional<xcb_atom_t> ChooseTarget(const std::optional<std::vector<xcb_atom_t>>& owner_targets);
+
+    std::optional<std::string> GetAtomName(xcb_atom_t atom);
+
+    // gets data through memfd channel of the owner, returns false if nothing was written and X path must be used
+    bool ReadFromMemfd(xcb_atom_t target, int fd);
+
+    // in order of preference
+    inline static constexpr std::string_view preferred_targets[] =
+    {
+        "UTF8_STRING",
+        "text/plain;charset=utf-8",
+        "STRING",
+        "TEXT",
+        "text/plain"
+    };
+
+    std::string_view target_;
+    xcb_atom_t selection_;
+};
+
+} // namespace xcpp
+
+#endif // XCLIPP_READER_HPP
@@ -0,0 +1,284 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+#include "recorder.hpp"
+
+namespace xcpp
+{
+
+static constexpr std::string_view magic = "XCLPREC1";
+// record type of atom name, others are RecordedEvent::Type
+static constexpr std::uint8_t atom_record = 0;
+
+Recorder::Recorder(const std::string& path, xcb_connection_t* connection, std::size_t data_size) :
+    file_{std::fopen(path.c_str(), "wbe"), std::fclose},
+    connection_{connection},
+    multiple_atom_{XCB_ATOM_NONE},
+    atom_pair_atom_{XCB_ATOM_NONE},
+    start_{std::chrono::steady_clock::now()}
+{
+    if (file_ == nullptr)
+    {
+        throw std::runtime_error("Failed to create recording file " + path);
+    }
+    auto multiple_cookie = xcb_intern_atom(connection_, 0, 8, "MULTIPLE");
+    auto atom_pair_cookie = xcb_intern_atom(connection_, 0, 9, "ATOM_PAIR");
+    std::pair<xcb_intern_atom_cookie_t, xcb_atom_t*> atoms[] =
+    {
+        {multiple_cookie, &multiple_atom_},
+        {atom_pair_cookie, &atom_pair_atom_}
+    };
+    for (auto [cookie, atom] : atoms)
+    {
+        if (auto reply = xcb_intern_atom_reply(connection_, cookie, nullptr))
+        {
+            *atom = reply->atom;
+            std::free(reply);
+        }
+    }
+    buf_ = magic;
+    AddNumber(data_size);
+    Write();
+}
+
+void Recorder::RecordRequest(const xcb_selection_request_event_t& req)
+{
+    std::vector<xcb_atom_t> subrequests;
+    if (req.target == multiple_atom_ && req.property != XCB_ATOM_NONE)
+    {
+        // the owner reads them too, the requestor must not change them before it's notified
+        auto cookie = xcb_get_property(
+            connection_, 0, req.requestor, req.property, atom_pair_atom_, 0,
+            std::numeric_limits<std::uint32_t>::max() / 4);
+        if (auto reply = xcb_get_property_reply(connection_, cookie, nullptr))
+        {
+            auto pairs = static_cast<const xcb_atom_t*>(xcb_get_property_value(reply));
+            std::size_t n = xcb_get_property_value_length(reply) / sizeof(xcb_atom_t) / 2 * 2;
+            subrequests.assign(pairs, pairs + (reply->format == 32 ? n : 0));
+            std::free(reply);
+        }
+    }
+
+    for (auto atom : {req.selection, req.target, req.property})
+    {
+        AddAtom(atom);
+    }
+    for (auto atom : subrequests)
+    {
+        AddAtom(atom);
+    }
+    AddEventHeader(RecordedEvent::Type::REQUEST, req.requestor);
+    for (auto atom : {req.selection, req.target, req.property})
+    {
+        AddNumber(atom);
+    }
+    AddNumber(subrequests.size() / 2);
+    for (auto atom : subrequests)
+    {
+        AddNumber(atom);
+    }
+    Write();
+}
+
+void Recorder::RecordPropertyDelete(xcb_window_t requestor, xcb_atom_t property)
+{
+    AddAtom(property);
+    AddEventHeader(RecordedEvent::Type::PROPERTY_DELETE, requestor);
+    AddNumber(property);
+    Write();
+}
+
+void Recorder::RecordDestroy(xcb_window_t requestor)
+{
+    AddEventHeader(RecordedEvent::Type::DESTROY, requestor);
+    Write();
+    // X server may reuse the id for another window
+    requestors_.erase(requestor);
+}
+
+void Recorder::AddAtom(xcb_atom_t atom)
+{
+    if (atom == XCB_ATOM_NONE || !atoms_.insert(atom).second)
+    {
+        return;
+    }
+    auto reply = xcb_get_atom_name_reply(connection_, xcb_get_atom_name(connection_, atom), nullptr);
+    std::string_view name;
+    if (reply != nullptr)
+    {
+        name = {xcb_get_atom_name_name(reply), std::size_t(xcb_get_atom_name_name_length(reply))};
+    }
+    buf_.push_back(atom_record);
+    AddNumber(atom);
+    AddNumber(name.size());
+    buf_ += name;
+    std::free(reply);
+}
+
+void Recorder::AddEventHeader(RecordedEvent::Type type, xcb_window_t requestor)
+{
+    auto now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_);
+    std::uint64_t time_us = now.count();
+    auto [it, is_new] = requestors_.try_emplace(requestor, next_requestor_);
+    next_requestor_ += is_new;
+
+    buf_.push_back(static_cast<char>(type));
+    AddNumber(time_us - last_time_us_);
+    AddNumber(it->second);
+    last_time_us_ = time_us;
+}
+
+void Recorder::AddNumber(std::uint64_t n)
+{
+    for (; n >= 0x80; n >>= 7)
+    {
+        buf_.push_back(static_cast<char>(n | 0x80));
+    }
+    buf_.push_back(static_cast<char>(n));
+}
+
+void Recorder::Write()
+{
+    std::fwrite(buf_.data(), 1, buf_.size(), file_.get());
+    std::fflush(file_.get());
+    buf_.clear();
+}
+
+// cursor over recording content, `ok` is cleared once reading past the end
+class RecordingParser
+{
+public:
+    explicit RecordingParser(std::string_view data) noexcept : data_{data}
+    {
+    }
+
+    bool AtEnd() const noexcept
+    {
+        return pos_ == data_.size();
+    }
+
+    bool IsOk() const noexcept
+    {
+        return ok_;
+    }
+
+    std::uint8_t Byte() noexcept
+    {
+        if (pos_ == data_.size())
+        {
+            ok_ = false;
+            return 0;
+        }
+        return data_[pos_++];
+    }
+
+    std::uint64_t Number() noexcept
+    {
+        std::uint64_t n = 0;
+        for (int shift = 0; shift < 64 && ok_; shift += 7)
+        {
+            std::uint8_t b = Byte();
+            n |= std::uint64_t(b & 0x7f) << shift;
+            if ((b & 0x80) == 0)
+            {
+                break;
+            }
+        }
+        return n;
+    }
+
+    std::string_view Bytes(std::size_t n) noexcept
+    {
+        if (data_.size() - pos_ < n)
+        {
+            ok_ = false;
+            return {};
+        }
+        pos_ += n;
+        return data_.substr(pos_ - n, n);
+    }
+
+private:
+    std::string_view data_;
+    std::size_t pos_ = 0;
+    bool ok_ = true;
+};
+
+std::optional<Recording> read_recording(const std::string& path)
+{
+    std::ifstream file{path, std::ios::binary};
+    std::string content{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    RecordingParser parser{content};
+    if (!file || parser.Bytes(magic.size()) != magic)
+    {
+        return {};
+    }
+
+    Recording recording{parser.Number(), {}};
+    std::unordered_map<std::uint64_t, std::string> names;
+    auto name = [&names, &parser]
+    {
+        auto it = names.find(parser.Number());
+        return it == names.end() ? std::string{} : it->second;
+    };
+    std::uint64_t time_us = 0;
+    while (parser.IsOk() && !parser.AtEnd())
+    {
+        std::uint8_t type = parser.Byte();
+        if (type == atom_record)
+        {
+            auto atom = parser.Number();
+            names[atom] = parser.Bytes(parser.Number());
+            continue;
+        }
+        if (type < static_cast<std::uint8_t>(RecordedEvent::Type::REQUEST) ||
+            type > static_cast<std::uint8_t>(RecordedEvent::Type::DESTROY))
+        {
+            return {};
+        }
+
+        auto& event = recording.events.emplace_back();
+        event.type = static_cast<RecordedEvent::Type>(type);
+        time_us += parser.Number();
+        event.time_us = time_us;
+        event.requestor = parser.Number();
+        if (event.type == RecordedEvent::Type::REQUEST)
+        {
+            event.selection = name();
+            event.target = name();
+            event.property = name();
+            for (auto n = parser.Number(); n > 0 && parser.IsOk(); --n)
+            {
+                auto subtarget = name();
+                event.subrequests.emplace_back(std::move(subtarget), name());
+            }
+        }
+        else if (event.type == RecordedEvent::Type::PROPERTY_DELETE)
+        {
+            event.property = name();
+        }
+    }
+    if (!parser.IsOk())
+    {
+        return {};
+    }
+    return recording;
+}
+
+} // namespace xcpp
@@ -0,0 +1,98 @@
+#pragma once
+
+#ifndef XCLIPP_RECORDER_HPP
+#define XCLIPP_RECORDER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+namespace xcpp
+{
+
+// event of the owner's incoming selection traffic, atoms are kept as names and requestor windows as indices
+// in order of appearance, so a recording can be replayed on another X server
+struct RecordedEvent
+{
+    enum class Type : std::uint8_t
+    {
+        REQUEST = 1,
+        // requestor deleted the property during INCR transfer
+        PROPERTY_DELETE,
+        // requestor window was destroyed during INCR transfer
+        DESTROY
+    };
+
+    Type type;
+    // since the start of recording
+    std::uint64_t time_us;
+    std::uint32_t requestor;
+    // only `property` is set for PROPERTY_DELETE
+    std::string selection;
+    std::string target;
+    std::string property;
+    // target and property of each MULTIPLE subrequest
+    std::vector<std::pair<std::string, std::string>> subrequests;
+};
+
+struct Recording
+{
+    // of the data served by the owner, content itself is not recorded
+    std::size_t data_size;
+    std::vector<RecordedEvent> events;
+};
+
+// appends events to a compact binary file: magic, data size, then records of a type byte followed by
+// LEB128 integers; atom name is written once before the first record referring to the atom
+class Recorder
+{
+public:
+    // throws if `path` can't be created, `connection` is used to look up atom names and MULTIPLE subrequests
+    Recorder(const std::string& path, xcb_connection_t* connection, std::size_t data_size);
+
+    void RecordRequest(const xcb_selection_request_event_t& req);
+
+    void RecordPropertyDelete(xcb_window_t requestor, xcb_atom_t property);
+
+    void RecordDestroy(xcb_window_t requestor);
+
+private:
+    // adds ATOM record for `atom` if it's not written yet
+    void AddAtom(xcb_atom_t atom);
+
+    void AddEventHeader(RecordedEvent::Type type, xcb_window_t requestor);
+
+    void AddNumber(std::uint64_t n);
+
+    // writes out pending records, flushed right away so a killed owner leaves a complete file
+    void Write();
+
+    std::unique_ptr<std::FILE, decltype(&std::fclose)> file_;
+    xcb_connection_t* connection_;
+    xcb_atom_t multiple_atom_;
+    xcb_atom_t atom_pair_atom_;
+    std::chrono::steady_clock::time_point start_;
+    std::uint64_t last_time_us_ = 0;
+    std::unordered_set<xcb_atom_t> atoms_;
+    std::unordered_map<xcb_window_t, std::uint32_t> requestors_;
+    std::uint32_t next_requestor_ = 0;
+    std::string buf_;
+};
+
+// parses file written by Recorder, nullopt if it's not a recording or is truncated in the middle of a record
+std::optional<Recording> read_recording(const std::string& path);
+
+} // namespace xcpp
+
+#endif // XCLIPP_RECORDER_HPP
@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+#include "clipper.hpp"
+#include "fake_server.hpp"
+#include "reader.hpp"
+#include "utils.hpp"
+
+using namespace xcpp;
+
+static bool is_failed = false;
+
+static void check(bool condition, std::string_view what)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr, "FAILED: %.*s\n", static_cast<int>(what.size()), what.data());
+        is_failed = true;
+    }
+}
+
+// makes another client own CLIPBOARD, so the owner's Run() returns
+static void take_clipboard(const bench::FakeServer& server)
+{
+    auto [connection, screen_id] = server.Connect();
+    xcb_connection_t* c = connection.get();
+    xcb_window_t window = xcb_generate_id(c);
+    xcb_create_window(
+        c, 0, window, xcb_setup_roots_iterator(xcb_get_setup(c)).data->root, 0, 0, 1, 1, 0,
+        XCB_WINDOW_CLASS_INPUT_ONLY, XCB_COPY_FROM_PARENT, 0, nullptr);
+    auto reply = xcb_intern_atom_reply(c, xcb_intern_atom(c, 0, 9, "CLIPBOARD"), nullptr);
+    xcb_set_selection_owner(c, window, reply->atom, XCB_CURRENT_TIME);
+    std::free(reply);
+    std::free(xcb_get_input_focus_reply(c, xcb_get_input_focus(c), nullptr)); // wait until it's handled
+}
+
+// owner of `data` running in background till the clipboard is taken from it
+class Owner
+{
+public:
+    Owner(const bench::FakeServer& server, std::string_view data, ClipperOptions options = {}) :
+        server_{server},
+        clipper_{data, WithTransport(server, std::move(options))},
+        thread_{[this] { clipper_.Run(); }}
+    {
+    }
+
+    ~Owner()
+    {
+        take_clipboard(server_);
+        thread_.join();
+    }
+
+private:
+    static ClipperOptions WithTransport(const bench::FakeServer& server, ClipperOptions options)
+    {
+        options.transport = &server;
+        return options;
+    }
+
+    const bench::FakeServer& server_;
+    Clipper clipper_;
+    std::thread thread_;
+};
+
+// whole content of `target`, with its type name and whether INCR was used
+struct Pasted
+{
+    bool is_read = false;
+    std::string type;
+    bool is_incremental = false;
+    std::string data;
+};
+
+static ReaderOptions reader_options(const bench::FakeServer& server, std::string_view target = {})
+{
+    ReaderOptions options;
+    options.target = target;
+    options.transport = &server;
+    return options;
+}
+
+static Pasted paste(const bench::FakeServer& server, std::string_view target)
+{
+    Pasted pasted;
+    Reader reader{reader_options(server, target)};
+    auto on_size = [&pasted](std::string_view type, std::uint8_t, std::size_t, bool is_incremental)
+    {
+        pasted.type = type;
+        pasted.is_incremental = is_incremental;
+        return true;
+    };
+    auto on_chunk = [&pasted](std::string_view chunk)
+    {
+        pasted.data += chunk;
+        return true;
+    };
+    pasted.is_read = reader.Read(on_size, on_chunk);
+    return pasted;
+}
+
+// content of memfd written by the reader
+static std::string read_all(int fd)
+{
+    std::string data;
+    char buf[4096];
+    lseek(fd, 0, SEEK_SET);
+    while (true)
+    {
+        auto n = read(fd, buf, sizeof(buf));
+        if (n <= 0)
+        {
+            return data;
+        }
+        data.append(buf, n);
+    }
+}
+
+// metrics served at abstract socket `address` (starting with '@')
+static std::string scrape(std::string_view address)
+{
+    FileDescriptor s{socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path + 1, address.data() + 1, address.size() - 1);
+    socklen_t len = offsetof(sockaddr_un, sun_path) + address.size();
+    if (!s || connect(s.Get(), reinterpret_cast<sockaddr*>(&addr), len) == -1)
+    {
+        return {};
+    }
+    return read_all(s.Get());
+}
+
+static std::string latin1_to_utf8(std::string_view latin1)
+{
+    std::string utf8;
+    for (unsigned char c : latin1)
+    {
+        if (c < 0x80)
+        {
+            utf8 += static_cast<char>(c);
+        }
+        else
+        {
+            utf8 += static_cast<char>(0xC0 | (c >> 6));
+            utf8 += static_cast<char>(0x80 | (c & 0x3F));
+        }
+    }
+    return utf8;
+}
+
+static void test_targets()
+{
+    bench::FakeServer server;
+    Owner owner{server, "text"};
+    auto targets = Reader{reader_options(server)}.ListTargets();
+    check(targets.has_value(), "owner answers TARGETS");
+    if (targets)
+    {
+        for (std::string_view t : {"TARGETS", "MULTIPLE", "TIMESTAMP", "UTF8_STRING", "STRING", "TEXT"})
+        {
+            check(std::ranges::find(*targets, t) != targets->end(), std::string{t} + " is offered");
+        }
+        check(std::ranges::find(*targets, "text/uri-list") == targets->end(), "file targets aren't offered for text");
+    }
+}
+
+static void test_conversion()
+{
+    bench::FakeServer server;
+    std::string latin1 = "na\xEFve caf\xE9\n";
+    Owner owner{server, latin1};
+
+    auto string = paste(server, "STRING");
+    check(string.is_read && string.type == "STRING" && string.data == latin1, "Latin-1 text is served as is");
+    auto utf8 = paste(server, "UTF8_STRING");
+    check(
+        utf8.is_read && utf8.type == "UTF8_STRING" && utf8.data == latin1_to_utf8(latin1),
+        "Latin-1 text is transcoded to UTF-8");
+    auto text = paste(server, "TEXT");
+    check(text.is_read && text.type == "STRING" && text.data == latin1, "TEXT is served in the original encoding");
+    check(!paste(server, "image/png").is_read, "unknown target is refused");
+}
+
+static void test_incr()
+{
+    // a property of a single request holds at most 4 KB, and there is no BIG-REQUESTS
+    bench::FakeServer server{{.max_request_length = 1024, .big_request_length = 0}};
+    std::string latin1;
+    while (latin1.size() < (1 << 20))
+    {
+        latin1 += "gar\xE7on " + std::to_string(latin1.size()) + "\n";
+    }
+    Owner owner{server, latin1};
+
+    auto string = paste(server, "STRING");
+    check(string.is_read && string.is_incremental, "large data is sent with INCR");
+    check(string.data == latin1, "INCR transfer delivers data as is");
+    auto utf8 = paste(server, "UTF8_STRING");
+    check(utf8.is_read && utf8.is_incremental, "large transcoded data is sent with INCR");
+    check(utf8.data == latin1_to_utf8(latin1), "INCR transfer transcodes data chunk by chunk");
+}
+
+static void test_multiple()
+{
+    bench::FakeServer server;
+    std::string address = "@xclipp-test-" + std::to_string(getpid());
+    std::string utf8 = "caf\xC3\xA9\n";
+    ClipperOptions options;
+    options.metrics_socket = address;
+    Owner owner{server, utf8, options};
+
+    std::string_view targets[] = {"UTF8_STRING", "STRING", "image/png"};
+    FileDescriptor files[] =
+    {
+        FileDescriptor{memfd_create("utf8", MFD_CLOEXEC)},
+        FileDescriptor{memfd_create("latin1", MFD_CLOEXEC)},
+        FileDescriptor{memfd_create("png", MFD_CLOEXEC)}
+    };
+    int fds[] = {files[0].Get(), files[1].Get(), files[2].Get()};
+    auto converted = Reader{reader_options(server)}.ReadMultiple(targets, fds);
+    check(converted.has_value(), "owner handles MULTIPLE");
+    if (converted)
+    {
+        check(converted->size() == 3 && (*converted)[0] && (*converted)[1] && !(*converted)[2],
+            "only offered targets are converted");
+        check(read_all(fds[0]) == utf8, "UTF8_STRING subrequest is served as is");
+        check(read_all(fds[1]) == "caf\xE9\n", "STRING subrequest is transcoded");
+    }
+
+    // each request is counted once, though MULTIPLE is processed again once its subrequests are done
+    std::string metrics = scrape(address);
+    for (std::string_view target : {"MULTIPLE", "UTF8_STRING", "STRING"})
+    {
+        std::string sample = "xclipp_requests_total{target=\"" + std::string{target} + "\"} 1\n";
+        check(metrics.find(sample) != std::string::npos, sample);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::map<std::string_view, std::function<void()>> tests =
+    {
+        {"targets", test_targets},
+        {"conversion", test_conversion},
+        {"incr", test_incr},
+        {"multiple", test_multiple}
+    };
+    if (argc != 2 || !tests.contains(argv[1]))
+    {
+        std::fprintf(stderr, "Usage: %s targets|conversion|incr|multiple\n", argv[0]);
+        return 2;
+    }
+    try
+    {
+        tests[argv[1]]();
+    }
+    catch (std::exception& e)
+    {
+        std::fprintf(stderr, "FAILED: %s\n", e.what());
+        return 1;
+    }
+    return is_failed ? 1 : 0;
+}
@@ -0,0 +1,133 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <format>
+#include <stdexcept>
+#include <string>
+#include <mutex>
+#include <string_view>
+
+#include <unistd.h>
+
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+#include "tracer.hpp"
+
+namespace xcpp
+{
+
+// appends `s` as JSON string
+static void append_json_string(std::string& out, std::string_view s)
+{
+    static constexpr char hex_digits[] = "0123456789abcdef";
+    out += '"';
+    for (unsigned char c : s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if (c < 0x20)
+        {
+            out += "\\u00";
+            out += hex_digits[c >> 4];
+            out += hex_digits[c & 0xf];
+        }
+        else
+        {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+// trace timestamps are in microseconds
+static double to_us(Tracer::Clock::duration d)
+{
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+Tracer::Tracer(const std::string& path, xcb_connection_t* connection) :
+    file_{std::fopen(path.c_str(), "we"), std::fclose},
+    connection_{connection},
+    start_{Clock::now()},
+    pid_{getpid()}
+{
+    if (file_ == nullptr)
+    {
+        throw std::runtime_error("Failed to create trace file " + path);
+    }
+    // closing bracket is optional in JSON array format, so a killed owner still leaves a usable trace
+    buf_ = std::format(
+        "[\n{{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":{},\"args\":{{\"name\":\"xclipp\"}}}}", pid_);
+    std::fwrite(buf_.data(), 1, buf_.size(), file_.get());
+}
+
+Tracer::~Tracer()
+{
+    std::fputs("\n]\n", file_.get());
+}
+
+void Tracer::AddTarget(xcb_atom_t target, std::string_view name)
+{
+    std::lock_guard lock{mutex_};
+    names_.try_emplace(target, name);
+}
+
+void Tracer::Complete(std::string_view name, Clock::time_point start, xcb_window_t requestor, xcb_atom_t target)
+{
+    auto end = Clock::now();
+    std::lock_guard lock{mutex_};
+    AddEvent(name, 'X', start, requestor, target, std::format(",\"dur\":{:.3f}", to_us(end - start)));
+}
+
+void Tracer::Async(std::string_view name, Clock::time_point start, xcb_window_t requestor, xcb_atom_t target)
+{
+    auto end = Clock::now();
+    std::lock_guard lock{mutex_};
+    auto id = std::format(",\"id\":{}", next_id_++);
+    AddEvent(name, 'b', start, requestor, target, id);
+    AddEvent(name, 'e', end, requestor, target, id);
+}
+
+void Tracer::Instant(std::string_view name, xcb_window_t requestor, xcb_atom_t target)
+{
+    auto now = Clock::now();
+    std::lock_guard lock{mutex_};
+    AddEvent(name, 'i', now, requestor, target, ",\"s\":\"t\"");
+}
+
+void Tracer::AddEvent(
+    std::string_view name, char phase, Clock::time_point time, xcb_window_t requestor, xcb_atom_t target,
+    std::string_view extra)
+{
+    buf_ = ",\n{\"name\":";
+    append_json_string(buf_, name);
+    buf_ += std::format(
+        ",\"cat\":\"xclipp\",\"ph\":\"{}\",\"ts\":{:.3f},\"pid\":{},\"tid\":{}{},\"args\":{{\"requestor\":\"{:#x}\",",
+        phase, to_us(time - start_), pid_, gettid(), extra, requestor);
+    buf_ += "\"target\":";
+    append_json_string(buf_, TargetName(target));
+    buf_ += "}}";
+    std::fwrite(buf_.data(), 1, buf_.size(), file_.get());
+}
+
+const std::string& Tracer::TargetName(xcb_atom_t target)
+{
+    auto [it, is_new] = names_.try_emplace(target);
+    if (is_new)
+    {
+        auto reply = xcb_get_atom_name_reply(connection_, xcb_get_atom_name(connection_, target), nullptr);
+        if (reply != nullptr)
+        {
+            it->second.assign(xcb_get_atom_name_name(reply), xcb_get_atom_name_name_length(reply));
+            std::free(reply);
+        }
+    }
+    return it->second;
+}
+
+} // namespace xcpp
@@ -0,0 +1,107 @@
+#pragma once
+
+#ifndef XCLIPP_TRACER_HPP
+#define XCLIPP_TRACER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <sys/types.h>
+
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+namespace xcpp
+{
+
+// writes Chrome trace events (JSON array format, viewable in Perfetto or chrome://tracing), each one tagged
+// with requestor window and target name; events may come from several threads, each one is tagged with its thread
+class Tracer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // throws if `path` can't be created, `connection` is used to look up names of unknown targets
+    Tracer(const std::string& path, xcb_connection_t* connection);
+
+    ~Tracer();
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    // spares a round trip for targets known in advance, `name` is copied
+    void AddTarget(xcb_atom_t target, std::string_view name);
+
+    // synchronous work from `start` till now
+    void Complete(std::string_view name, Clock::time_point start, xcb_window_t requestor, xcb_atom_t target);
+
+    // span from `start` till now which other work may overlap, e.g. waiting for the requestor
+    void Async(std::string_view name, Clock::time_point start, xcb_window_t requestor, xcb_atom_t target);
+
+    void Instant(std::string_view name, xcb_window_t requestor, xcb_atom_t target);
+
+private:
+    // mutex_ must be held
+    void AddEvent(
+        std::string_view name, char phase, Clock::time_point time, xcb_window_t requestor, xcb_atom_t target,
+        std::string_view extra);
+
+    const std::string& TargetName(xcb_atom_t target);
+
+    std::unique_ptr<std::FILE, decltype(&std::fclose)> file_;
+    xcb_connection_t* connection_;
+    Clock::time_point start_;
+    pid_t pid_;
+    std::uint64_t next_id_ = 0;
+    std::unordered_map<xcb_atom_t, std::string> names_;
+    std::string buf_;
+    // guards the file and the members above, events are rare enough for a lock
+    std::mutex mutex_;
+};
+
+// complete event of the enclosing scope, costs a null check if tracing is disabled
+class TraceSpan
+{
+public:
+    TraceSpan(std::optional<Tracer>& tracer, std::string_view name, const xcb_selection_request_event_t& req) :
+        tracer_{tracer},
+        name_{name},
+        requestor_{req.requestor},
+        target_{req.target}
+    {
+        if (tracer_)
+        {
+            start_ = Tracer::Clock::now();
+        }
+    }
+
+    ~TraceSpan()
+    {
+        if (tracer_)
+        {
+            tracer_->Complete(name_, start_, requestor_, target_);
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    std::optional<Tracer>& tracer_;
+    std::string_view name_;
+    // copied, the request may be freed before the scope ends
+    xcb_window_t requestor_;
+    xcb_atom_t target_;
+    Tracer::Clock::time_point start_;
+};
+
+} // namespace xcpp
+
+#endif // XCLIPP_TRACER_HPP
@@ -0,0 +1,426 @@
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "transcode.hpp"
+
+namespace xcpp
+{
+
+static constexpr std::uint32_t invalid_code_point = 0xFFFF'FFFF;
+
+static constexpr std::string_view utf8_replacement = "\xEF\xBF\xBD"; // U+FFFD
+
+// length of the longest prefix of `p` consisting of ASCII characters only
+static std::size_t ascii_prefix(const unsigned char* p, std::size_t n) noexcept
+{
+    std::size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        if (unsigned mask = _mm_movemask_epi8(v))
+        {
+            return i + std::countr_zero(mask);
+        }
+    }
+#else
+    for (; i + 8 <= n; i += 8)
+    {
+        std::uint64_t w = 0;
+        std::memcpy(&w, p + i, sizeof(w));
+        if ((w & 0x8080'8080'8080'8080) != 0)
+        {
+            break;
+        }
+    }
+#endif
+    while (i < n && p[i] < 0x80)
+    {
+        ++i;
+    }
+    return i;
+}
+
+// number of bytes with the highest bit set
+static std::size_t non_ascii_count(const unsigned char* p, std::size_t n) noexcept
+{
+    std::size_t cnt = 0;
+    std::size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        cnt += std::popcount(static_cast<unsigned>(_mm_movemask_epi8(v)));
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        cnt += p[i] >> 7;
+    }
+    return cnt;
+}
+
+static bool is_continuation(unsigned char c) noexcept
+{
+    return (c & 0b1100'0000) == 0b1000'0000;
+}
+
+// decodes non-ASCII UTF-8 sequence at the start of `p`, returns code point and its length,
+// malformed sequence is reported as invalid_code_point of length 1
+static std::pair<std::uint32_t, std::size_t> decode_utf8(const unsigned char* p, std::size_t n) noexcept
+{
+    unsigned char c = p[0];
+    if (0xC2 <= c && c <= 0xDF)
+    {
+        if (n >= 2 && is_continuation(p[1]))
+        {
+            return {((c & 0b0001'1111u) << 6) | (p[1] & 0b0011'1111u), 2};
+        }
+    }
+    else if (0xE0 <= c && c <= 0xEF)
+    {
+        // reject overlong encodings and surrogate halves
+        unsigned char lo = c == 0xE0 ? 0xA0 : 0x80;
+        unsigned char hi = c == 0xED ? 0x9F : 0xBF;
+        if (n >= 3 && lo <= p[1] && p[1] <= hi && is_continuation(p[2]))
+        {
+            return {((c & 0b0000'1111u) << 12) | ((p[1] & 0b0011'1111u) << 6) | (p[2] & 0b0011'1111u), 3};
+        }
+    }
+    else if (0xF0 <= c && c <= 0xF4)
+    {
+        // reject overlong encodings and code points above U+10FFFF
+        unsigned char lo = c == 0xF0 ? 0x90 : 0x80;
+        unsigned char hi = c == 0xF4 ? 0x8F : 0xBF;
+        if (n >= 4 && lo <= p[1] && p[1] <= hi && is_continuation(p[2]) && is_continuation(p[3]))
+        {
+            return {
+                ((c & 0b0000'0111u) << 18) |
+                    ((p[1] & 0b0011'1111u) << 12) |
+                    ((p[2] & 0b0011'1111u) << 6) |
+                    (p[3] & 0b0011'1111u),
+                4};
+        }
+    }
+    return {invalid_code_point, 1};
+}
+
+// writes UTF-16 code unit in the given byte order
+template <bool BigEndian>
+static void put_utf16_unit(char* dst, std::uint16_t unit) noexcept
+{
+    dst[BigEndian ? 0 : 1] = static_cast<char>(unit >> 8);
+    dst[BigEndian ? 1 : 0] = static_cast<char>(unit & 0xFF);
+}
+
+// zero-extends bytes of `p` into UTF-16 code units up to `n` bytes, or the first non-ASCII one if `AsciiOnly`,
+// returns number of converted bytes
+template <bool BigEndian, bool AsciiOnly>
+static std::size_t widen(const unsigned char* p, std::size_t n, char* dst) noexcept
+{
+    std::size_t i = 0;
+#if defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        if (AsciiOnly && _mm_movemask_epi8(v) != 0)
+        {
+            break;
+        }
+        __m128i lo = BigEndian ? _mm_unpacklo_epi8(zero, v) : _mm_unpacklo_epi8(v, zero);
+        __m128i hi = BigEndian ? _mm_unpackhi_epi8(zero, v) : _mm_unpackhi_epi8(v, zero);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i + 16), hi);
+    }
+#endif
+    for (; i < n && (!AsciiOnly || p[i] < 0x80); ++i)
+    {
+        put_utf16_unit<BigEndian>(dst + 2 * i, p[i]);
+    }
+    return i;
+}
+
+template <bool BigEndian>
+static std::pair<std::size_t, std::size_t> utf8_to_utf16(
+    std::string_view src, char* dst, std::size_t capacity) noexcept
+{
+    auto p = reinterpret_cast<const unsigned char*>(src.data());
+    std::size_t n = src.size();
+    std::size_t i = 0;
+    std::size_t o = 0;
+    while (i < n && capacity - o >= 2)
+    {
+        std::size_t run = widen<BigEndian, true>(p + i, std::min(n - i, (capacity - o) / 2), dst + o);
+        i += run;
+        o += 2 * run;
+        if (i == n || capacity - o < 2)
+        {
+            break;
+        }
+        auto [code_point, len] = decode_utf8(p + i, n - i);
+        if (code_point == invalid_code_point)
+        {
+            code_point = 0xFFFD;
+        }
+        if (code_point < 0x1'0000)
+        {
+            put_utf16_unit<BigEndian>(dst + o, code_point);
+            o += 2;
+        }
+        else
+        {
+            // surrogate pair
+            if (capacity - o < 4)
+            {
+                break;
+            }
+            code_point -= 0x1'0000;
+            put_utf16_unit<BigEndian>(dst + o, 0xD800 | (code_point >> 10));
+            put_utf16_unit<BigEndian>(dst + o + 2, 0xDC00 | (code_point & 0x3FF));
+            o += 4;
+        }
+        i += len;
+    }
+    return {i, o};
+}
+
+static bool is_uri_unreserved(unsigned char c) noexcept
+{
+    return
+        ('A' <= c && c <= 'Z') ||
+        ('a' <= c && c <= 'z') ||
+        ('0' <= c && c <= '9') ||
+        c == '/' || c == '.' || c == '_' || c == '-' || c == '~';
+}
+
+bool is_ascii(std::string_view data) noexcept
+{
+    return ascii_prefix(reinterpret_cast<const unsigned char*>(data.data()), data.size()) == data.size();
+}
+
+std::size_t latin1_to_utf8_size(std::string_view src) noexcept
+{
+    return src.size() + non_ascii_count(reinterpret_cast<const unsigned char*>(src.data()), src.size());
+}
+
+std::pair<std::size_t, std::size_t> latin1_to_utf8(std::string_view src, char* dst, std::size_t capacity) noexcept
+{
+    auto p = reinterpret_cast<const unsigned char*>(src.data());
+    std::size_t n = src.size();
+    std::size_t i = 0;
+    std::size_t o = 0;
+    while (i < n && o < capacity)
+    {
+        std::size_t run = ascii_prefix(p + i, std::min(n - i, capacity - o));
+        std::memcpy(dst + o, p + i, run);
+        i += run;
+        o += run;
+        // non-ASCII character takes 2 bytes
+        if (i == n || capacity - o < 2)
+        {
+            break;
+        }
+        dst[o++] = static_cast<char>(0b1100'0000 | (p[i] >> 6));
+        dst[o++] = static_cast<char>(0b1000'0000 | (p[i] & 0b0011'1111));
+        ++i;
+    }
+    return {i, o};
+}
+
+std::size_t utf8_to_latin1_size(std::string_view src) noexcept
+{
+    auto p = reinterpret_cast<const unsigned char*>(src.data());
+    std::size_t n = src.size();
+    std::size_t i = 0;
+    std::size_t size = 0;
+    while (i < n)
+    {
+        std::size_t run = ascii_prefix(p + i, n - i);
+        i += run;
+        size += run;
+        if (i == n)
+        {
+            break;
+        }
+        i += decode_utf8(p + i, n - i).second;
+        ++size;
+    }
+    return size;
+}
+
+std::pair<std::size_t, std::size_t> utf8_to_latin1(
+    std::string_view src, char* dst, std::size_t capacity, char replacement) noexcept
+{
+    auto p = reinterpret_cast<const unsigned char*>(src.data());
+    std::size_t n = src.size();
+    std::size_t i = 0;
+    std::size_t o = 0;
+    while (i < n && o < capacity)
+    {
+        std::size_t run = ascii_prefix(p + i, std::min(n - i, capacity - o));
+        std::memcpy(dst + o, p + i, run);
+        i += run;
+        o += run;
+        if (i == n || o == capacity)
+        {
+            break;
+        }
+        auto [code_point, len] = decode_utf8(p + i, n - i);
+        dst[o++] = code_point <= 0xFF ? static_cast<char>(code_point) : replacement;
+        i += len;
+    }
+    return {i, o};
+}
+
+std::size_t sanitize_utf8_size(std::string_view src) noexcept
+{
+    auto p = reinterpret_cast<const unsigned char*>(src.data());
+    std::size_t n = src.size();
+    std::size_t i = 0;
+    std::size_t size = 0;
+    while (i < n)
+    {
+        std::size_t run = ascii_prefix(p + i, n - i);
+        i += run;
+        size += run;
+        if (i == n)
+        {
+            break;
+        }
+        auto [code_point, len] = decode_utf8(p + i, n - i);
+        i += len;
+        size += code_point == invalid_code_point ? utf8_replacement.size() : len;
+    }
+    return size;
+}
+
+std::pair<std::size_t, std::size_t> sanitize_utf8(std::string_view src, char* dst, std::size_t capacity) noexcept
+{
+    auto p = reinterpret_cast<const unsigned char*>(src.data());
+    std::size_t n = src.size();
+    std::size_t i = 0;
+    std::size_t o = 0;
+    while (i < n && o < capacity)
+    {
+        std::size_t run = ascii_prefix(p + i, std::min(n - i, capacity - o));
+        std::memcpy(dst + o, p + i, run);
+        i += run;
+        o += run;
+        if (i == n || o == capacity)
+        {
+            break;
+        }
+        auto [code_point, len] = decode_utf8(p + i, n - i);
+        std::string_view out =
+            code_point == invalid_code_point ? utf8_replacement : std::string_view{src.data() + i, len};
+        if (capacity - o < out.size())
+        {
+            break;
+        }
+        std::memcpy(dst + o, out.data(), out.size());
+        i += len;
+        o += out.size();
+    }
+    return {i, o};
+}
+
+std::size_t utf8_to_utf16_size(std::string_view src) noexcept
+{
+    auto p = reinterpret_cast<const unsigned char*>(src.data());
+    std::size_t n = src.size();
+    std::size_t i = 0;
+    std::size_t size = 0;
+    while (i < n)
+    {
+        std::size_t run = ascii_prefix(p + i, n - i);
+        i += run;
+        size += 2 * run;
+        if (i == n)
+        {
+            break;
+        }
+        auto [code_point, len] = decode_utf8(p + i, n - i);
+        i += len;
+        size += code_point != invalid_code_point && code_point >= 0x1'0000 ? 4 : 2;
+    }
+    return size;
+}
+
+std::pair<std::size_t, std::size_t> utf8_to_utf16le(std::string_view src, char* dst, std::size_t capacity) noexcept
+{
+    return utf8_to_utf16<false>(src, dst, capacity);
+}
+
+std::pair<std::size_t, std::size_t> utf8_to_utf16be(std::string_view src, char* dst, std::size_t capacity) noexcept
+{
+    return utf8_to_utf16<true>(src, dst, capacity);
+}
+
+std::size_t latin1_to_utf16_size(std::string_view src) noexcept
+{
+    return 2 * src.size();
+}
+
+std::pair<std::size_t, std::size_t> latin1_to_utf16le(std::string_view src, char* dst, std::size_t capacity) noexcept
+{
+    std::size_t n = widen<false, false>(
+        reinterpret_cast<const unsigned char*>(src.data()), std::min(src.size(), capacity / 2), dst);
+    return {n, 2 * n};
+}
+
+std::pair<std::size_t, std::size_t> latin1_to_utf16be(std::string_view src, char* dst, std::size_t capacity) noexcept
+{
+    std::size_t n = widen<true, false>(
+        reinterpret_cast<const unsigned char*>(src.data()), std::min(src.size(), capacity / 2), dst);
+    return {n, 2 * n};
+}
+
+std::size_t uri_path_size(std::string_view file_path) noexcept
+{
+    std::size_t as_is_char_cnt = std::ranges::count_if(file_path, is_uri_unreserved);
+    return as_is_char_cnt + 3 * (file_path.size() - as_is_char_cnt);
+}
+
+std::pair<std::size_t, std::size_t> encode_uri_path(
+    std::string_view file_path, char* dst, std::size_t capacity) noexcept
+{
+    std::size_t i = 0;
+    std::size_t o = 0;
+    for (; i < file_path.size(); ++i)
+    {
+        unsigned char c = file_path[i];
+        if (is_uri_unreserved(c))
+        {
+            if (o == capacity)
+            {
+                break;
+            }
+            dst[o++] = c;
+        }
+        else
+        {
+            if (capacity - o < 3)
+            {
+                break;
+            }
+            unsigned char hi = c >> 4;
+            unsigned char lo = c & 0xF;
+            dst[o++] = '%';
+            dst[o++] = hi > 9 ? 'A' + hi - 10 : '0' + hi;
+            dst[o++] = lo > 9 ? 'A' + lo - 10 : '0' + lo;
+        }
+    }
+    return {i, o};
+}
+
+} // namespace xcpp
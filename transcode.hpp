@@ -0,0 +1,100 @@
+#pragma once
+
+#ifndef XCLIPP_TRANSCODE_HPP
+#define XCLIPP_TRANSCODE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+#include <utility>
+
+namespace xcpp
+{
+
+// All transcoders convert as much of `src` as fits into `dst` of `capacity` bytes,
+// only whole characters are written, so conversion can be resumed from the returned position
+// (capacity of at least 4 bytes always gives progress).
+// Return number of consumed bytes of `src` and number of written bytes of `dst`.
+// Size functions return exact size of the whole conversion result.
+
+bool is_ascii(std::string_view data) noexcept;
+
+std::size_t latin1_to_utf8_size(std::string_view src) noexcept;
+
+std::pair<std::size_t, std::size_t> latin1_to_utf8(std::string_view src, char* dst, std::size_t capacity) noexcept;
+
+// malformed sequences and characters outside of Latin-1 are replaced with `replacement`
+std::size_t utf8_to_latin1_size(std::string_view src) noexcept;
+
+std::pair<std::size_t, std::size_t> utf8_to_latin1(
+    std::string_view src, char* dst, std::size_t capacity, char replacement = '?') noexcept;
+
+// malformed sequences are replaced with U+FFFD
+std::size_t sanitize_utf8_size(std::string_view src) noexcept;
+
+std::pair<std::size_t, std::size_t> sanitize_utf8(std::string_view src, char* dst, std::size_t capacity) noexcept;
+
+// malformed sequences are replaced with U+FFFD, no BOM is written
+std::size_t utf8_to_utf16_size(std::string_view src) noexcept;
+
+std::pair<std::size_t, std::size_t> utf8_to_utf16le(std::string_view src, char* dst, std::size_t capacity) noexcept;
+
+std::pair<std::size_t, std::size_t> utf8_to_utf16be(std::string_view src, char* dst, std::size_t capacity) noexcept;
+
+std::size_t latin1_to_utf16_size(std::string_view src) noexcept;
+
+std::pair<std::size_t, std::size_t> latin1_to_utf16le(std::string_view src, char* dst, std::size_t capacity) noexcept;
+
+std::pair<std::size_t, std::size_t> latin1_to_utf16be(std::string_view src, char* dst, std::size_t capacity) noexcept;
+
+// percent-encodes file path for use in URI
+std::size_t uri_path_size(std::string_view file_path) noexcept;
+
+std::pair<std::size_t, std::size_t> encode_uri_path(
+    std::string_view file_path, char* dst, std::size_t capacity) noexcept;
+
+inline constexpr std::string_view utf16le_bom = "\xFF\xFE";
+
+inline constexpr std::string_view utf16be_bom = "\xFE\xFF";
+
+struct Transcoder
+{
+    std::size_t(*size)(std::string_view) noexcept;
+    std::pair<std::size_t, std::size_t>(*transcode)(std::string_view, char*, std::size_t) noexcept;
+};
+
+inline constexpr Transcoder copy_transcoder =
+{
+    [](std::string_view src) noexcept { return src.size(); },
+    [](std::string_view src, char* dst, std::size_t capacity) noexcept
+    {
+        std::size_t n = std::min(src.size(), capacity);
+        std::memcpy(dst, src.data(), n);
+        return std::pair{n, n};
+    }
+};
+
+inline constexpr Transcoder latin1_to_utf8_transcoder = {latin1_to_utf8_size, latin1_to_utf8};
+
+inline constexpr Transcoder utf8_to_latin1_transcoder =
+{
+    utf8_to_latin1_size,
+    [](std::string_view src, char* dst, std::size_t capacity) noexcept { return utf8_to_latin1(src, dst, capacity); }
+};
+
+inline constexpr Transcoder sanitize_utf8_transcoder = {sanitize_utf8_size, sanitize_utf8};
+
+inline constexpr Transcoder utf8_to_utf16le_transcoder = {utf8_to_utf16_size, utf8_to_utf16le};
+
+inline constexpr Transcoder utf8_to_utf16be_transcoder = {utf8_to_utf16_size, utf8_to_utf16be};
+
+inline constexpr Transcoder latin1_to_utf16le_transcoder = {latin1_to_utf16_size, latin1_to_utf16le};
+
+inline constexpr Transcoder latin1_to_utf16be_transcoder = {latin1_to_utf16_size, latin1_to_utf16be};
+
+inline constexpr Transcoder uri_path_transcoder = {uri_path_size, encode_uri_path};
+
+} // namespace xcpp
+
+#endif // XCLIPP_TRANSCODE_HPP
@@ -0,0 +1,27 @@
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <xcb/xcb.h>
+
+#include "transport.hpp"
+
+namespace xcpp
+{
+
+DisplayTransport::DisplayTransport(std::string display) noexcept : display_{std::move(display)}
+{
+}
+
+std::pair<Connection, int> DisplayTransport::Connect() const
+{
+    int screen_id = 0;
+    Connection connection{xcb_connect(display_.empty() ? nullptr : display_.c_str(), &screen_id), xcb_disconnect};
+    if (int err = xcb_connection_has_error(connection.get()))
+    {
+        throw std::runtime_error("Failed to connect to X server, XCB_CONN_* error code " + std::to_string(err));
+    }
+    return {std::move(connection), screen_id};
+}
+
+} // namespace xcpp
@@ -0,0 +1,42 @@
+#pragma once
+
+#ifndef XCLIPP_TRANSPORT_HPP
+#define XCLIPP_TRANSPORT_HPP
+
+#include <memory>
+#include <string>
+#include <utility>
+
+#include <xcb/xcb.h>
+
+namespace xcpp
+{
+
+using Connection = std::unique_ptr<xcb_connection_t, decltype(&xcb_disconnect)>;
+
+// source of connections to X server, all communication of a client goes through the connection it gets
+class Transport
+{
+public:
+    virtual ~Transport() = default;
+
+    // new connection and number of its default screen, throws on failure
+    virtual std::pair<Connection, int> Connect() const = 0;
+};
+
+// connects to a real X server
+class DisplayTransport : public Transport
+{
+public:
+    // empty `display` means $DISPLAY
+    explicit DisplayTransport(std::string display = {}) noexcept;
+
+    std::pair<Connection, int> Connect() const override;
+
+private:
+    std::string display_;
+};
+
+} // namespace xcpp
+
+#endif // XCLIPP_TRANSPORT_HPP
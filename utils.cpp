@@ -2,14 +2,14 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
-#include <iostream>
-#include <memory>
 #include <string_view>
 #include <utility>
 
+#include <unistd.h>
 #include <xcb/xcb.h>
 #include <xcb/xproto.h>
 
+#include "log.hpp"
 #include "utils.hpp"
 
 namespace xcpp
@@ -22,33 +22,25 @@ std::size_t PairHash::operator()(std::pair<xcb_window_t, xcb_atom_t> p) const no
     return std::hash<std::uint64_t>{}(n);
 }
 
-template <class... Args>
-void Logger::operator()(Args&&... args) const
+void FileDescriptor::Reset(int fd) noexcept
 {
-    std::string_view file_name = loc_.file_name();
-    file_name.remove_prefix(file_name.rfind('/') + 1);
-    if constexpr (sizeof...(args) == 0)
+    if (fd_ != -1 && fd_ != fd)
     {
-        std::clog << file_name << ':' << loc_.line() << '\n';
-    }
-    else
-    {
-        std::clog << file_name << ':' << loc_.line() << ": ";
-        (std::clog << ... << std::forward<Args>(args));
-        std::clog << '\n';
+        close(fd_);
     }
+    fd_ = fd;
 }
 
-void ErrorLogger::operator()(xcb_generic_error_t* err) const
+void Logger::Log(LogLevel level, std::uint8_t error_code, std::string_view msg) const noexcept
 {
-    if (msg_.empty())
-    {
-        Logger::operator()(error_string(err->error_code));
-    }
-    else
-    {
-        Logger::operator()(error_string(err->error_code), ": ", msg_);
-    }
+    LogRecord record;
+    record.file = loc_.file_name();
+    record.line = loc_.line();
+    record.level = level;
+    record.error_code = error_code;
+    record.msg_size = std::min(msg.size(), LogRecord::max_msg_size);
+    std::memcpy(record.msg, msg.data(), record.msg_size);
+    log_record(record);
 }
 
 std::string_view error_string(std::uint8_t error_code) noexcept
@@ -76,13 +68,24 @@ std::string_view error_string(std::uint8_t error_code) noexcept
     }
 }
 
-bool is_icccm_string(std::string_view data) noexcept
+static bool is_icccm_control(unsigned char c) noexcept
+{
+    return c == '\n' || c == '\t';
+}
+
+// other whitespace controls, e.g. of \r\n line ends, aren't allowed by ICCCM, but occur in text from other systems
+static bool is_text_control(unsigned char c) noexcept
+{
+    return is_icccm_control(c) || c == '\r' || c == '\f' || c == '\v';
+}
+
+static bool is_latin1(std::string_view data, bool (*is_allowed_control)(unsigned char) noexcept) noexcept
 {
     return std::ranges::all_of(
-        data, [](unsigned char c) { return (0x20 <= c && c <= 0x7E) || 0xA0 <= c || c == '\n' || c == '\t'; });
+        data, [=](unsigned char c) { return (0x20 <= c && c <= 0x7E) || 0xA0 <= c || is_allowed_control(c); });
 }
 
-bool is_icccm_utf8_string(std::string_view data) noexcept
+static bool is_utf8(std::string_view data, bool (*is_allowed_control)(unsigned char) noexcept) noexcept
 {
     std::size_t i = 0;
     std::uint32_t value = 0;
@@ -92,7 +95,7 @@ bool is_icccm_utf8_string(std::string_view data) noexcept
         std::size_t n = 0;
         if ((c & 0b1000'0000) == 0)
         {
-            if ((c < 0x20 && c != '\n' && c != '\t') || c == 0x7F)
+            if ((c < 0x20 && !is_allowed_control(c)) || c == 0x7F)
             {
                 return false;
             }
@@ -150,60 +153,24 @@ bool is_icccm_utf8_string(std::string_view data) noexcept
     return true;
 }
 
-static bool has_to_be_encoded(char c) noexcept
+bool is_icccm_string(std::string_view data) noexcept
 {
-    return
-        ('A' <= c && c <= 'Z') ||
-        ('a' <= c && c <= 'z') ||
-        ('0' <= c && c <= '9') ||
-        c == '/' || c == '.' || c == '_' || c == '-' || c == '~';
+    return is_latin1(data, is_icccm_control);
 }
 
-static void encode(std::string_view file_path, char* buf) noexcept
-{
-    for (unsigned char c : file_path)
-    {
-        if (has_to_be_encoded(c))
-        {
-            *(buf++) = c;
-        }
-        else
-        {
-            unsigned char hi = c >> 4;
-            unsigned char lo = c & 0xF;
-            *(buf++) = '%';
-            *(buf++) = hi > 9 ? 'A' + hi - 10 : '0' + hi;
-            *(buf++) = lo > 9 ? 'A' + lo - 10 : '0' + lo;
-        }
-    }
-}
-
-static std::size_t uri_len(std::string_view file_path) noexcept
+bool is_icccm_utf8_string(std::string_view data) noexcept
 {
-    std::size_t as_is_char_cnt = std::ranges::count_if(file_path, has_to_be_encoded);
-    return as_is_char_cnt + 3 * (file_path.size() - as_is_char_cnt);
+    return is_utf8(data, is_icccm_control);
 }
 
-std::pair<std::unique_ptr<char[]>, std::size_t> to_uri(std::string_view file_path)
+bool is_text_latin1(std::string_view data) noexcept
 {
-    constexpr std::string_view prefix = "file://";
-    std::size_t size = prefix.size() + uri_len(file_path) + 2;
-    char* buf = new char[size];
-    std::memcpy(buf, prefix.data(), prefix.size());
-    encode(file_path, buf + prefix.size());
-    buf[size - 2] = '\r';
-    buf[size - 1] = '\n';
-    return {std::unique_ptr<char[]>{buf}, size};
+    return is_latin1(data, is_text_control);
 }
 
-std::pair<std::unique_ptr<char[]>, std::size_t> to_file_manager_clipboard_format(std::string_view file_path)
+bool is_text_utf8(std::string_view data) noexcept
 {
-    constexpr std::string_view prefix = "copy\nfile://";
-    std::size_t size = prefix.size() + uri_len(file_path);
-    char* buf = new char[size];
-    std::memcpy(buf, prefix.data(), prefix.size());
-    encode(file_path, buf + prefix.size());
-    return {std::unique_ptr<char[]>{buf}, size};
+    return is_utf8(data, is_text_control);
 }
 
 } // namespace xcpp
@@ -5,7 +5,6 @@
 
 #include <cstddef>
 #include <cstdint>
-#include <memory>
 #include <source_location>
 #include <string>
 #include <string_view>
@@ -14,6 +13,8 @@
 #include <xcb/xcb.h>
 #include <xcb/xproto.h>
 
+#include "log.hpp"
+
 namespace xcpp
 {
 
@@ -22,6 +23,45 @@ struct PairHash
     std::size_t operator()(std::pair<xcb_window_t, xcb_atom_t> p) const noexcept;
 };
 
+// owning wrapper of file descriptor
+class FileDescriptor
+{
+public:
+    explicit FileDescriptor(int fd = -1) noexcept : fd_{fd}
+    {
+    }
+
+    FileDescriptor(FileDescriptor&& other) noexcept : fd_{std::exchange(other.fd_, -1)}
+    {
+    }
+
+    FileDescriptor& operator=(FileDescriptor&& other) noexcept
+    {
+        Reset(std::exchange(other.fd_, -1));
+        return *this;
+    }
+
+    ~FileDescriptor()
+    {
+        Reset();
+    }
+
+    int Get() const noexcept
+    {
+        return fd_;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return fd_ != -1;
+    }
+
+    void Reset(int fd = -1) noexcept;
+
+private:
+    int fd_;
+};
+
 class Logger
 {
 public:
@@ -29,13 +69,16 @@ public:
     {
     }
 
-    template <class... Args>
-    void operator()(Args&&... args) const;
+protected:
+    // queues message for the logging thread, `error_code` is X error code or 0
+    void Log(LogLevel level, std::uint8_t error_code, std::string_view msg) const noexcept;
 
 private:
     std::source_location loc_;
 };
 
+// logs errors of requests whose failure isn't fatal, messages above max_log_level are compiled out
+template <LogLevel level = LogLevel::ERROR>
 class ErrorLogger : public Logger
 {
 public:
@@ -45,7 +88,22 @@ public:
     {
     }
 
-    void operator()(xcb_generic_error_t* err) const;
+    void operator()(xcb_generic_error_t* err) const noexcept
+    {
+        if constexpr (level <= max_log_level)
+        {
+            Log(level, err->error_code, msg_);
+        }
+    }
+
+    // for failures other than X errors
+    void operator()() const noexcept
+    {
+        if constexpr (level <= max_log_level)
+        {
+            Log(level, 0, msg_);
+        }
+    }
 
 private:
     std::string_view msg_;
@@ -59,9 +117,11 @@ bool is_icccm_string(std::string_view data) noexcept;
 // non-control UTF-8 characters or \n, \t
 bool is_icccm_utf8_string(std::string_view data) noexcept;
 
-std::pair<std::unique_ptr<char[]>, std::size_t> to_uri(std::string_view file_path);
+// as above, but also allow \r, \f, \v, so text from other systems isn't taken for binary data;
+// such text is neither STRING nor UTF8_STRING, these only tell its encoding
+bool is_text_latin1(std::string_view data) noexcept;
 
-std::pair<std::unique_ptr<char[]>, std::size_t> to_file_manager_clipboard_format(std::string_view file_path);
+bool is_text_utf8(std::string_view data) noexcept;
 
 } // namespace xcpp
 
@@ -0,0 +1,59 @@
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+
+#include <xcb/xcb.h>
+#include <xcb/xfixes.h>
+#include <xcb/xproto.h>
+
+#include "client.hpp"
+#include "reader.hpp"
+#include "watcher.hpp"
+
+namespace xcpp
+{
+
+Watcher::Watcher(const ReaderOptions& options) :
+    Client{{}, options.display, options.transport},
+    selection_{options.primary ? xcb_atom_t{XCB_ATOM_PRIMARY} : clipboard_atom_}
+{
+    const xcb_query_extension_reply_t* xfixes = xcb_get_extension_data(connection_.get(), &xcb_xfixes_id);
+    if (xfixes == nullptr || !xfixes->present)
+    {
+        throw std::runtime_error("XFixes extension is not supported by X server");
+    }
+    xfixes_first_event_ = xfixes->first_event;
+
+    // version has to be negotiated before any other XFixes request, selection events appeared in 1.0
+    auto version_cookie = xcb_xfixes_query_version(connection_.get(), 1, 0);
+    std::uint32_t mask =
+        XCB_XFIXES_SELECTION_EVENT_MASK_SET_SELECTION_OWNER |
+        XCB_XFIXES_SELECTION_EVENT_MASK_SELECTION_WINDOW_DESTROY |
+        XCB_XFIXES_SELECTION_EVENT_MASK_SELECTION_CLIENT_CLOSE;
+    auto select_cookie = xcb_xfixes_select_selection_input_checked(connection_.get(), window_, selection_, mask);
+    Await(
+        version_cookie, xcb_xfixes_query_version_reply, [](xcb_xfixes_query_version_reply_t*) {},
+        "Failed to get XFixes version");
+    Await(select_cookie, "Failed to subscribe for selection ownership changes");
+}
+
+bool Watcher::Watch(const std::function<bool(const xcb_xfixes_selection_notify_event_t&)>& on_change)
+{
+    xcb_flush(connection_.get());
+    while (std::unique_ptr<xcb_generic_event_t, decltype(&std::free)> event{
+        xcb_wait_for_event(connection_.get()), std::free})
+    {
+        auto notify = reinterpret_cast<xcb_xfixes_selection_notify_event_t*>(event.get());
+        if ((event->response_type & ~0x80) == xfixes_first_event_ + XCB_XFIXES_SELECTION_NOTIFY &&
+            notify->selection == selection_ &&
+            !on_change(*notify))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace xcpp
@@ -0,0 +1,37 @@
+#pragma once
+
+#ifndef XCLIPP_WATCHER_HPP
+#define XCLIPP_WATCHER_HPP
+
+#include <cstdint>
+#include <functional>
+
+#include <xcb/xcb.h>
+#include <xcb/xfixes.h>
+#include <xcb/xproto.h>
+
+#include "client.hpp"
+#include "reader.hpp"
+
+namespace xcpp
+{
+
+// reports selection ownership changes as XFixes delivers them, without polling
+class Watcher : private Client
+{
+public:
+    // watches selection chosen by `options`, target is ignored, throws if XFixes is not supported
+    explicit Watcher(const ReaderOptions& options = {});
+
+    // blocks until ownership changes and passes the notification to `on_change`, returning false from it
+    // stops watching, returns false on I/O error
+    bool Watch(const std::function<bool(const xcb_xfixes_selection_notify_event_t&)>& on_change);
+
+private:
+    xcb_atom_t selection_;
+    std::uint8_t xfixes_first_event_;
+};
+
+} // namespace xcpp
+
+#endif // XCLIPP_WATCHER_HPP